@@ -0,0 +1,54 @@
+/**
+ * @file coroutine_handler.cpp
+ * @author mina (mina@disappea.rs)
+ * @brief Example showing how to use coroutine handlers
+ * @date 2024-12-30
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * Handlers returning `W::Task<>` can `co_await` blocking work through
+ * `W::blocking` or wait with `W::sleep`. The event loop keeps serving other
+ * requests in the meantime and resumes the handler when the work is done.
+ */
+
+#include <webli/http.hpp>
+#include <webli/router.hpp>
+#include <webli/server.hpp>
+#include <webli/task.hpp>
+#include <webli/webclient.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <string>
+
+static const char *HTTP_METHOD_GET = "GET";
+
+int main() {
+  W::Router router;
+
+  router.get("/upstream", [](const W::Http::Request &req,
+                             std::shared_ptr<W::Http::Response> res)
+                 -> W::Task<> {
+    // the request runs on the blocking pool, not on the loop thread
+    auto upstream = co_await W::blocking([]() {
+      W::HttpsClient client("example.com");
+      return client.send(HTTP_METHOD_GET, "/", {}, "");
+    });
+
+    res->setBody(std::to_string(static_cast<int>(upstream.getStatusCode())));
+  });
+
+  router.get("/later", [](const W::Http::Request &req,
+                          std::shared_ptr<W::Http::Response> res)
+                 -> W::Task<> {
+    co_await W::sleep(std::chrono::milliseconds(500));
+    res->setBody("later");
+  });
+
+  W::Server server{router};
+
+  server.ssl_config("key.pem", "cert.pem");
+  server.listen("127.0.0.1", 443);
+
+  return 0;
+}
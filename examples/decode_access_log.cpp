@@ -0,0 +1,48 @@
+/**
+ * @file decode_access_log.cpp
+ * @author mina (mina@disappea.rs)
+ * @brief Example showing how to write and read a binary access log
+ * @date 2025-01-12
+ *
+ * @copyright Copyright (c) 2024
+ *
+ * A binary access log only copies fixed size records, which keeps the writer
+ * cheap under load. Run the server with `serve` and turn the log into common
+ * log format lines with `decode <file>` afterwards.
+ */
+
+#include <webli/access_log.hpp>
+#include <webli/http.hpp>
+#include <webli/router.hpp>
+#include <webli/server.hpp>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string_view>
+
+int main(int argc, char **argv) {
+  if (argc == 3 && std::string_view(argv[1]) == "decode") {
+    std::ifstream in(argv[2], std::ios::binary);
+    if (!W::AccessLog::decode(in, std::cout, W::AccessLogFormat::Common)) {
+      std::cerr << "not a complete binary access log\n";
+      return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+  }
+
+  W::Router router;
+
+  router.get("/", [](const W::Http::Request &req,
+                     std::shared_ptr<W::Http::Response> res) {
+    res->setBody("logged");
+  });
+
+  W::Server server{router,
+                   {.access_log = {.format = W::AccessLogFormat::Binary,
+                                   .path = "access.log",
+                                   .sample = 10}}};
+
+  server.ssl_config("key.pem", "cert.pem");
+  server.listen("0.0.0.0", 4000);
+}
@@ -0,0 +1,262 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace W {
+/**
+ * @brief Line format of the access log
+ *
+ */
+enum class AccessLogFormat {
+  /** @brief `GET	200 | /path`, like the server always printed */
+  Text,
+  /** @brief NCSA common log format */
+  Common,
+  /**
+   * @brief fixed size records in host byte order, turned into text offline
+   * with `AccessLog::decode`
+   */
+  Binary
+};
+
+/**
+ * @brief Access log options
+ *
+ */
+using AccessLogOptions = struct AccessLogOptions {
+  /** @brief write an access log at all */
+  bool enabled{true};
+
+  /** @brief record format */
+  AccessLogFormat format{AccessLogFormat::Text};
+
+  /** @brief file the log is appended to (empty = stderr) */
+  std::string path{};
+
+  /** @brief log one of every n requests, errors always get logged */
+  std::uint32_t sample{1};
+
+  /** @brief records buffered per thread, further ones get dropped */
+  std::size_t buffer_records{1024};
+
+  /** @brief time the writer sleeps while the buffers are empty */
+  std::chrono::milliseconds flush_interval{10};
+};
+
+/**
+ * @brief One access log entry, also the record of the binary format
+ *
+ */
+struct AccessRecord {
+  /** @brief unix time in nanoseconds */
+  std::int64_t time{0};
+
+  /** @brief client address in network byte order */
+  std::uint32_t address{0};
+
+  /** @brief response bytes */
+  std::uint32_t bytes{0};
+
+  /** @brief response status code */
+  std::uint16_t status{0};
+
+  /** @brief the request upgraded to a websocket */
+  std::uint8_t websocket{0};
+
+  /** @brief used bytes of path */
+  std::uint8_t path_size{0};
+
+  /** @brief request method (not terminated if all 8 bytes are used) */
+  char method[8]{};
+
+  /** @brief request path, truncated */
+  char path[100]{};
+};
+
+/**
+ * @brief Asynchronous access log.
+ *
+ * Every logging thread gets its own single producer ring buffer, so
+ * `record` never takes a lock or touches a file. One writer thread drains
+ * the rings, formats the records and writes them out. Records that find
+ * their ring full are counted and dropped instead of waiting. Diagnostic
+ * lines (`note`) take the same way through rings of their own and always go
+ * to stderr.
+ *
+ */
+class AccessLog {
+public:
+  /**
+   * @brief Construct a new Access Log and start the writer
+   *
+   * @param options log options
+   * @param notes start the writer for `note` even if the log is disabled
+   */
+  explicit AccessLog(const AccessLogOptions &options, bool notes = false);
+
+  /**
+   * @brief Stop the writer after it wrote all buffered records
+   *
+   */
+  ~AccessLog();
+
+  AccessLog(const AccessLog &) = delete;
+  AccessLog &operator=(const AccessLog &) = delete;
+
+  /**
+   * @brief log a request, never blocks
+   *
+   * @param address client address
+   * @param method request method
+   * @param path request path
+   * @param status response status code
+   * @param bytes response size in bytes
+   * @param websocket the request upgraded to a websocket
+   */
+  void record(struct in_addr address, std::string_view method,
+              std::string_view path, int status, std::size_t bytes,
+              bool websocket = false) noexcept;
+
+  /**
+   * @brief write a diagnostic line to stderr, never blocks. Dropped if the
+   * ring of the thread is full or no writer runs.
+   *
+   * @param line line including the newline
+   */
+  void note(std::string line) noexcept;
+
+  /**
+   * @brief Get the number of records dropped because a ring was full
+   *
+   * @return std::uint64_t
+   */
+  std::uint64_t getDropped() const noexcept;
+
+  /**
+   * @brief format a single record
+   *
+   * @param record record
+   * @param format Text or Common
+   * @return std::string - line including the newline
+   */
+  static std::string format(const AccessRecord &record,
+                            AccessLogFormat format);
+
+  /**
+   * @brief turn a binary log into text lines
+   *
+   * @param in binary log
+   * @param out text output
+   * @param format Text or Common
+   * @return false if the input is no binary log or truncated
+   */
+  static bool decode(std::istream &in, std::ostream &out,
+                     AccessLogFormat format);
+
+private:
+  /**
+   * @brief Single producer single consumer record ring
+   *
+   */
+  struct Ring {
+    explicit Ring(std::size_t capacity);
+
+    /** @brief records, capacity is a power of two */
+    std::vector<AccessRecord> records;
+
+    /** @brief next record the writer reads */
+    std::atomic<std::size_t> head{0};
+
+    /** @brief next record the producer writes */
+    std::atomic<std::size_t> tail{0};
+
+    /** @brief diagnostic lines, capacity is a power of two */
+    std::vector<std::string> notes;
+
+    /** @brief next line the writer reads */
+    std::atomic<std::size_t> notes_head{0};
+
+    /** @brief next line the producer writes */
+    std::atomic<std::size_t> notes_tail{0};
+
+    /** @brief the producing thread exited */
+    std::atomic<bool> closed{false};
+
+    /** @brief requests seen for sampling (producer only) */
+    std::uint32_t seen{0};
+  };
+
+  /**
+   * @brief Get the ring of the calling thread, registered on first use
+   *
+   * @return Ring&
+   */
+  Ring &local();
+
+  /**
+   * @brief writer thread routine
+   *
+   * @param stop stop token of the writer
+   */
+  void write(std::stop_token stop);
+
+  /**
+   * @brief drain all rings into the output
+   *
+   * @return true if a record was written
+   */
+  bool drain();
+
+  /**
+   * @brief write bytes to a descriptor
+   *
+   * @param fd log descriptor or stderr
+   * @param data bytes to write
+   */
+  void output(int fd, std::string_view data) noexcept;
+
+  /** @brief log options */
+  AccessLogOptions options;
+
+  /** @brief unique id, thread local rings are looked up with it */
+  std::uint64_t id;
+
+  /** @brief log descriptor */
+  int fd{2};
+
+  /** @brief dropped records */
+  std::atomic<std::uint64_t> dropped{0};
+
+  /** @brief drops already reported */
+  std::uint64_t reported{0};
+
+  /** @brief dropped diagnostic lines */
+  std::atomic<std::uint64_t> dropped_notes{0};
+
+  /** @brief dropped lines already reported */
+  std::uint64_t reported_notes{0};
+
+  /** @brief lock protecting the ring list (taken once per thread) */
+  std::mutex rings_lock;
+
+  /** @brief rings of all producing threads */
+  std::vector<std::shared_ptr<Ring>> rings;
+
+  /** @brief writer thread */
+  std::jthread writer;
+};
+} // namespace W
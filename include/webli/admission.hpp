@@ -0,0 +1,96 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace W {
+/**
+ * @brief Decides which requests the server runs once it is overloaded.
+ *
+ * Requests beyond the in-flight cap get rejected right away. Queue delay is
+ * handled like CoDel: once every request waited longer than `target` for a
+ * whole `interval` there is a standing queue, and requests get shed until
+ * one makes it through the queue in time again. The queue drains quickly
+ * then and the requests still served are served in time.
+ *
+ */
+class Admission {
+public:
+  /**
+   * @brief Construct a new Admission
+   *
+   * @param max_in_flight requests running at the same time (0 = unlimited)
+   * @param target acceptable queue delay (0 = no queue delay shedding)
+   * @param interval time the delay has to stay above target before requests
+   * get shed
+   */
+  Admission(std::size_t max_in_flight, std::chrono::milliseconds target,
+            std::chrono::milliseconds interval);
+
+  /**
+   * @brief admit a request, `release` has to follow once it is done
+   *
+   * @param sojourn time the request waited in a queue before
+   * @return true if the request should run
+   * @return false if it should be answered with 503
+   */
+  bool admit(std::chrono::steady_clock::duration sojourn);
+
+  /**
+   * @brief release an admitted request
+   *
+   */
+  void release() noexcept;
+
+  /**
+   * @brief Get the number of running requests
+   *
+   * @return std::size_t
+   */
+  std::size_t getInFlight() const noexcept;
+
+  /**
+   * @brief Get the number of requests shed so far
+   *
+   * @return std::uint64_t
+   */
+  std::uint64_t getShed() const noexcept;
+
+private:
+  /**
+   * @brief check the queue delay of a request against the standing queue
+   *
+   * @param sojourn time the request waited in a queue
+   * @return true if the request should be shed
+   */
+  bool congested(std::chrono::steady_clock::duration sojourn);
+
+  /** @brief in-flight cap (0 = unlimited) */
+  std::size_t max_in_flight;
+
+  /** @brief acceptable queue delay */
+  std::chrono::steady_clock::duration target;
+
+  /** @brief length of a measuring interval */
+  std::chrono::steady_clock::duration interval;
+
+  /** @brief running requests */
+  std::atomic<std::size_t> in_flight{0};
+
+  /** @brief shed requests */
+  std::atomic<std::uint64_t> shed{0};
+
+  /**
+   * @brief time the queue delay has been above target for a whole interval,
+   * in steady clock ticks (0 while a request made it in time). Loops and
+   * workers share it, so it takes no lock.
+   */
+  std::atomic<std::chrono::steady_clock::rep> above_until{0};
+
+  /** @brief requests get shed */
+  std::atomic<bool> overloaded{false};
+};
+} // namespace W
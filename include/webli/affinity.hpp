@@ -0,0 +1,88 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace W {
+/**
+ * @brief Where server threads get pinned
+ *
+ */
+enum class Placement {
+  /** @brief let the scheduler decide */
+  None,
+  /** @brief thread n runs on the n-th core only */
+  Core,
+  /**
+   * @brief thread n runs on all cores of the n-th NUMA node, so threads get
+   * spread across the nodes round robin
+   */
+  Node
+};
+
+/**
+ * @brief Cores and NUMA nodes the process may run on, read from sysfs once.
+ *
+ * Memory is placed by the kernel on the node of the thread touching it
+ * first, so buffers a pinned thread allocates itself stay node-local.
+ *
+ */
+class Topology {
+public:
+  /**
+   * @brief Get the topology of the machine, limited to the cores the process
+   * may run on
+   *
+   * @return const Topology&
+   */
+  static const Topology &system();
+
+  /**
+   * @brief Get the cores of every node, nodes without allowed cores are left
+   * out
+   *
+   * @return const std::vector<std::vector<int>>&
+   */
+  const std::vector<std::vector<int>> &getNodes() const noexcept;
+
+  /**
+   * @brief Get the cores a thread gets placed on
+   *
+   * @param placement placement strategy
+   * @param index thread index
+   * @param cores cores to choose from (empty = all allowed cores)
+   * @return std::vector<int> - empty for Placement::None
+   */
+  std::vector<int> select(Placement placement, std::size_t index,
+                          const std::vector<int> &cores) const;
+
+  /**
+   * @brief pin the calling thread
+   *
+   * @param cores cores the thread may run on
+   * @return true on success
+   */
+  static bool pin(const std::vector<int> &cores) noexcept;
+
+  /**
+   * @brief parse a sysfs cpu list like `0-3,8,10-11`
+   *
+   * @param list cpu list
+   * @return std::vector<int>
+   */
+  static std::vector<int> parseList(std::string_view list);
+
+private:
+  /**
+   * @brief Read the topology from sysfs
+   *
+   */
+  Topology();
+
+  /** @brief allowed cores per node */
+  std::vector<std::vector<int>> nodes;
+};
+} // namespace W
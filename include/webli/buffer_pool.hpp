@@ -0,0 +1,138 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/http.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace W {
+/**
+ * @brief What a pool keeps
+ *
+ */
+enum class PoolKind : std::size_t { Buffer, Request, Response };
+
+/** @brief number of pool kinds */
+inline constexpr std::size_t PoolKindCount = 3;
+
+/**
+ * @brief Per thread pools of connection buffers, requests and responses.
+ *
+ * Every thread keeps what gets given back on it and hands it out again, reset
+ * but with its memory, so serving a request mostly skips the allocator. The
+ * pools take no locks. Things can be given back on another thread than they
+ * were taken on, they join the pool of that thread then.
+ *
+ */
+class BufferPool {
+public:
+  /**
+   * @brief Reuse counters of all threads
+   *
+   */
+  using Stats = struct Stats {
+    /** @brief takes served from a pool, by kind */
+    std::array<std::uint64_t, PoolKindCount> hits{};
+
+    /** @brief takes that had to allocate, by kind */
+    std::array<std::uint64_t, PoolKindCount> misses{};
+  };
+
+  /**
+   * @brief size the pools of every thread of the process, a later call
+   * replaces the limits of an earlier one
+   *
+   * @param size things of every kind a thread keeps at most (0 = no pooling)
+   * @param max_buffer buffers and bodies that grew larger get freed
+   */
+  static void configure(std::size_t size, std::size_t max_buffer) noexcept;
+
+  /**
+   * @brief take an empty buffer
+   *
+   * @return std::string
+   */
+  static std::string takeBuffer();
+
+  /**
+   * @brief give a buffer back
+   *
+   * @param buffer buffer, cleared by the pool
+   */
+  static void giveBuffer(std::string &&buffer) noexcept;
+
+  /**
+   * @brief take an empty request
+   *
+   * @return std::shared_ptr<Http::Request>
+   */
+  static std::shared_ptr<Http::Request> takeRequest();
+
+  /**
+   * @brief give a request back, only kept when nobody else holds it
+   *
+   * @param request request, reset by the pool
+   */
+  static void giveRequest(std::shared_ptr<Http::Request> &&request) noexcept;
+
+  /**
+   * @brief take an empty 200 OK response
+   *
+   * @return std::shared_ptr<Http::Response>
+   */
+  static std::shared_ptr<Http::Response> takeResponse();
+
+  /**
+   * @brief give a response back, only kept when nobody else holds it
+   *
+   * @param response response, reset by the pool
+   */
+  static void
+  giveResponse(std::shared_ptr<Http::Response> &&response) noexcept;
+
+  /**
+   * @brief sum up the counters of all threads, past ones included
+   *
+   * @return Stats
+   */
+  static Stats stats();
+};
+
+/**
+ * @brief Buffer taken from the pool for a scope, given back at its end
+ *
+ */
+class PooledBuffer {
+public:
+  /**
+   * @brief Take a buffer
+   *
+   */
+  PooledBuffer() : buffer(BufferPool::takeBuffer()) {}
+
+  /**
+   * @brief Give the buffer back
+   *
+   */
+  ~PooledBuffer() { BufferPool::giveBuffer(std::move(this->buffer)); }
+
+  PooledBuffer(const PooledBuffer &) = delete;
+  PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+  /**
+   * @brief Get the buffer
+   *
+   * @return std::string&
+   */
+  std::string &operator*() noexcept { return this->buffer; }
+
+private:
+  /** @brief buffer */
+  std::string buffer;
+};
+} // namespace W
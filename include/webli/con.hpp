@@ -5,58 +5,244 @@
 #include <arpa/inet.h>
 #include <cstddef>
 #include <cstdint>
-
-#include <openssl/ssl.h>
+#include <string_view>
+#include <vector>
 
 namespace W {
 /**
- * @brief TLS TCP Client Connection
+ * @brief Result of a non-blocking connection operation
+ *
+ */
+enum class IoStatus {
+  /** @brief operation completed */
+  Ok,
+  /** @brief operation has to be retried when the socket is readable */
+  WantRead,
+  /** @brief operation has to be retried when the socket is writable */
+  WantWrite,
+  /** @brief peer closed the connection */
+  Closed,
+  /** @brief fatal tls or socket error */
+  Error
+};
+
+/**
+ * @brief How a connection moves its bytes
+ *
+ */
+enum class ConMode {
+  /** @brief blocking socket, the handshake happens in the constructor */
+  Blocking,
+  /** @brief non-blocking socket, the handshake is driven by `accept` */
+  NonBlocking,
+  /**
+   * @brief received and sent bytes go through memory buffers (`feed` and
+   * `drain`), the socket is only touched by the blocking `read` and `write`
+   */
+  Memory
+};
+
+/**
+ * @brief Client connection of the server. `TlsCon` speaks tls, `TcpCon`
+ * plain tcp for servers behind a tls terminating proxy, the rest of the
+ * server only sees this interface.
+ *
+ * The blocking `read` and `write` are buffered: small reads are served from
+ * a read-ahead buffer and small writes collect until `flush`, so they leave
+ * in one tls record instead of one each.
  *
  */
 class Con {
 public:
+  /** @brief size of the read-ahead and the write buffer, one tls record */
+  static constexpr std::size_t BufferSize = 16384;
+
   /**
    * @brief Construct a new Con object
    *
    * @param sd socket descriptor
    * @param address internet address
-   * @param ctx tls context
+   * @param mode how the bytes are moved
+   */
+  Con(int sd, struct in_addr address, ConMode mode) noexcept;
+
+  /**
+   * @brief Close the socket
+   *
    */
-  Con(int sd, struct in_addr address, SSL_CTX *ctx);
-  ~Con();
+  virtual ~Con();
+
+  Con(const Con &) = delete;
+  Con &operator=(const Con &) = delete;
 
   /**
-   * @brief write data onto the buffer
+   * @brief write data onto the write buffer, blocks only when it is full.
+   * Nothing reaches the client before `flush`.
    *
    * @param data pointer to data
    * @param data_size size to write in bytes
    * @return std::size_t - bytes written
+   * @throws W::Exception if the client is gone
    */
   std::size_t write(const std::uint8_t *data, int data_size) const;
 
   /**
-   * @brief read data from socket into buffer
+   * @brief send the write buffer, blocks
+   *
+   * @throws W::Exception if the client is gone
+   */
+  void flush() const;
+
+  /**
+   * @brief read data from socket into buffer, blocks until the buffer is
+   * full. Bytes read ahead are only seen by `read`, not by `readSome`.
    *
    * @param buffer pointer to buffer
    * @param buffer_size size to read in bytes
    * @return std::size_t - bytes read
+   * @throws W::Exception if the client is gone
    */
   std::size_t read(std::uint8_t *buffer, int buffer_size) const;
 
+  /**
+   * @brief advance the handshake without blocking
+   *
+   * @return IoStatus - Ok when the handshake is done
+   */
+  virtual IoStatus accept() = 0;
+
+  /**
+   * @brief read available data without blocking
+   *
+   * @param buffer pointer to buffer
+   * @param buffer_size size to read in bytes
+   * @param read bytes read (only valid on IoStatus::Ok)
+   * @return IoStatus
+   */
+  virtual IoStatus readSome(std::uint8_t *buffer, int buffer_size,
+                            std::size_t &read) = 0;
+
+  /**
+   * @brief write as much data as the socket accepts without blocking
+   *
+   * @param data pointer to data
+   * @param data_size size to write in bytes
+   * @param written bytes written (only valid on IoStatus::Ok)
+   * @return IoStatus
+   */
+  virtual IoStatus writeSome(const std::uint8_t *data, int data_size,
+                             std::size_t &written) = 0;
+
+  /**
+   * @brief pass bytes received from the socket (memory mode only)
+   *
+   * @param data received bytes
+   * @param data_size number of bytes
+   */
+  virtual void feed(const std::uint8_t *data, std::size_t data_size) = 0;
+
+  /**
+   * @brief mark the end of the received bytes, reads fail once the buffered
+   * ones are consumed (memory mode only)
+   *
+   */
+  virtual void feedEnd() = 0;
+
+  /**
+   * @brief take bytes that have to be sent (memory mode only)
+   *
+   * @param buffer output buffer
+   * @param buffer_size buffer size in bytes
+   * @return std::size_t - bytes taken
+   */
+  virtual std::size_t drain(std::uint8_t *buffer, std::size_t buffer_size) = 0;
+
+  /**
+   * @brief number of bytes waiting to be drained (memory mode only)
+   *
+   * @return std::size_t
+   */
+  virtual std::size_t pending() const noexcept = 0;
+
+  /**
+   * @brief Get the application protocol negotiated during the handshake
+   *
+   * @return std::string_view - `h2` or `http/1.1`
+   */
+  virtual std::string_view getProtocol() const noexcept;
+
+  /**
+   * @brief check if file bodies can go from the page cache to the socket
+   * without a copy through userspace
+   *
+   * @return true
+   * @return false if `sendFileSome` always fails
+   */
+  virtual bool canSendFile() const noexcept;
+
+  /**
+   * @brief check if the handshake resumed an earlier session
+   *
+   * @return true
+   * @return false after a full handshake (or without tls)
+   */
+  virtual bool isResumed() const noexcept;
+
+  /**
+   * @brief check if the data read last arrived as tls 1.3 early data, before
+   * the handshake finished. An attacker may have replayed it.
+   *
+   * @return true
+   * @return false once the handshake finished (or without tls)
+   */
+  virtual bool isEarly() const noexcept;
+
+  /**
+   * @brief send part of a file (blocks only in blocking mode)
+   *
+   * @param fd file descriptor
+   * @param offset file offset to send from
+   * @param size bytes to send at most
+   * @param sent bytes sent (only valid on IoStatus::Ok)
+   * @return IoStatus
+   */
+  virtual IoStatus sendFileSome(int fd, std::size_t offset, std::size_t size,
+                                std::size_t &sent);
+
   /**
    * @brief Get the clients address
    *
    * @return  struct in_addr
    */
-  struct in_addr getAddress();
+  struct in_addr getAddress() const noexcept;
 
-private:
   /**
-   * @brief free tls context and close socket
-   * @note this function won't shutdown the tls session
+   * @brief Get the socket descriptor
+   *
+   * @return int
+   */
+  int getDescriptor() const noexcept;
+
+protected:
+  /**
+   * @brief read whatever data arrived, blocks until there is some
    *
+   * @param buffer pointer to buffer
+   * @param buffer_size size to read in bytes at most
+   * @return std::size_t - bytes read, never 0
+   * @throws W::Exception if the client is gone
    */
-  void close() noexcept;
+  virtual std::size_t readAvailable(std::uint8_t *buffer,
+                                    int buffer_size) const = 0;
+
+  /**
+   * @brief write all data, blocks
+   *
+   * @param data pointer to data
+   * @param data_size size to write in bytes
+   * @throws W::Exception if the client is gone
+   */
+  virtual void writeAll(const std::uint8_t *data, int data_size) const = 0;
 
   /** @brief socket descriptor  */
   int sd;
@@ -64,7 +250,20 @@ private:
   /** @brief client address */
   struct in_addr address;
 
-  /** @brief tls context  */
-  SSL *ssl;
+  /** @brief byte transport */
+  ConMode mode;
+
+private:
+  /** @brief read-ahead buffer (allocated on the first `read`) */
+  mutable std::vector<std::uint8_t> read_buffer;
+
+  /** @brief first byte of `read_buffer` not read yet */
+  mutable std::size_t read_pos{0};
+
+  /** @brief end of the bytes in `read_buffer` */
+  mutable std::size_t read_end{0};
+
+  /** @brief written bytes waiting for `flush` */
+  mutable std::vector<std::uint8_t> write_buffer;
 };
 } // namespace W
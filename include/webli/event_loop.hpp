@@ -0,0 +1,80 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/reactor.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+namespace W {
+/**
+ * @brief Single threaded epoll reactor. File descriptors are registered
+ * together with a callback that gets the ready epoll events.
+ *
+ */
+class EventLoop : public Reactor {
+public:
+  /**
+   * @brief Construct a new Event Loop
+   *
+   * @throws W::Exception when epoll or the wakeup descriptor can't be created
+   */
+  EventLoop();
+
+  /**
+   * @brief Destroy the Event Loop and drop all registered callbacks
+   *
+   */
+  ~EventLoop() override;
+
+  /**
+   * @brief register a file descriptor
+   *
+   * @param fd file descriptor
+   * @param events epoll event mask (EPOLLIN, EPOLLOUT, ...)
+   * @param callback called from the loop thread when the fd is ready
+   */
+  void add(int fd, std::uint32_t events, const Callback &callback);
+
+  /**
+   * @brief change the event mask of a registered file descriptor
+   *
+   * @param fd file descriptor
+   * @param events epoll event mask
+   */
+  void modify(int fd, std::uint32_t events);
+
+  /**
+   * @brief unregister a file descriptor (the descriptor won't be closed)
+   *
+   * @param fd file descriptor
+   */
+  void remove(int fd);
+
+  void accept(int sd, const AcceptCallback &callback) override;
+
+  void stopAccept(int sd) override;
+
+  void attach(Con &con, std::uint32_t events,
+              const Callback &callback) override;
+
+  void modify(Con &con, std::uint32_t events) override;
+
+  void detach(Con &con, Task done) override;
+
+  void close(std::unique_ptr<Con> con) override;
+
+  ConMode connectionMode() const noexcept override;
+
+  void run() override;
+
+private:
+  /** @brief epoll descriptor */
+  int epfd;
+
+  /** @brief registered callbacks, shared so they survive self removal */
+  std::unordered_map<int, std::shared_ptr<Callback>> callbacks;
+};
+} // namespace W
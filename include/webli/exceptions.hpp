@@ -8,6 +8,7 @@
 #include <webli/websocket.hpp>
 
 #include <base64.hpp>
+#include <openssl/sha.h>
 
 #include <string_view>
 
@@ -123,6 +124,56 @@ public:
       Http::StatusCode::Unauthorized, {}, "<h1>Unauthorized</h1>");
 };
 
+/**
+ * @brief Exception holding a 413 Payload Too Large
+ *
+ */
+class PayloadTooLarge : public HttpException {
+public:
+  PayloadTooLarge() : HttpException(PayloadTooLarge::response) {}
+
+  /**
+   * @brief static response buffer, can be overwritten by user
+   *
+   */
+  static inline Http::Response response = Http::Response(
+      Http::StatusCode::PayloadTooLarge, {}, "<h1>Payload Too Large</h1>");
+};
+
+/**
+ * @brief Exception holding a 431 Request Header Fields Too Large
+ *
+ */
+class HeaderFieldsTooLarge : public HttpException {
+public:
+  HeaderFieldsTooLarge() : HttpException(HeaderFieldsTooLarge::response) {}
+
+  /**
+   * @brief static response buffer, can be overwritten by user
+   *
+   */
+  static inline Http::Response response =
+      Http::Response(Http::StatusCode::RequestHeaderFieldsTooLarge, {},
+                     "<h1>Request Header Fields Too Large</h1>");
+};
+
+/**
+ * @brief Exception holding a 425 Too Early, the client repeats the request
+ * after the handshake
+ *
+ */
+class TooEarly : public HttpException {
+public:
+  TooEarly() : HttpException(TooEarly::response) {}
+
+  /**
+   * @brief static response buffer, can be overwritten by user
+   *
+   */
+  static inline Http::Response response =
+      Http::Response(Http::StatusCode::TooEarly, {}, "<h1>Too Early</h1>");
+};
+
 /**
  * @brief Exception loading a response body from storage
  *
@@ -140,8 +191,9 @@ public:
   FromStorage(std::string_view path, const std::string &type,
               Http::StatusCode status_code = Http::StatusCode::Ok,
               const Http::StringMap &header = {})
-      : HttpException(
-            Http::Response(status_code, header, Storage::loadAsString(path))) {
+      : HttpException(Http::Response(status_code, header, "")) {
+    // the server streams the file when it can instead of copying it
+    this->resp.setFile(std::string(path));
     this->resp.setHeader(Http::Header::ContentType, type);
   }
 };
@@ -0,0 +1,64 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <functional>
+
+namespace W {
+/**
+ * @brief Something that runs jobs, e.g. a reactor or a thread pool.
+ * Coroutine handlers get resumed on the executor they were started on.
+ *
+ */
+class Executor {
+public:
+  /**
+   * @brief Typedef for executor jobs
+   *
+   */
+  using Job = std::function<void()>;
+
+  virtual ~Executor() = default;
+
+  /**
+   * @brief run a job on the executor, can be called from any thread
+   *
+   * @param job job to run
+   */
+  virtual void execute(Job job) = 0;
+
+  /**
+   * @brief Get the executor running on the current thread
+   *
+   * @return Executor* - null on threads without one
+   */
+  static Executor *current() noexcept;
+
+  /**
+   * @brief Marks the executor of the current thread for its lifetime
+   *
+   */
+  class Scope {
+  public:
+    /**
+     * @brief Construct a new Scope
+     *
+     * @param executor executor of the current thread (null for none)
+     */
+    explicit Scope(Executor *executor) noexcept;
+
+    /**
+     * @brief restore the previous executor
+     *
+     */
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    /** @brief executor before this scope */
+    Executor *previous;
+  };
+};
+} // namespace W
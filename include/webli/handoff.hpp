@@ -0,0 +1,73 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace W {
+/**
+ * @brief Hands listening sockets from a running server to its successor over
+ * a unix socket (SCM_RIGHTS), so a new binary takes over the port without
+ * refusing a single connection.
+ *
+ * The successor connects to the socket path and gets the listeners, the old
+ * process stops accepting and drains its connections.
+ *
+ */
+class Handoff {
+public:
+  /**
+   * @brief Construct a new Handoff
+   *
+   * @param path unix socket path shared by all generations of the server
+   */
+  explicit Handoff(std::string_view path);
+
+  /**
+   * @brief Destroy the Handoff and close the socket
+   *
+   */
+  ~Handoff();
+
+  Handoff(const Handoff &) = delete;
+  Handoff &operator=(const Handoff &) = delete;
+
+  /**
+   * @brief take over the listeners of a running server
+   *
+   * @return std::vector<int> - listening sockets (empty if nobody runs)
+   */
+  std::vector<int> adopt() const;
+
+  /**
+   * @brief listen on the socket path for the next successor, replaces the
+   * socket of the previous generation
+   *
+   */
+  void open();
+
+  /**
+   * @brief send the listeners to a waiting successor
+   *
+   * @param sds listening sockets
+   * @return true if the successor got them
+   */
+  bool serve(const std::vector<int> &sds) const;
+
+  /**
+   * @brief Get the unix socket descriptor
+   *
+   * @return int (-1 before `open`)
+   */
+  int getDescriptor() const noexcept;
+
+private:
+  /** @brief unix socket path */
+  std::string path;
+
+  /** @brief listening unix socket */
+  int sd{-1};
+};
+} // namespace W
@@ -0,0 +1,187 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace W {
+/**
+ * @brief Header field of a HPACK header list (name, value), names are lower
+ * case
+ *
+ */
+using HpackField = std::pair<std::string, std::string>;
+
+/**
+ * @brief Compression error of a header block. Unlike `W::Exception` it is not
+ * printed, the peer controls the input and could flood the log otherwise.
+ *
+ */
+class HpackError {
+public:
+  /**
+   * @brief Construct a new Hpack Error
+   *
+   * @param error pointer to error message
+   */
+  explicit HpackError(const char *error) noexcept : msg(error) {}
+
+  /**
+   * @brief Get the Message object
+   *
+   * @return const char* - pointer to error message
+   */
+  const char *getMessage() const noexcept { return this->msg; }
+
+private:
+  /** @brief pointer to error message */
+  const char *msg;
+};
+
+/**
+ * @brief HPACK index table (RFC 7541): the static table followed by the
+ * dynamic table, newest entry first
+ *
+ */
+class HpackTable {
+public:
+  /**
+   * @brief Construct a new Hpack Table
+   *
+   * @param max_size maximum size of the dynamic table
+   */
+  explicit HpackTable(std::size_t max_size = 4096);
+
+  /**
+   * @brief Get an entry
+   *
+   * @param index 1-based index, static entries first
+   * @return const HpackField&
+   * @throws HpackError when the index is out of range
+   */
+  const HpackField &get(std::size_t index) const;
+
+  /**
+   * @brief find an entry
+   *
+   * @param name field name
+   * @param value field value
+   * @param exact set if the value matched too
+   * @return std::size_t - index, 0 if not even the name is known
+   */
+  std::size_t find(std::string_view name, std::string_view value,
+                   bool &exact) const noexcept;
+
+  /**
+   * @brief add an entry to the dynamic table, old entries get evicted to
+   * make room
+   *
+   * @param name field name
+   * @param value field value
+   */
+  void add(std::string name, std::string value);
+
+  /**
+   * @brief change the maximum size of the dynamic table
+   *
+   * @param max_size new maximum size
+   */
+  void resize(std::size_t max_size);
+
+  /**
+   * @brief Get the maximum size of the dynamic table
+   *
+   * @return std::size_t
+   */
+  std::size_t getMaxSize() const noexcept;
+
+private:
+  /**
+   * @brief evict the oldest entries until the table fits
+   *
+   * @param limit size to fit in
+   */
+  void evict(std::size_t limit) noexcept;
+
+  /** @brief dynamic entries, newest first */
+  std::deque<HpackField> entries;
+
+  /** @brief size of the dynamic entries as defined by HPACK */
+  std::size_t size{0};
+
+  /** @brief maximum size of the dynamic entries */
+  std::size_t max_size;
+};
+
+/**
+ * @brief HPACK header block decoder, one per connection
+ *
+ */
+class HpackDecoder {
+public:
+  /**
+   * @brief Construct a new Hpack Decoder
+   *
+   * @param max_table_size dynamic table size announced to the peer
+   */
+  explicit HpackDecoder(std::size_t max_table_size = 4096);
+
+  /**
+   * @brief decode a complete header block. A block exceeding the list size
+   * still updates the table, otherwise later blocks would decode wrong.
+   *
+   * @param block header block
+   * @param fields decoded fields
+   * @param max_list_size size of the header list at most (name + value + 32
+   * per field)
+   * @return true
+   * @return false if the header list is too large, fields stay empty then
+   * @throws HpackError on compression errors, the connection is unusable
+   * then
+   */
+  bool decode(std::string_view block, std::vector<HpackField> &fields,
+              std::size_t max_list_size);
+
+private:
+  /** @brief dynamic table of the peers encoder */
+  HpackTable table;
+
+  /** @brief table size the peer may choose at most */
+  std::size_t max_table_size;
+};
+
+/**
+ * @brief HPACK header block encoder, one per connection
+ *
+ */
+class HpackEncoder {
+public:
+  /**
+   * @brief apply the table size the peer allows, the next block announces
+   * the change
+   *
+   * @param max_size SETTINGS_HEADER_TABLE_SIZE of the peer
+   */
+  void resize(std::size_t max_size);
+
+  /**
+   * @brief encode a header list into a block
+   *
+   * @param fields header list, names have to be lower case
+   * @param out output buffer to append to
+   */
+  void encode(const std::vector<HpackField> &fields, std::string &out);
+
+private:
+  /** @brief dynamic table mirrored by the peers decoder */
+  HpackTable table;
+
+  /** @brief a table size update has to start the next block */
+  bool resized{false};
+};
+} // namespace W
@@ -80,13 +80,19 @@ enum class StatusCode {
   NetworkAuthenticationRequired
 };
 
+class RequestParser;
+
 namespace Header {
 static constexpr const char *Cookie = "Cookie";
 static constexpr const char *Connection = "Connection";
 static constexpr const char *ContentLength = "Content-Length";
 static constexpr const char *ContentType = "Content-Type";
+static constexpr const char *EarlyData = "Early-Data";
 static constexpr const char *Host = "Host";
+static constexpr const char *KeepAlive = "Keep-Alive";
+static constexpr const char *RetryAfter = "Retry-After";
 static constexpr const char *SetCookie = "Set-Cookie";
+static constexpr const char *TransferEncoding = "Transfer-Encoding";
 static constexpr const char *UserAgent = "User-Agent";
 static constexpr const char *Upgrade = "Upgrade";
 static constexpr const char *WsKey = "Sec-WebSocket-Key";
@@ -211,6 +217,13 @@ public:
    */
   std::string_view getHeader(const std::string &key) const noexcept;
 
+  /**
+   * @brief Get all HTTP headers
+   *
+   * @return const StringMap&
+   */
+  const StringMap &getHeaders() const noexcept;
+
   /**
    * @brief Get the HTTP body
    *
@@ -245,7 +258,29 @@ public:
    *
    * @param data http body data (text only)
    */
-  void setBody(const std::string &data) noexcept;
+  virtual void setBody(const std::string &data) noexcept;
+
+  /**
+   * @brief Append to the HTTP body, the header stays as it is (bodies
+   * arriving in pieces)
+   *
+   * @param data body data
+   */
+  void appendBody(std::string_view data);
+
+  /**
+   * @brief Move the HTTP body out, e.g. to send it without a copy. The
+   * header stays as it is.
+   *
+   * @return std::string
+   */
+  std::string takeBody() noexcept;
+
+  /**
+   * @brief Reset to an empty object for reuse, the body keeps its capacity
+   *
+   */
+  virtual void reset() noexcept;
 
   /**
    * @brief Set the HTTP body, the Content-Length + Content-Type field
@@ -382,6 +417,39 @@ public:
    */
   void setPath(const std::string &path) noexcept;
 
+  /**
+   * @brief check if the request arrived as tls early data (0-RTT), directly
+   * or through a proxy that sent `Early-Data: 1`. Early data can be replayed
+   * by an attacker.
+   *
+   * @return true
+   * @return false
+   */
+  bool isEarlyData() const noexcept;
+
+  /**
+   * @brief mark the request as received in tls early data
+   *
+   * @param early_data received before the handshake completed
+   */
+  void setEarlyData(bool early_data) noexcept;
+
+  /**
+   * @brief Reset to an empty request for reuse
+   *
+   */
+  void reset() noexcept override;
+
+  /**
+   * @brief Take method, path, version and header from a parsed request head,
+   * the body stays as it is. The fields get copied out of the views of the
+   * parser, only the parse itself is zero-copy. A pooled request keeps the
+   * capacity of method and path, every header field is a new entry.
+   *
+   * @param head parser with a complete head
+   */
+  void assign(const RequestParser &head);
+
   /**
    * @brief build the http request to a string
    *
@@ -402,6 +470,9 @@ private:
 
   /** @brief http request path */
   std::string path;
+
+  /** @brief received in tls early data */
+  bool early_data{false};
 };
 
 /**
@@ -455,6 +526,44 @@ public:
    */
   void setStatusCode(StatusCode code) noexcept;
 
+  /**
+   * @brief Set the HTTP body, drops a file body
+   *
+   * @param data http body data (text only)
+   */
+  void setBody(const std::string &data) noexcept override;
+
+  /**
+   * @brief Send a file as the HTTP body and set the Content-Length field.
+   * The server streams it from the page cache where the connection allows
+   * it (kTLS or plain tcp), otherwise it gets read into the body on sending.
+   * A missing file leaves an empty body.
+   *
+   * @param path path to file in filesystem
+   */
+  void setFile(const std::string &path) noexcept;
+
+  /**
+   * @brief Get the path of the file body
+   *
+   * @return const std::string& - empty without a file body
+   */
+  const std::string &getFile() const noexcept;
+
+  /**
+   * @brief Get the size of the file body at the time it got set
+   *
+   * @return std::size_t
+   */
+  std::size_t getFileSize() const noexcept;
+
+  /**
+   * @brief Replace the file body by its content, for connections that can't
+   * stream files
+   *
+   */
+  void loadFile() noexcept;
+
   /**
    * @brief Set a session cookie with the given parameter. Assign an empty
    * string if you don't want to use them. Webli cookies are secure by default
@@ -500,12 +609,27 @@ public:
             std::string_view same_site = Cookie::SameSite::Strict) noexcept;
 
   /**
-   * @brief build the http response to a string
+   * @brief build the http response to a string, only the head with a file
+   * body
    *
    * @return http request as std::string
    */
   std::string build() const noexcept final;
 
+  /**
+   * @brief build the head of the http response up to the empty line, the
+   * body can be sent from where it is
+   *
+   * @return std::string
+   */
+  std::string buildHead() const noexcept;
+
+  /**
+   * @brief Reset to an empty 200 OK response for reuse
+   *
+   */
+  void reset() noexcept override;
+
 private:
   /**
    * @brief read and parse the first line on the http stream
@@ -516,6 +640,12 @@ private:
 
   /** @brief http status code */
   StatusCode status_code;
+
+  /** @brief path of the file body (empty = body in memory) */
+  std::string file;
+
+  /** @brief size of the file body */
+  std::size_t file_size{0};
 };
 
 } // namespace W::Http
@@ -0,0 +1,418 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/hpack.hpp>
+#include <webli/http.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace W {
+/**
+ * @brief HTTP/2 error codes of RST_STREAM and GOAWAY frames
+ *
+ */
+enum class Http2Error : std::uint32_t {
+  NoError,
+  ProtocolError,
+  InternalError,
+  FlowControlError,
+  SettingsTimeout,
+  StreamClosed,
+  FrameSizeError,
+  RefusedStream,
+  Cancel,
+  CompressionError,
+  ConnectError,
+  EnhanceYourCalm,
+  InadequateSecurity,
+  /** @brief the request has to be repeated over HTTP/1.1 (websockets) */
+  Http11Required
+};
+
+/**
+ * @brief HTTP/2 options
+ *
+ */
+using Http2Options = struct Http2Options {
+  /** @brief offer h2 through ALPN on tls connections */
+  bool enabled{false};
+
+  /** @brief streams a client may open at the same time */
+  std::uint32_t max_streams{100};
+
+  /**
+   * @brief flow control window of every stream and of the connection for
+   * request bodies (at least 65535)
+   */
+  std::uint32_t window_size{1 << 20};
+
+  /** @brief size of a request header list at most, larger ones get a 431 */
+  std::uint32_t max_header_list_size{16384};
+
+  /** @brief size of a request body at most, larger ones get reset */
+  std::size_t max_body_size{1 << 20};
+
+  /**
+   * @brief streams a client may reset beyond the ones it got answered,
+   * more close the connection with ENHANCE_YOUR_CALM (0 = no limit)
+   */
+  std::uint32_t max_resets{100};
+};
+
+/**
+ * @brief Server side of a HTTP/2 connection (RFC 9113) without any io.
+ *
+ * Received bytes go into `receive`, complete requests come out of `next` and
+ * their responses go back through `respond`, in any order. Frames to send
+ * pile up until `takeOutput`. Response bodies are sent as the flow control
+ * windows of the client allow, the rest waits for its window updates.
+ *
+ */
+class Http2Connection {
+public:
+  /**
+   * @brief Construct a new Http2 Connection, the server preface is the first
+   * output
+   *
+   * @param options HTTP/2 options
+   */
+  explicit Http2Connection(const Http2Options &options);
+
+  /**
+   * @brief process received bytes
+   *
+   * @param data received bytes, partial frames get buffered
+   * @return true
+   * @return false on a connection error, a GOAWAY is the last output then
+   * and the connection has to be closed once it is sent
+   */
+  bool receive(std::string_view data);
+
+  /**
+   * @brief take the next complete request
+   *
+   * @return std::optional<std::pair<std::uint32_t, Http::Request>> - stream
+   * id and request, empty if none is ready
+   */
+  std::optional<std::pair<std::uint32_t, Http::Request>> next();
+
+  /**
+   * @brief answer a request, answers to reset streams are dropped. A stream
+   * counts as open until its request is answered, also after the client
+   * reset it.
+   *
+   * @param stream stream id of the request
+   * @param resp response, its body gets copied
+   */
+  void respond(std::uint32_t stream, const Http::Response &resp);
+
+  /**
+   * @brief answer a request with the body moved out of the response
+   *
+   * @param stream stream id of the request
+   * @param resp response, its body is taken
+   */
+  void respond(std::uint32_t stream, Http::Response &&resp);
+
+  /**
+   * @brief abort a stream instead of answering it
+   *
+   * @param stream stream id
+   * @param error error code sent to the client
+   */
+  void reset(std::uint32_t stream, Http2Error error);
+
+  /**
+   * @brief take the frames to send
+   *
+   * @return std::string
+   */
+  std::string takeOutput() noexcept;
+
+  /**
+   * @brief Get the number of open streams
+   *
+   * @return std::size_t
+   */
+  std::size_t getActiveStreams() const noexcept;
+
+  /**
+   * @brief check if the connection is over, because of an error or because
+   * the client went away and all its streams are done
+   *
+   * @return true
+   * @return false
+   */
+  bool isDone() const noexcept;
+
+private:
+  /**
+   * @brief Frame types
+   *
+   */
+  enum class FrameType : std::uint8_t {
+    Data,
+    Headers,
+    Priority,
+    RstStream,
+    Settings,
+    PushPromise,
+    Ping,
+    Goaway,
+    WindowUpdate,
+    Continuation
+  };
+
+  /**
+   * @brief State of an open stream
+   *
+   */
+  struct Stream {
+    /** @brief request header fields */
+    std::vector<HpackField> fields;
+
+    /** @brief request body */
+    std::string body;
+
+    /** @brief the client sent END_STREAM */
+    bool received{false};
+
+    /** @brief the response is being sent */
+    bool responding{false};
+
+    /** @brief the request is a HEAD request, the response has no body */
+    bool head{false};
+
+    /** @brief the request was queued for its handler */
+    bool handling{false};
+
+    /** @brief the stream got reset while its request is handled */
+    bool cancelled{false};
+
+    /** @brief response body */
+    std::string pending;
+
+    /** @brief bytes of the response body already sent */
+    std::size_t sent{0};
+
+    /** @brief bytes the client may send before its next window update */
+    std::int64_t receive_window{0};
+
+    /** @brief received bytes not given back to the window yet */
+    std::uint32_t consumed{0};
+
+    /** @brief bytes the server may send */
+    std::int64_t send_window{0};
+  };
+
+  /**
+   * @brief handle a frame
+   *
+   * @param type frame type
+   * @param flags frame flags
+   * @param id stream id
+   * @param payload frame payload
+   */
+  void frame(FrameType type, std::uint8_t flags, std::uint32_t id,
+             std::string_view payload);
+
+  /**
+   * @brief handle a HEADERS frame
+   *
+   * @param flags frame flags
+   * @param id stream id
+   * @param payload frame payload
+   */
+  void headers(std::uint8_t flags, std::uint32_t id, std::string_view payload);
+
+  /**
+   * @brief decode a complete header block and attach it to its stream
+   *
+   * @param id stream id
+   * @param end_stream the block ends the request
+   */
+  void headerBlock(std::uint32_t id, bool end_stream);
+
+  /**
+   * @brief handle a DATA frame
+   *
+   * @param flags frame flags
+   * @param id stream id
+   * @param payload frame payload
+   */
+  void data(std::uint8_t flags, std::uint32_t id, std::string_view payload);
+
+  /**
+   * @brief handle a SETTINGS frame
+   *
+   * @param flags frame flags
+   * @param id stream id
+   * @param payload frame payload
+   */
+  void settings(std::uint8_t flags, std::uint32_t id,
+                std::string_view payload);
+
+  /**
+   * @brief handle a WINDOW_UPDATE frame
+   *
+   * @param id stream id
+   * @param payload frame payload
+   */
+  void windowUpdate(std::uint32_t id, std::string_view payload);
+
+  /**
+   * @brief turn a complete request into a `Http::Request` and queue it, or
+   * reset it if it is malformed
+   *
+   * @param id stream id
+   * @param stream stream
+   */
+  void complete(std::uint32_t id, Stream &stream);
+
+  /**
+   * @brief send the response header and queue the body of a stream
+   *
+   * @param stream stream id of the request
+   * @param resp response
+   * @param body response body
+   */
+  void answer(std::uint32_t stream, const Http::Response &resp,
+              std::string body);
+
+  /**
+   * @brief reset a stream because of a frame of the client
+   *
+   * @param id stream id
+   * @param error error code sent to the client
+   */
+  void abort(std::uint32_t id, Http2Error error);
+
+  /**
+   * @brief forget a reset stream, a stream whose request is handled already
+   * stays until its answer comes back
+   *
+   * @param id stream id
+   */
+  void cancel(std::uint32_t id);
+
+  /**
+   * @brief send response bodies as far as the windows allow
+   *
+   */
+  void flush();
+
+  /**
+   * @brief forget a stream whose response is sent
+   *
+   * @param id stream id
+   */
+  void finish(std::uint32_t id);
+
+  /**
+   * @brief remove padding from a frame payload
+   *
+   * @param flags frame flags
+   * @param payload frame payload
+   * @return true
+   * @return false if the padding is invalid, the connection failed then
+   */
+  bool unpad(std::uint8_t flags, std::string_view &payload);
+
+  /**
+   * @brief fail the connection with a GOAWAY
+   *
+   * @param error error code
+   */
+  void fail(Http2Error error);
+
+  /**
+   * @brief queue a frame
+   *
+   * @param type frame type
+   * @param flags frame flags
+   * @param id stream id
+   * @param payload frame payload
+   */
+  void write(FrameType type, std::uint8_t flags, std::uint32_t id,
+             std::string_view payload);
+
+  /**
+   * @brief queue a WINDOW_UPDATE frame
+   *
+   * @param id stream id (0 = connection)
+   * @param increment window increment
+   */
+  void writeWindowUpdate(std::uint32_t id, std::uint32_t increment);
+
+  /** @brief HTTP/2 options */
+  Http2Options options;
+
+  /** @brief decoder of request header blocks */
+  HpackDecoder decoder;
+
+  /** @brief encoder of response header blocks */
+  HpackEncoder encoder;
+
+  /** @brief received bytes not processed yet */
+  std::string input;
+
+  /** @brief frames to send */
+  std::string output;
+
+  /** @brief open streams by id */
+  std::map<std::uint32_t, Stream> streams;
+
+  /** @brief complete requests not taken yet */
+  std::deque<std::pair<std::uint32_t, Http::Request>> ready;
+
+  /** @brief header block being received over CONTINUATION frames */
+  std::string block;
+
+  /** @brief stream of the header block being received (0 = none) */
+  std::uint32_t block_stream{0};
+
+  /** @brief the header block being received ends its stream */
+  bool block_end_stream{false};
+
+  /** @brief streams the client reset beyond the ones it got answered */
+  std::uint32_t resets{0};
+
+  /** @brief highest stream id the client opened */
+  std::uint32_t last_stream{0};
+
+  /** @brief the client preface was received */
+  bool preface{false};
+
+  /** @brief the first SETTINGS of the client was received */
+  bool settled{false};
+
+  /** @brief the client sent GOAWAY */
+  bool gone{false};
+
+  /** @brief the connection failed, nothing gets processed anymore */
+  bool failed{false};
+
+  /** @brief bytes the client may send on the connection */
+  std::int64_t receive_window;
+
+  /** @brief received bytes not given back to the connection window yet */
+  std::uint32_t consumed{0};
+
+  /** @brief bytes the server may send on the connection */
+  std::int64_t send_window{65535};
+
+  /** @brief initial send window of new streams */
+  std::int64_t initial_send_window{65535};
+
+  /** @brief largest frame payload the client accepts */
+  std::uint32_t max_frame_size{16384};
+};
+} // namespace W
@@ -0,0 +1,370 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace W {
+struct Route;
+
+/**
+ * @brief Phases of a request
+ *
+ */
+enum class Phase : std::size_t {
+  /** @brief tls handshake, only on the first request of a connection */
+  Handshake,
+  /**
+   * @brief first received byte until the request is complete. Blocking
+   * connections reading the request at once leave their read phase empty.
+   */
+  Read,
+  /** @brief `Http::Request` parsing */
+  Parse,
+  /** @brief waiting for a worker of the pool (event loop mode only) */
+  Queue,
+  /** @brief route lookup */
+  Route,
+  /** @brief handler chain */
+  Handler,
+  /** @brief serializing and writing the response */
+  Write
+};
+
+/** @brief number of request phases */
+static constexpr const std::size_t PhaseCount = 7;
+
+/**
+ * @brief Time spent in every phase of a request, measured on the monotonic
+ * clock. Every `lap` closes the running phase and starts the next one.
+ *
+ */
+class RequestTiming {
+public:
+  /**
+   * @brief forget all phases and start measuring
+   *
+   */
+  void start() noexcept;
+
+  /**
+   * @brief start measuring again, the time since the last lap belongs to no
+   * phase
+   *
+   */
+  void skip() noexcept;
+
+  /**
+   * @brief add the time since the last lap to a phase
+   *
+   * @param phase phase that just ended
+   */
+  void lap(Phase phase) noexcept;
+
+  /**
+   * @brief check if a phase was measured
+   *
+   * @param phase phase
+   * @return true
+   * @return false
+   */
+  bool has(Phase phase) const noexcept;
+
+  /**
+   * @brief Get the time spent in a phase
+   *
+   * @param phase phase
+   * @return std::chrono::nanoseconds
+   */
+  std::chrono::nanoseconds get(Phase phase) const noexcept;
+
+  /**
+   * @brief Get the time spent in all phases
+   *
+   * @return std::chrono::nanoseconds
+   */
+  std::chrono::nanoseconds total() const noexcept;
+
+  /**
+   * @brief describe the measured phases
+   *
+   * @return std::string - e.g. `read=0.210ms parse=0.012ms ...`
+   */
+  std::string describe() const;
+
+  /**
+   * @brief Get the name of a phase
+   *
+   * @param phase phase
+   * @return std::string_view
+   */
+  static std::string_view name(Phase phase) noexcept;
+
+private:
+  /** @brief time per phase */
+  std::array<std::chrono::nanoseconds, PhaseCount> phases{};
+
+  /** @brief measured phases, one bit per phase */
+  std::uint32_t measured{0};
+
+  /** @brief end of the last lap */
+  std::chrono::steady_clock::time_point last{};
+};
+
+/**
+ * @brief HDR style latency histogram with atomic buckets.
+ *
+ * Values are kept in microseconds. Below 16 every value has its own bucket,
+ * above every power of two is split into 8 buckets, so a bucket is at most
+ * 12.5% wide. Values beyond the last bucket (4.7 hours) land in it.
+ *
+ */
+class Histogram {
+public:
+  /** @brief number of buckets */
+  static constexpr const std::size_t Buckets = 256;
+
+  /**
+   * @brief record a value
+   *
+   * @param value duration to record
+   */
+  void record(std::chrono::nanoseconds value) noexcept;
+
+  /**
+   * @brief add the buckets into an array
+   *
+   * @param counts array to add to
+   * @param sum sum of all values in microseconds to add to
+   */
+  void collect(std::array<std::uint64_t, Buckets> &counts,
+               std::uint64_t &sum) const noexcept;
+
+  /**
+   * @brief get the bucket a value falls into
+   *
+   * @param micros value in microseconds
+   * @return std::size_t
+   */
+  static std::size_t bucketOf(std::uint64_t micros) noexcept;
+
+  /**
+   * @brief get the smallest value of a bucket
+   *
+   * @param bucket bucket index
+   * @return std::uint64_t - microseconds
+   */
+  static std::uint64_t lowerBound(std::size_t bucket) noexcept;
+
+private:
+  /** @brief values per bucket */
+  std::array<std::atomic<std::uint64_t>, Buckets> counts{};
+
+  /** @brief sum of all values in microseconds */
+  std::atomic<std::uint64_t> sum{0};
+};
+
+/**
+ * @brief Server instrumentation rendered in the Prometheus text format.
+ *
+ * All counters are sharded by the cpu the recording thread runs on, so
+ * threads on different cores never write the same cache line. Rendering
+ * sums the shards up.
+ *
+ * Requests are counted per method and registered route, labelled with the
+ * path the route got registered under, never with the path a client sent.
+ * Routes are looked up by their `Route` in a fixed size table, requests to
+ * unknown routes and to routes beyond `max_routes` share the `unmatched`
+ * series.
+ *
+ */
+class Metrics {
+public:
+  /**
+   * @brief Construct new Metrics
+   *
+   * @param max_routes routes with their own series
+   */
+  explicit Metrics(std::size_t max_routes = 128);
+
+  /**
+   * @brief Free all shards
+   *
+   */
+  ~Metrics();
+
+  Metrics(const Metrics &) = delete;
+  Metrics &operator=(const Metrics &) = delete;
+
+  /**
+   * @brief record a routed request
+   *
+   * @param route matched route (or null)
+   * @param method request method
+   * @param prefix group prefixes in front of the path of the route
+   * @param status response status code
+   * @param latency time the handlers took
+   */
+  void request(const Route *route, std::string_view method,
+               std::string_view prefix, int status,
+               std::chrono::nanoseconds latency);
+
+  /**
+   * @brief record the measured phases of a request
+   *
+   * @param timing request timing
+   */
+  void phases(const RequestTiming &timing) noexcept;
+
+  /**
+   * @brief count transferred bytes
+   *
+   * @param received request bytes
+   * @param sent response bytes
+   */
+  void transfer(std::size_t received, std::size_t sent) noexcept;
+
+  /**
+   * @brief change the open connection gauge
+   *
+   * @param delta +1 or -1
+   */
+  void connections(std::int64_t delta) noexcept;
+
+  /**
+   * @brief change the open websocket gauge
+   *
+   * @param delta +1 or -1
+   */
+  void websockets(std::int64_t delta) noexcept;
+
+  /**
+   * @brief count a completed tls handshake
+   *
+   * @param resumed the handshake resumed an earlier session
+   */
+  void handshake(bool resumed) noexcept;
+
+  /**
+   * @brief change the gauge of handshakes waiting for a handshake thread
+   *
+   * @param delta +1 or -1
+   */
+  void pendingHandshakes(std::int64_t delta) noexcept;
+
+  /**
+   * @brief count a connection closed because too many handshakes waited
+   *
+   */
+  void handshakeRejected() noexcept;
+
+  /**
+   * @brief render all metrics
+   *
+   * @return std::string - Prometheus text format
+   */
+  std::string render() const;
+
+private:
+  /**
+   * @brief Counters of one route on one shard
+   *
+   */
+  struct RouteShard {
+    /** @brief handler latency */
+    Histogram latency;
+
+    /** @brief requests by status class (1xx to 5xx) */
+    std::array<std::atomic<std::uint64_t>, 5> classes{};
+  };
+
+  /**
+   * @brief Labels of a route table entry
+   *
+   */
+  struct RouteEntry {
+    /** @brief claimed by this route */
+    std::atomic<const Route *> route{nullptr};
+
+    /** @brief labels are written */
+    std::atomic<bool> ready{false};
+
+    /** @brief method label */
+    std::string method;
+
+    /** @brief route label */
+    std::string path;
+  };
+
+  /**
+   * @brief Counters of one cpu
+   *
+   */
+  struct alignas(64) Shard {
+    /** @brief responses by status code */
+    std::array<std::atomic<std::uint64_t>, 600> statuses{};
+
+    /** @brief request bytes */
+    std::atomic<std::uint64_t> received{0};
+
+    /** @brief response bytes */
+    std::atomic<std::uint64_t> sent{0};
+
+    /** @brief opened minus closed connections */
+    std::atomic<std::int64_t> connections{0};
+
+    /** @brief opened minus closed websockets */
+    std::atomic<std::int64_t> websockets{0};
+
+    /** @brief tls handshakes, full and resumed */
+    std::array<std::atomic<std::uint64_t>, 2> handshakes{};
+
+    /** @brief queued minus started handshakes */
+    std::atomic<std::int64_t> pending_handshakes{0};
+
+    /** @brief connections refused by the handshake queue */
+    std::atomic<std::uint64_t> rejected_handshakes{0};
+
+    /** @brief time per request phase */
+    std::array<Histogram, PhaseCount> phases{};
+
+    /** @brief route counters, allocated on first use */
+    std::unique_ptr<std::atomic<RouteShard *>[]> routes;
+  };
+
+  /**
+   * @brief Get the shard of the calling thread
+   *
+   * @return Shard&
+   */
+  Shard &local() noexcept;
+
+  /**
+   * @brief find or claim the table entry of a route
+   *
+   * @param route matched route (or null)
+   * @param method request method
+   * @param prefix group prefixes in front of the path of the route
+   * @return std::size_t - entry index (`max_routes` for unmatched)
+   */
+  std::size_t find(const Route *route, std::string_view method,
+                   std::string_view prefix);
+
+  /** @brief routes with their own series */
+  std::size_t max_routes;
+
+  /** @brief route table, open addressing */
+  std::unique_ptr<RouteEntry[]> entries;
+
+  /** @brief one shard per cpu */
+  std::vector<Shard> shards;
+};
+} // namespace W
@@ -0,0 +1,222 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/con.hpp>
+#include <webli/executor.hpp>
+#include <webli/timer_wheel.hpp>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace W {
+/**
+ * @brief Single threaded event reactor connections are registered in. It
+ * owns the timers and the task queue, the io backends (`EventLoop` for epoll,
+ * `UringLoop` for io_uring) implement the socket handling.
+ *
+ * Interest masks use the epoll flags: EPOLLIN to wait for data, EPOLLOUT to
+ * wait until the connection is writable and EPOLLONESHOT without other flags
+ * to pause a connection.
+ *
+ * All functions except `post` and `stop` have to be called from the thread
+ * running the reactor.
+ *
+ */
+class Reactor : public Executor {
+public:
+  /**
+   * @brief Typedef for the callback invoked with the ready events
+   *
+   */
+  using Callback = std::function<void(std::uint32_t events)>;
+
+  /**
+   * @brief Typedef for the callback invoked with every accepted connection
+   *
+   */
+  using AcceptCallback =
+      std::function<void(int client_sd, struct in_addr address)>;
+
+  /**
+   * @brief Typedef for tasks posted from other threads
+   *
+   */
+  using Task = std::function<void()>;
+
+  /**
+   * @brief Typedef for timer handles (0 is never a valid timer)
+   *
+   */
+  using TimerId = TimerWheel::TimerId;
+
+  /**
+   * @brief Construct a new Reactor
+   *
+   * @throws W::Exception when the wakeup descriptor can't be created
+   */
+  Reactor();
+
+  /**
+   * @brief Destroy the Reactor
+   *
+   */
+  ~Reactor() override;
+
+  Reactor(const Reactor &) = delete;
+  Reactor &operator=(const Reactor &) = delete;
+
+  /**
+   * @brief accept connections on a listening socket until the reactor stops
+   *
+   * @param sd listening socket descriptor
+   * @param callback called with every accepted client socket
+   */
+  virtual void accept(int sd, const AcceptCallback &callback) = 0;
+
+  /**
+   * @brief stop accepting connections on a listening socket, the socket
+   * stays open
+   *
+   * @param sd listening socket descriptor passed to `accept`
+   */
+  virtual void stopAccept(int sd) = 0;
+
+  /**
+   * @brief register a connection
+   *
+   * @param con connection, has to outlive the registration
+   * @param events interest mask
+   * @param callback called when the connection is ready
+   */
+  virtual void attach(Con &con, std::uint32_t events,
+                      const Callback &callback) = 0;
+
+  /**
+   * @brief change the interest mask of a registered connection
+   *
+   * @param con registered connection
+   * @param events interest mask
+   */
+  virtual void modify(Con &con, std::uint32_t events) = 0;
+
+  /**
+   * @brief unregister a connection without closing it, e.g. to hand it to a
+   * blocking thread. Bytes the reactor still receives for it get fed into
+   * the connection.
+   *
+   * @param con registered connection
+   * @param done runs on the reactor thread once the reactor is done with the
+   * connection, the new owner may use it from then on
+   */
+  virtual void detach(Con &con, Task done) = 0;
+
+  /**
+   * @brief unregister a connection and take it over. The connection gets
+   * destroyed as soon as its pending output is sent.
+   *
+   * @param con registered connection
+   */
+  virtual void close(std::unique_ptr<Con> con) = 0;
+
+  /**
+   * @brief send data the connection produced outside of the socket, called
+   * after every state change of a connection
+   *
+   * @param con registered connection
+   */
+  virtual void flush(Con &con);
+
+  /**
+   * @brief Get the connection mode the backend drives
+   *
+   * @return ConMode
+   */
+  virtual ConMode connectionMode() const noexcept = 0;
+
+  /**
+   * @brief process events until `stop` is called
+   *
+   */
+  virtual void run() = 0;
+
+  /**
+   * @brief run a task on the reactor thread, can be called from any thread
+   *
+   * @param task task to run
+   */
+  void post(Task task);
+
+  /**
+   * @brief same as `post`
+   *
+   * @param job job to run
+   */
+  void execute(Job job) override;
+
+  /**
+   * @brief make `run` return, can be called from any thread. Called before
+   * `run` it makes `run` return right away.
+   *
+   */
+  void stop();
+
+  /**
+   * @brief run a task on the reactor thread after a delay
+   *
+   * @param delay time until the task runs
+   * @param task task to run
+   * @return TimerId - handle to cancel the timer
+   */
+  TimerId after(std::chrono::milliseconds delay, Task task);
+
+  /**
+   * @brief cancel a pending timer, expired or unknown timers are ignored
+   *
+   * @param id timer handle
+   */
+  void cancel(TimerId id) noexcept;
+
+protected:
+  /**
+   * @brief run all tasks that were posted since the last wakeup
+   *
+   */
+  void runPosted();
+
+  /**
+   * @brief run all expired timers
+   *
+   */
+  void runTimers();
+
+  /**
+   * @brief get the time until the timers have to run again
+   *
+   * @return int - milliseconds (-1 without timers)
+   */
+  int timeout() const noexcept;
+
+  /** @brief eventfd used to wake the reactor for posted tasks */
+  int wakefd;
+
+  /** @brief false once `stop` was called, a later `run` returns at once */
+  std::atomic<bool> running{true};
+
+private:
+  /** @brief pending timers */
+  TimerWheel timers;
+
+  /** @brief lock protecting the posted task queue */
+  std::mutex queue_lock;
+
+  /** @brief tasks posted from other threads */
+  std::vector<Task> queue;
+};
+} // namespace W
@@ -0,0 +1,187 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace W::Http {
+/**
+ * @brief Header field of a parsed request, views into the parsed bytes
+ *
+ */
+using HeaderView = struct HeaderView {
+  /** @brief field name as sent */
+  std::string_view key;
+
+  /** @brief field value without surrounding whitespace */
+  std::string_view value;
+};
+
+/**
+ * @brief Incremental zero-copy HTTP/1.1 request head parser.
+ *
+ * Works on the contiguous bytes of a connection, from the first byte of the
+ * request on. It can be called again whenever more bytes arrived, even after
+ * the buffer moved, and only looks at the new ones. Once the head is complete
+ * method, path, version and header are views into the bytes of the last call,
+ * they stay valid as long as those bytes are not changed. Lines end with
+ * CRLF or a lone LF (RFC 9112 2.2), other bare CRs are refused.
+ *
+ */
+class RequestParser {
+public:
+  /**
+   * @brief Result of a parse call
+   *
+   */
+  enum class Status { Incomplete, Done, Invalid };
+
+  /** @brief header fields a request may have at most */
+  static constexpr std::size_t MaxHeaders = 100;
+
+  /**
+   * @brief parse on
+   *
+   * @param data the bytes of the request so far, the bytes of the previous
+   * call have to start it unchanged
+   * @return Status
+   */
+  Status parse(std::string_view data);
+
+  /**
+   * @brief start over with a new request, keeps the memory
+   *
+   */
+  void reset() noexcept;
+
+  /**
+   * @brief Get the size of the head including the empty line
+   *
+   * @return std::size_t - 0 before the head is complete
+   */
+  std::size_t getHeadSize() const noexcept;
+
+  /**
+   * @brief Get the Method
+   *
+   * @return std::string_view
+   */
+  std::string_view getMethod() const noexcept;
+
+  /**
+   * @brief Get the Path (request target)
+   *
+   * @return std::string_view
+   */
+  std::string_view getPath() const noexcept;
+
+  /**
+   * @brief Get the Version
+   *
+   * @return std::string_view
+   */
+  std::string_view getVersion() const noexcept;
+
+  /**
+   * @brief Get the header fields in the order they were sent
+   *
+   * @return const std::vector<HeaderView>&
+   */
+  const std::vector<HeaderView> &getHeaders() const noexcept;
+
+  /**
+   * @brief Get the value of the first header field with a name, ignoring
+   * case
+   *
+   * @param key field name
+   * @return std::string_view - empty if there is none
+   */
+  std::string_view getHeader(std::string_view key) const noexcept;
+
+  /**
+   * @brief Get the body bytes of a Content-Length request that are in the
+   * parsed bytes, all of them once the request is complete
+   *
+   * @return std::string_view - empty without a Content-Length
+   */
+  std::string_view getBody() const noexcept;
+
+private:
+  /**
+   * @brief Part of the head parsed next
+   *
+   */
+  enum class Stage { RequestLine, Fields, Done, Invalid };
+
+  /**
+   * @brief Position of a part of the head, the bytes may move between calls
+   *
+   */
+  struct Span {
+    /** @brief offset from the start of the request */
+    std::size_t pos{0};
+
+    /** @brief size */
+    std::size_t size{0};
+  };
+
+  /**
+   * @brief parse the request line
+   *
+   * @param line request line without its line break
+   * @return true
+   * @return false if it is malformed
+   */
+  bool requestLine(Span line);
+
+  /**
+   * @brief parse a header field line
+   *
+   * @param line field line without its line break
+   * @return true
+   * @return false if it is malformed or one too many
+   */
+  bool field(Span line);
+
+  /**
+   * @brief Get the view of a span into the bytes of the last call
+   *
+   * @param span span
+   * @return std::string_view
+   */
+  std::string_view view(Span span) const noexcept;
+
+  /** @brief bytes of the last call */
+  std::string_view data;
+
+  /** @brief part of the head parsed next */
+  Stage stage{Stage::RequestLine};
+
+  /** @brief start of the next line */
+  std::size_t line{0};
+
+  /** @brief bytes searched for the end of the next line already */
+  std::size_t scanned{0};
+
+  /** @brief size of the complete head */
+  std::size_t head_size{0};
+
+  /** @brief method */
+  Span method;
+
+  /** @brief request target */
+  Span path;
+
+  /** @brief http version */
+  Span version;
+
+  /** @brief header fields, name and value */
+  std::vector<std::pair<Span, Span>> fields;
+
+  /** @brief views of the fields once the head is complete */
+  std::vector<HeaderView> headers;
+};
+} // namespace W::Http
@@ -0,0 +1,141 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/http.hpp>
+#include <webli/request_parser.hpp>
+#include <webli/router.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace W {
+/**
+ * @brief Incremental HTTP/1.1 request reader.
+ *
+ * Takes the bytes of a connection as they arrive and frames one request at a
+ * time: the head once it is complete, then a body of `Content-Length` bytes
+ * or in `Transfer-Encoding: chunked`. Bodies are buffered in the request up
+ * to a cap, or passed on piece by piece to the body handler of their route.
+ *
+ */
+class RequestReader {
+public:
+  /**
+   * @brief Construct a new Request Reader
+   *
+   * @param router router to look up body handlers in
+   * @param max_head bytes a request head may take at most
+   * @param max_body bytes a buffered body may take at most
+   */
+  RequestReader(const Router &router, std::size_t max_head,
+                std::size_t max_body);
+
+  /**
+   * @brief Destroy the Request Reader, the unfinished request goes back to
+   * the pool
+   *
+   */
+  ~RequestReader();
+
+  RequestReader(const RequestReader &) = delete;
+  RequestReader &operator=(const RequestReader &) = delete;
+
+  /**
+   * @brief take received bytes. Bytes past the end of the request and an
+   * incomplete head, chunk size or trailer line are left over, the caller
+   * keeps them for the next call.
+   *
+   * @param data received bytes
+   * @param early_data the bytes arrived as tls early data
+   * @return std::size_t - bytes taken from the front of data
+   * @throws WebException::BadRequest on malformed requests
+   * @throws WebException::HeaderFieldsTooLarge when the head exceeds its cap
+   * @throws WebException::PayloadTooLarge when a buffered body exceeds its cap
+   */
+  std::size_t feed(std::string_view data, bool early_data = false);
+
+  /**
+   * @brief check if the head of the current request was read
+   *
+   * @return true
+   * @return false
+   */
+  bool hasHead() const noexcept;
+
+  /**
+   * @brief check if the current request was read completely
+   *
+   * @return true
+   * @return false
+   */
+  bool isDone() const noexcept;
+
+  /**
+   * @brief take the complete request and start over with the next one,
+   * give it back to the pool when done
+   *
+   * @return std::shared_ptr<Http::Request>
+   */
+  std::shared_ptr<Http::Request> take();
+
+private:
+  /**
+   * @brief Part of the request read next
+   *
+   */
+  enum class Stage {
+    Head,
+    Body,
+    ChunkSize,
+    ChunkData,
+    ChunkEnd,
+    Trailer,
+    Done
+  };
+
+  /**
+   * @brief take the parsed head and find out how the body is framed
+   *
+   * @param early_data the head arrived as tls early data
+   * @throws WebException::BadRequest when the framing is ambiguous, e.g. a
+   * length next to a transfer coding, or the coding is not just chunked
+   */
+  void parseHead(bool early_data);
+
+  /**
+   * @brief hand a piece of the body to the handler or the request
+   *
+   * @param data decoded body bytes
+   */
+  void append(std::string_view data);
+
+  /** @brief router to look up body handlers in */
+  const Router &router;
+
+  /** @brief bytes a request head may take at most */
+  std::size_t max_head;
+
+  /** @brief bytes a buffered body may take at most */
+  std::size_t max_body;
+
+  /** @brief part of the request read next */
+  Stage stage{Stage::Head};
+
+  /** @brief parser of the head, resumes where the last bytes ended */
+  Http::RequestParser parser;
+
+  /** @brief request being read */
+  std::shared_ptr<Http::Request> request;
+
+  /** @brief body handler of the route (null = buffer the body) */
+  const BodyHandler *body_handler{nullptr};
+
+  /** @brief bytes left of the body or the current chunk */
+  std::size_t remaining{0};
+
+  /** @brief body bytes buffered so far */
+  std::size_t buffered{0};
+};
+} // namespace W
@@ -4,12 +4,16 @@
 
 #include <webli/con.hpp>
 #include <webli/http.hpp>
+#include <webli/task.hpp>
 
+#include <concepts>
 #include <functional>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <variant>
 #include <vector>
 
 namespace W {
@@ -20,6 +24,66 @@ namespace W {
 using HttpUserHandler =
     std::function<void(const Http::Request &, std::shared_ptr<Http::Response>)>;
 
+/**
+ * @brief Typedef for coroutine request handler function prototype.
+ *
+ * The handler may `co_await` other tasks, `W::blocking` or `W::sleep` and
+ * gets resumed on its executor. The request reference stays valid until the
+ * task is done.
+ *
+ */
+using HttpCoroutineHandler = std::function<Task<>(
+    const Http::Request &, std::shared_ptr<Http::Response>)>;
+
+/**
+ * @brief Callables that can be registered as coroutine handler
+ *
+ */
+template <typename F>
+concept CoroutineHandler =
+    std::invocable<F &, const Http::Request &,
+                   std::shared_ptr<Http::Response>> &&
+    std::same_as<std::invoke_result_t<F &, const Http::Request &,
+                                      std::shared_ptr<Http::Response>>,
+                 Task<>>;
+
+/**
+ * @brief A plain or a coroutine request handler
+ *
+ */
+using HttpHandler = std::variant<HttpUserHandler, HttpCoroutineHandler>;
+
+/**
+ * @brief Typedef for request body handler function prototype.
+ *
+ * Gets the body of a request piece by piece while it arrives, on the thread
+ * reading the connection, after the head and before the route handlers run.
+ *
+ */
+using BodyHandler =
+    std::function<void(const Http::Request &, std::string_view)>;
+
+/**
+ * @brief Handlers registered under method + route
+ *
+ */
+using Route = struct Route {
+  /** @brief handler chain, called in order */
+  std::vector<HttpHandler> handlers;
+
+  /**
+   * @brief the route may run on replayable tls early data, GET, HEAD and
+   * OPTIONS routes are by default
+   */
+  bool idempotent{false};
+
+  /** @brief takes the body instead of the request (empty = buffer it) */
+  BodyHandler body_handler{};
+
+  /** @brief path the route got registered under, within its router */
+  std::string path{};
+};
+
 /**
  * @brief HTTP Router
  *
@@ -46,6 +110,18 @@ public:
    */
   void get(std::string_view route, const HttpUserHandler &handler);
 
+  /**
+   * @brief register a new GET route with one coroutine handler
+   *
+   * @param route http route
+   * @param handler coroutine handler function
+   */
+  template <CoroutineHandler F>
+  void get(std::string_view route, F &&handler) {
+    this->custom("GET", route,
+                 HttpCoroutineHandler(std::forward<F>(handler)));
+  }
+
   /**
    * @brief register a new GET route with more than one handler
    *
@@ -62,6 +138,18 @@ public:
    */
   void post(std::string_view route, const HttpUserHandler &handler);
 
+  /**
+   * @brief register a new POST route with one coroutine handler
+   *
+   * @param route http route
+   * @param handler coroutine handler function
+   */
+  template <CoroutineHandler F>
+  void post(std::string_view route, F &&handler) {
+    this->custom("POST", route,
+                 HttpCoroutineHandler(std::forward<F>(handler)));
+  }
+
   /**
    * @brief register a new POST route with more than one handler
    *
@@ -79,6 +167,18 @@ public:
    */
   void put(std::string_view route, const HttpUserHandler &handler);
 
+  /**
+   * @brief register a new PUT route with one coroutine handler
+   *
+   * @param route http route
+   * @param handler coroutine handler function
+   */
+  template <CoroutineHandler F>
+  void put(std::string_view route, F &&handler) {
+    this->custom("PUT", route,
+                 HttpCoroutineHandler(std::forward<F>(handler)));
+  }
+
   /**
    * @brief register a new PUT route with more than one handler
    *
@@ -95,6 +195,18 @@ public:
    */
   void patch(std::string_view route, const HttpUserHandler &handler);
 
+  /**
+   * @brief register a new PATCH route with one coroutine handler
+   *
+   * @param route http route
+   * @param handler coroutine handler function
+   */
+  template <CoroutineHandler F>
+  void patch(std::string_view route, F &&handler) {
+    this->custom("PATCH", route,
+                 HttpCoroutineHandler(std::forward<F>(handler)));
+  }
+
   /**
    * @brief register a new PATCH route with more than one handler
    *
@@ -112,6 +224,18 @@ public:
    */
   void del(std::string_view route, const HttpUserHandler &handler);
 
+  /**
+   * @brief register a new DELETE route with one coroutine handler
+   *
+   * @param route http route
+   * @param handler coroutine handler function
+   */
+  template <CoroutineHandler F>
+  void del(std::string_view route, F &&handler) {
+    this->custom("DELETE", route,
+                 HttpCoroutineHandler(std::forward<F>(handler)));
+  }
+
   /**
    * @brief register a new DELETE route with more than one handler
    *
@@ -130,6 +254,31 @@ public:
   void custom(std::string_view method, std::string_view route,
               const HttpUserHandler &handler);
 
+  /**
+   * @brief register a new route under a custom method with one coroutine
+   * handler
+   *
+   * @param method http method
+   * @param route http route
+   * @param handler coroutine handler function
+   */
+  void custom(std::string_view method, std::string_view route,
+              const HttpCoroutineHandler &handler);
+
+  /**
+   * @brief register a new route under a custom method with one coroutine
+   * handler
+   *
+   * @param method http method
+   * @param route http route
+   * @param handler coroutine handler function
+   */
+  template <CoroutineHandler F>
+  void custom(std::string_view method, std::string_view route, F &&handler) {
+    const HttpCoroutineHandler coroutine(std::forward<F>(handler));
+    this->custom(method, route, coroutine);
+  }
+
   /**
    * @brief register a new route under a custom method with more than one
    * handler
@@ -141,6 +290,31 @@ public:
   void custom(std::string_view method, std::string_view route,
               const std::vector<HttpUserHandler> &handler);
 
+  /**
+   * @brief mark a registered route as (not) idempotent. Requests in tls early
+   * data only reach idempotent routes, the others answer 425 Too Early.
+   *
+   * @param method http method
+   * @param route http route
+   * @param idempotent running the route twice does no harm
+   * @throws W::Exception when nothing is registered
+   */
+  void setIdempotent(std::string_view method, std::string_view route,
+                     bool idempotent = true);
+
+  /**
+   * @brief stream the request bodies of a registered route into a handler.
+   * They skip the request and its size cap then. HTTP/2 bodies are always
+   * buffered, up to `Http2Options::max_body_size`.
+   *
+   * @param method http method
+   * @param route http route
+   * @param handler body handler function
+   * @throws W::Exception when nothing is registered
+   */
+  void setBodyHandler(std::string_view method, std::string_view route,
+                      const BodyHandler &handler);
+
   /**
    * @brief register a group to redirect requests to another router
    *
@@ -158,20 +332,47 @@ public:
   void group(std::string_view route, Router *router);
 
   /**
-   * @brief Get the HttpUserHandler Vector registered under method +
-   * route
+   * @brief Get the Route registered under method + route
+   *
+   * @param method http method
+   * @param route http route
+   * @param prefix set to the size of the group prefixes in front of the
+   * path of the route (optional)
+   * @return const Route&
+   * @throws WebException::NotFound when nothing is registered
+   */
+  const Route &getRoute(std::string_view method, std::string_view route,
+                        std::size_t *prefix = nullptr) const;
+
+  /**
+   * @brief Find the Route registered under method + route
+   *
+   * @param method http method
+   * @param route http route
+   * @param prefix set to the size of the group prefixes in front of the
+   * path of the route (optional)
+   * @return const Route* - null when nothing is registered
+   */
+  const Route *findRoute(std::string_view method, std::string_view route,
+                         std::size_t *prefix = nullptr) const;
+
+  /**
+   * @brief Get the plain handler chain registered under method + route
+   * @deprecated use `getRoute`, routes may hold coroutine handlers
    *
    * @param method http method
    * @param route http route
-   * @return const std::vector<HttpUserHandler>&
+   * @return std::vector<HttpUserHandler> - copy of the handler chain
+   * @throws WebException::NotFound when nothing is registered
+   * @throws W::Exception when the route has a coroutine handler
    */
-  const std::vector<HttpUserHandler> &getHandler(std::string_view method,
-                                                 std::string_view route) const;
+  [[deprecated("use getRoute, routes may hold coroutine handlers")]]
+  std::vector<HttpUserHandler> getHandler(std::string_view method,
+                                          std::string_view route) const;
 
 private:
-  /** @brief hash map containing std::vector with HttpUserHandler */
-  std::unordered_map<std::string, std::vector<HttpUserHandler>,
-                     Http::StringHash, std::equal_to<>>
+  /** @brief hash map containing the routes */
+  std::unordered_map<std::string, Route, Http::StringHash, std::equal_to<>>
       map;
 
   /** @brief hash map containing router pointer */
@@ -2,15 +2,277 @@
 
 #pragma once
 
+#include <webli/access_log.hpp>
+#include <webli/affinity.hpp>
+#include <webli/admission.hpp>
+#include <webli/buffer_pool.hpp>
 #include <webli/con.hpp>
+#include <webli/event_loop.hpp>
 #include <webli/exceptions.hpp>
+#include <webli/handoff.hpp>
+#include <webli/http2.hpp>
+#include <webli/metrics.hpp>
+#include <webli/request_reader.hpp>
 #include <webli/router.hpp>
+#include <webli/task.hpp>
+#include <webli/tcp_con.hpp>
+#include <webli/thread_pool.hpp>
+#include <webli/tls_con.hpp>
+#include <webli/tls_session.hpp>
+#include <webli/uring_loop.hpp>
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <memory>
+#include <mutex>
 #include <openssl/ssl.h>
+#include <string>
 #include <string_view>
+#include <sys/socket.h>
+#include <unordered_set>
+#include <vector>
 
 namespace W {
+/**
+ * @brief Connection handling strategy of the server
+ *
+ */
+enum class ServerMode {
+  /** @brief non-blocking sockets multiplexed by epoll loop threads */
+  EventLoop,
+  /** @brief one detached thread per accepted connection (legacy) */
+  ThreadPerConnection,
+  /** @brief blocking connections handled by the work-stealing worker pool */
+  WorkerPool
+};
+
+/**
+ * @brief Socket io backend of the event loop threads
+ *
+ */
+enum class IoBackend {
+  /** @brief readiness through epoll, tls records go straight to the socket */
+  Epoll,
+  /**
+   * @brief batched accept, recv and send through io_uring, falls back to
+   * epoll if the kernel lacks support
+   */
+  IoUring
+};
+
+/**
+ * @brief Protocol the listening sockets speak below http
+ *
+ */
+enum class Transport {
+  /** @brief https, needs `Server::ssl_config` */
+  Tls,
+  /**
+   * @brief plain http, for servers behind a tls terminating proxy on a
+   * trusted network
+   */
+  Tcp
+};
+
+/**
+ * @brief Server tuning options
+ *
+ */
+using ServerOptions = struct ServerOptions {
+  /**
+   * @brief server read buffer size, a request head has to fit in it (431
+   * Request Header Fields Too Large otherwise)
+   */
+  std::size_t buffer_size{2048};
+
+  /**
+   * @brief bytes of a HTTP/1.1 request body buffered at most (413 Payload Too
+   * Large otherwise), bodies streaming into a body handler are not capped
+   */
+  std::size_t max_body_size{1 << 20};
+
+  /**
+   * @brief connection buffers, requests and responses every thread keeps for
+   * reuse, of each (0 = no pooling). Hits and misses show up in the metrics.
+   * Process-global: the pools belong to the threads, not to a server, so the
+   * server constructed last sets the limit for all of them and the metrics
+   * of every server count the pools of the whole process.
+   */
+  std::size_t pool_size{64};
+
+  /**
+   * @brief pooled buffers and bodies that grew larger get freed instead.
+   * Process-global like `pool_size`.
+   */
+  std::size_t max_pooled_buffer{1 << 16};
+
+  /** @brief connection handling strategy */
+  ServerMode mode{ServerMode::EventLoop};
+
+  /** @brief number of event loop threads (0 = one per core) */
+  std::size_t loop_threads{0};
+
+  /** @brief io backend of the event loop threads */
+  IoBackend io_backend{IoBackend::Epoll};
+
+  /** @brief protocol of the listening sockets */
+  Transport transport{Transport::Tls};
+
+  /** @brief HTTP/2 through ALPN (tls only) */
+  Http2Options http2{};
+
+  /**
+   * @brief kernel tls offload where openssl and the kernel support it,
+   * records get encrypted in the kernel and file bodies skip userspace
+   */
+  bool ktls{true};
+
+  /** @brief tls session resumption */
+  TlsSessionOptions tls_sessions{};
+
+  /**
+   * @brief number of listening sockets sharing the port through SO_REUSEPORT,
+   * each with its own accept loop. In event loop mode every socket belongs to
+   * one loop and keeps its connections there, so match `loop_threads`.
+   */
+  std::size_t acceptors{1};
+
+  /**
+   * @brief where accept loops run. In event loop mode it places every loop
+   * thread, loop n serves listening socket n.
+   */
+  Placement acceptor_placement{Placement::None};
+
+  /**
+   * @brief where worker pool threads run. Workers allocate their connection
+   * buffers themselves, so they stay on the node of the worker.
+   */
+  Placement worker_placement{Placement::None};
+
+  /** @brief cores threads get placed on, in this order (empty = all) */
+  std::vector<int> cores{};
+
+  /** @brief listen backlog of every listening socket */
+  int backlog{SOMAXCONN};
+
+  /** @brief serve more than one request per connection */
+  bool keep_alive{true};
+
+  /**
+   * @brief connections the worker pool keeps open between requests at most
+   * (0 = half the workers, at least one). A connection waiting for its next
+   * request holds a worker, once this many wait further responses close
+   * their connection.
+   */
+  std::size_t pool_keep_alive{0};
+
+  /**
+   * @brief time an idle connection stays open, before the first request and
+   * between persistent ones
+   */
+  std::chrono::seconds keep_alive_timeout{5};
+
+  /** @brief time a client gets to finish the tls handshake */
+  std::chrono::seconds handshake_timeout{10};
+
+  /** @brief time a client gets to send the request head once it started */
+  std::chrono::seconds header_timeout{10};
+
+  /** @brief time a client gets to send the body after the request head */
+  std::chrono::seconds body_timeout{30};
+
+  /** @brief time a client gets to take the whole response */
+  std::chrono::seconds write_timeout{30};
+
+  /** @brief time a websocket may stay silent (0 = unlimited) */
+  std::chrono::seconds websocket_timeout{0};
+
+  /** @brief requests served on one connection before it gets closed */
+  std::size_t max_requests{100};
+
+  /** @brief number of worker pool threads (0 = one per core) */
+  std::size_t worker_threads{0};
+
+  /**
+   * @brief threads running tls handshakes apart from the threads serving
+   * requests, so a burst of new clients can't slow down established ones
+   * (0 = handshakes run where their connection is served). Established
+   * connections move on to the worker pool, their own thread or back to
+   * their event loop. io_uring loops keep their handshakes, the loop feeds
+   * the records of a connection while it waits.
+   */
+  std::size_t handshake_threads{0};
+
+  /**
+   * @brief handshakes waiting for a handshake thread at most, further
+   * connections get closed (0 = unlimited)
+   */
+  std::size_t max_pending_handshakes{0};
+
+  /**
+   * @brief run the router on the worker pool instead of the event loop
+   * thread, use it for handlers that block or burn cpu
+   */
+  bool offload_handlers{false};
+
+  /**
+   * @brief unix socket path for hot restarts (empty = disabled). A server
+   * started with the same path takes over the listening sockets of the
+   * running one, which then stops accepting and drains.
+   */
+  std::string handoff_path{};
+
+  /**
+   * @brief SIGINT and SIGTERM stop the server gracefully. The previous
+   * actions come back once the server stops, so a second signal ends the
+   * process as before.
+   */
+  bool stop_on_signal{false};
+
+  /**
+   * @brief open connections at most, further ones get closed right after
+   * accept (0 = unlimited)
+   */
+  std::size_t max_connections{0};
+
+  /**
+   * @brief requests running at the same time at most, further ones get a 503
+   * (0 = unlimited)
+   */
+  std::size_t max_in_flight{0};
+
+  /**
+   * @brief acceptable time a request waits for a worker. Once the delay
+   * stayed above it for a whole `queue_interval`, requests waiting longer get
+   * a 503 (0 = disabled).
+   */
+  std::chrono::milliseconds queue_target{5};
+
+  /** @brief interval the queue delay is measured over */
+  std::chrono::milliseconds queue_interval{100};
+
+  /** @brief Retry-After value of shed requests */
+  std::chrono::seconds retry_after{1};
+
+  /** @brief access log of served requests */
+  AccessLogOptions access_log{};
+
+  /**
+   * @brief requests taking longer get logged with the time of every phase
+   * (0 = disabled)
+   */
+  std::chrono::milliseconds slow_request{0};
+
+  /**
+   * @brief GET route rendering the metrics in the Prometheus text format
+   * (empty = disabled), the metrics get recorded either way
+   */
+  std::string metrics_path{};
+};
+
+class Session;
+
 /**
  * @brief TLS over HTTP Server
  *
@@ -24,6 +286,14 @@ public:
    */
   explicit Server(const Router &router, std::size_t buffer_size = 2048);
 
+  /**
+   * @brief Construct a new Server object
+   *
+   * @param router Router containing path handler
+   * @param options server tuning options
+   */
+  Server(const Router &router, const ServerOptions &options);
+
   /**
    * @brief Destroy the Server object
    *
@@ -32,7 +302,8 @@ public:
 
   /**
    * @brief Configure tls by passing key and cert path to the server.
-   * @warning A call to this function is needed in order to call listen.
+   * @warning A call to this function is needed in order to call listen with
+   * `Transport::Tls`.
    *
    * @param key_path path to key file
    * @param cert_path path to cert file
@@ -48,15 +319,189 @@ public:
    */
   void listen(std::string_view interface, std::uint16_t port);
 
+  /**
+   * @brief Stop accepting connections, `listen` returns once the open ones
+   * are done. Upgraded websockets get shut down, they would wait for their
+   * client otherwise. Can be called from any thread, called before `listen`
+   * it makes `listen` return right away.
+   *
+   */
+  void stop();
+
 private:
+  friend class Session;
+
+  /**
+   * @brief Internal subroutine creating, binding and listening on a socket.
+   *
+   * @param addr address to bind
+   * @return int - socket descriptor
+   */
+  int openListener(const struct sockaddr_in &addr) const;
+
+  /**
+   * @brief Internal subroutine wrapping an accepted socket into a connection
+   * of the configured transport.
+   *
+   * @param client_sd client socket
+   * @param address client address
+   * @param mode how the connection moves its bytes
+   * @return std::unique_ptr<Con>
+   * @throws W::Exception when the blocking tls handshake fails
+   */
+  std::unique_ptr<Con> openConnection(int client_sd, struct in_addr address,
+                                      ConMode mode) const;
+
+  /**
+   * @brief Internal subroutine pinning the calling thread according to its
+   * placement.
+   *
+   * @param placement placement of the thread kind
+   * @param index thread index within its kind
+   */
+  void place(Placement placement, std::size_t index) const;
+
+  /**
+   * @brief Internal accept loop handing every connection to its own thread or
+   * the worker pool.
+   *
+   * @param sd listening socket descriptor
+   */
+  void acceptThreads(int sd);
+
+  /**
+   * @brief Internal subroutine running the event loops until the server
+   * stops.
+   *
+   */
+  void runEventLoops();
+
+  /**
+   * @brief Internal subroutine registering a new connection in a loop.
+   *
+   * @param loop event loop serving the connection
+   * @param client_sd non-blocking client socket
+   * @param address client address
+   */
+  void startSession(Reactor &loop, int client_sd, struct in_addr address);
+
+  /**
+   * @brief Internal subroutine waiting until the server has to stop, either
+   * through `stop` or because a successor took over the listeners.
+   *
+   */
+  void watch();
+
+  /**
+   * @brief Internal subroutine waiting until all connections are closed,
+   * upgraded websockets included.
+   *
+   */
+  void drain();
+
+  /**
+   * @brief Internal subroutine giving SIGINT and SIGTERM back to their
+   * previous actions, if this server took them.
+   *
+   */
+  void restoreSignals() noexcept;
+
+  /**
+   * @brief Internal subroutine remembering the socket of a websocket to shut
+   * it down on stop, right away if the server stops already.
+   *
+   * @param sd socket descriptor
+   */
+  void websocketOpened(int sd);
+
+  /**
+   * @brief Internal subroutine forgetting the socket of a closed websocket.
+   *
+   * @param sd socket descriptor
+   */
+  void websocketClosed(int sd) noexcept;
+
+  /**
+   * @brief Internal subroutine shutting down the sockets of all websockets,
+   * their threads then end and release their connection slots.
+   *
+   */
+  void closeWebsockets();
+
+  /**
+   * @brief Internal subroutine counting a new connection.
+   *
+   * @return false if `max_connections` is reached, the connection is not
+   * counted then
+   */
+  bool connectionOpened() noexcept;
+
+  /**
+   * @brief Internal subroutine counting a closed connection.
+   *
+   */
+  void connectionClosed() noexcept;
+
+  /**
+   * @brief Internal subroutine reserving a worker for a connection waiting
+   * for its next request.
+   *
+   * @return false if `pool_keep_alive` connections wait already
+   */
+  bool reserveIdle() noexcept;
+
+  /**
+   * @brief Internal subroutine queueing a task on the handshake pool.
+   *
+   * @param task handshake (step) to run
+   * @return false if `max_pending_handshakes` wait already, the task is
+   * dropped then
+   */
+  bool offloadHandshake(ThreadPool::Task task);
+
+  /**
+   * @brief Internal subroutine running the blocking handshake of a new
+   * connection. The connection slot is released if it fails.
+   *
+   * @param client_sd client socket
+   * @param address client address
+   * @param timing request timing, gets the handshake phase
+   * @return std::unique_ptr<Con> - null if the handshake failed
+   */
+  std::unique_ptr<Con> handshake(int client_sd, struct in_addr address,
+                                 RequestTiming &timing);
+
+  /**
+   * @brief Internal subroutine running the handshake of a new connection on
+   * the handshake pool, the established connection goes on to the worker
+   * pool or a thread of its own.
+   *
+   * @param client_sd client socket
+   * @param address client address
+   */
+  void handshakeApart(int client_sd, struct in_addr address);
+
+  /**
+   * @brief Internal subroutine serving the requests of an established
+   * blocking connection until it closes, releases the connection slot.
+   *
+   * @param established connection after its handshake
+   * @param timing phases so far, the handshake counts to the first request
+   * @param sojourn time the connection waited for a worker
+   */
+  void serve(std::shared_ptr<Con> established, RequestTiming timing,
+             std::chrono::steady_clock::duration sojourn);
+
   /**
    * @brief Internal subroutine used for new connection threads.
    *
    * @param client_sd
    * @param address
    * @param server
+   * @param queued time the connection got queued for a worker
    */
-  static void handle_con(int client_sd, struct in_addr address, Server *server);
+  static void handle_con(int client_sd, struct in_addr address, Server *server,
+                         std::chrono::steady_clock::time_point queued);
 
   /**
    * @brief Internal subroutine used to upgrade a http request to a websocket
@@ -65,21 +510,109 @@ private:
    * @param con
    * @param path
    * @param e
+   * @param timing phases of the upgrade request
    */
   void handle_ws(const Con &con, std::string_view path,
-                 WebException::UpgradeToWebsocket &e);
+                 WebException::UpgradeToWebsocket &e, RequestTiming timing);
+
+  /**
+   * @brief Internal subroutine serving a HTTP/2 connection in a blocking
+   * thread, its streams get handled one after another
+   *
+   * @param con connection that negotiated h2
+   * @param timing phases so far, the handshake counts to the first request
+   */
+  void handle_h2(Con &con, RequestTiming timing);
 
-  /** @brief socket descriptor */
-  int sd;
+  /**
+   * @brief Run the handler chain registered for the request and record its
+   * latency. HTTP exceptions are turned into the response, websocket upgrades
+   * are rethrown.
+   *
+   * @param req parsed request, has to outlive the task
+   * @param resp response buffer passed to the handler
+   * @param timing request timing, gets the route and handler phase (has to
+   * outlive the task)
+   * @return Task<> - suspends while a coroutine handler waits
+   * @throws WebException::UpgradeToWebsocket
+   */
+  Task<> route(const Http::Request &req, std::shared_ptr<Http::Response> resp,
+               RequestTiming &timing);
+
+  /**
+   * @brief Record the phases of a written response and log the request if it
+   * was slow.
+   *
+   * @param timing request timing
+   * @param method request method
+   * @param path request path
+   */
+  void requestDone(const RequestTiming &timing, std::string_view method,
+                   std::string_view path);
 
-  /** @brief server first read buffer size */
-  std::size_t buffer_size;
+  /**
+   * @brief Decide if the connection stays open after this response and set
+   * the Connection, Keep-Alive and Content-Length header accordingly.
+   *
+   * @param req handled request
+   * @param resp response to send
+   * @param served number of requests served on the connection so far
+   * @param may_wait the connection may wait for another request at all
+   * @return true if the connection should wait for another request
+   */
+  bool keepAlive(const Http::Request &req, Http::Response &resp,
+                 std::size_t served, bool may_wait = true) const;
 
   /**
-   * @brief byte that indicates that the server is running.
-   * @todo turn false on interrupt
+   * @brief Serialize the answer to a request that could not be read, the
+   * connection closes after it.
+   *
+   * @param e error of the request reader
+   * @return std::string
    */
-  bool running{true};
+  std::string reject(WebException::HttpException &e);
+
+  /** @brief listening socket descriptors, one per acceptor */
+  std::vector<int> sds;
+
+  /** @brief server options */
+  ServerOptions options;
+
+  /** @brief false once the server stops accepting */
+  std::atomic<bool> running{true};
+
+  /** @brief eventfd signaled when the server has to stop */
+  int stop_fd{-1};
+
+  /** @brief open connections */
+  std::atomic<std::size_t> connections{0};
+
+  /** @brief SIGINT and SIGTERM are taken by this server */
+  bool signals{false};
+
+  /** @brief guards `websockets` and `websockets_closed` */
+  std::mutex websockets_mutex;
+
+  /** @brief sockets of the open websockets */
+  std::unordered_set<int> websockets;
+
+  /** @brief the websockets got shut down, new ones follow right away */
+  bool websockets_closed{false};
+
+  /** @brief hot restart socket (only with `handoff_path`) */
+  std::unique_ptr<Handoff> handoff;
+
+  /** @brief admission control of requests */
+  Admission admission;
+
+  /** @brief request and connection metrics */
+  Metrics metrics;
+
+  /** @brief 503 answer of shed requests */
+  Http::Response overload{};
+
+  /** @brief serialized `overload` */
+  std::string overload_response;
 
   /** @brief Router object holding path handler */
   Router router;
@@ -87,7 +620,31 @@ private:
   /** @brief SSL/TLS context */
   SSL_CTX *ctx;
 
-  /** @brief print lock used to synchronize logging between threads */
-  std::mutex print_lock;
+  /** @brief session ticket keys (only with tickets) */
+  std::unique_ptr<TicketKeys> ticket_keys;
+
+  /** @brief session cache (only with `tls_sessions.cache_size`) */
+  std::unique_ptr<SessionCache> session_cache;
+
+  /** @brief replay window of early data (only with early data) */
+  std::unique_ptr<EarlyDataGuard> early_data_guard;
+
+  /** @brief worker pool (only in WorkerPool mode or with offloaded handlers) */
+  std::unique_ptr<ThreadPool> pool;
+
+  /** @brief handshake pool (only with `handshake_threads` and tls) */
+  std::unique_ptr<ThreadPool> handshakes;
+
+  /** @brief handshakes waiting for a handshake thread */
+  std::atomic<std::size_t> pending_handshakes{0};
+
+  /** @brief pool connections waiting for their next request at most */
+  std::size_t max_idle{0};
+
+  /** @brief pool connections waiting for their next request */
+  std::atomic<std::size_t> idle_connections{0};
+
+  /** @brief access log of served requests */
+  AccessLog access_log;
 };
 } // namespace W
@@ -0,0 +1,282 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/con.hpp>
+#include <webli/reactor.hpp>
+#include <webli/exceptions.hpp>
+#include <webli/http.hpp>
+#include <webli/http2.hpp>
+#include <webli/metrics.hpp>
+#include <webli/request_reader.hpp>
+
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <string>
+
+namespace W {
+class Server;
+
+/**
+ * @brief HTTP connection driven by a `Reactor`. The session advances the
+ * tls handshake, reads the request, runs the router and writes the response
+ * without ever blocking the loop thread. Connections that negotiated h2
+ * multiplex their streams instead, every stream runs the router on its own.
+ *
+ */
+class Session : public std::enable_shared_from_this<Session> {
+public:
+  /**
+   * @brief Construct a new Session
+   *
+   * @param server server owning the router
+   * @param loop reactor the session is registered in
+   * @param con tls connection in the reactors connection mode
+   */
+  Session(Server &server, Reactor &loop, std::unique_ptr<Con> con);
+
+  /**
+   * @brief Destroy the Session, close the connection and release its slot in
+   * the server
+   *
+   */
+  ~Session();
+
+  /**
+   * @brief register the session in its reactor
+   *
+   */
+  void start();
+
+private:
+  /**
+   * @brief Session states
+   *
+   */
+  enum class State {
+    Handshake,
+    Handshaking,
+    Reading,
+    Processing,
+    Writing,
+    Multiplexing,
+    Closed
+  };
+
+  /**
+   * @brief Deadlines the connection is closed at, one per waiting phase
+   *
+   */
+  enum class Deadline { None, Handshake, Idle, Header, Body, Write };
+
+  /**
+   * @brief advance the state machine as far as possible without blocking
+   *
+   */
+  void drive();
+
+  /**
+   * @brief run the next handshake step on the handshake pool, the loop
+   * leaves the connection alone until it is back
+   *
+   */
+  void handshake();
+
+  /**
+   * @brief continue after the handshake finished
+   *
+   */
+  void established();
+
+  /**
+   * @brief feed the input buffer to the request reader, pipelined requests
+   * stay in it. A request the reader refuses gets rejected.
+   *
+   * @return true if a complete request is ready
+   * @return false while the request is incomplete or after a rejection
+   */
+  bool nextRequest();
+
+  /**
+   * @brief parse the buffered request and run the router inline or on the
+   * worker pool
+   *
+   */
+  void process();
+
+  /**
+   * @brief continue after the handler chain is done
+   *
+   * @param req handled request
+   * @param resp response filled by the router
+   * @param error exception that escaped the handlers (or null)
+   */
+  void finish(const Http::Request &req, Http::Response &resp,
+              std::exception_ptr error);
+
+  /**
+   * @brief run the router for a HTTP/2 stream inline or on the worker pool
+   *
+   * @param stream stream id
+   * @param request request of the stream
+   */
+  void dispatch(std::uint32_t stream, Http::Request request);
+
+  /**
+   * @brief answer a HTTP/2 stream after its handler chain is done
+   *
+   * @param stream stream id
+   * @param req handled request
+   * @param resp response filled by the router, its body gets moved out
+   * @param timing phases of the stream
+   * @param error exception that escaped the handlers (or null)
+   */
+  void finishStream(std::uint32_t stream, const Http::Request &req,
+                    Http::Response &resp, RequestTiming &timing,
+                    std::exception_ptr error);
+
+  /**
+   * @brief answer with the serialized 503 of the server and close afterwards
+   *
+   */
+  void shed();
+
+  /**
+   * @brief answer a request that could not be read and close afterwards
+   *
+   * @param e error of the request reader
+   */
+  void reject(WebException::HttpException &e);
+
+  /**
+   * @brief serialize the response and start writing it
+   *
+   * @param req handled request
+   * @param resp response filled by the router
+   */
+  void respond(const Http::Request &req, Http::Response &resp);
+
+  /**
+   * @brief give the answered request and its response back to the pool
+   *
+   */
+  void recycle() noexcept;
+
+  /**
+   * @brief open the file body of a response for sending, or read it into the
+   * body if the connection can't send files
+   *
+   * @param resp response to send
+   */
+  void attachFile(Http::Response &resp);
+
+  /**
+   * @brief close the file of the response being sent
+   *
+   */
+  void detachFile() noexcept;
+
+  /**
+   * @brief close the connection if the given phase takes longer than its
+   * timeout, replaces the deadline of the previous phase
+   *
+   * @param deadline phase the session waits in now
+   */
+  void expect(Deadline deadline);
+
+  /**
+   * @brief hand the connection to a websocket thread, it keeps the
+   * connection slot until it ends
+   *
+   * @param path request path
+   * @param e upgrade exception thrown by the handler
+   */
+  void upgrade(const std::string &path, WebException::UpgradeToWebsocket &e);
+
+  /**
+   * @brief wait for the given epoll events
+   *
+   * @param events epoll event mask
+   */
+  void want(std::uint32_t events);
+
+  /**
+   * @brief hand the connection back to the reactor to be closed
+   *
+   */
+  void close();
+
+  /** @brief server owning the router */
+  Server &server;
+
+  /** @brief reactor the session is registered in */
+  Reactor &loop;
+
+  /** @brief tls connection */
+  std::unique_ptr<Con> con;
+
+  /** @brief current state */
+  State state{State::Handshake};
+
+  /** @brief epoll events the session is currently waiting for */
+  std::uint32_t armed{0};
+
+  /** @brief HTTP/2 state (only after h2 got negotiated) */
+  std::unique_ptr<Http2Connection> h2;
+
+  /** @brief received request bytes */
+  std::string input;
+
+  /** @brief frames the requests of the input */
+  RequestReader reader;
+
+  /** @brief request being answered (null while reading or when shed) */
+  std::shared_ptr<Http::Request> request;
+
+  /** @brief response to `request`, both go back to the pool once written */
+  std::shared_ptr<Http::Response> response;
+
+  /** @brief phases of the current request */
+  RequestTiming timing;
+
+  /** @brief serialized responses, pipelined ones get written together */
+  std::string output;
+
+  /** @brief bytes of output already written */
+  std::size_t output_pos{0};
+
+  /** @brief large response body sent after the output, moved out of it */
+  std::string body;
+
+  /** @brief bytes of the body already written */
+  std::size_t body_pos{0};
+
+  /** @brief file body sent after the output (-1 = none) */
+  int file{-1};
+
+  /** @brief bytes of the file body already sent */
+  std::size_t file_pos{0};
+
+  /** @brief size of the file body */
+  std::size_t file_size{0};
+
+  /** @brief requests served on this connection */
+  std::size_t served{0};
+
+  /** @brief the router runs inline on the loop thread right now */
+  bool routing{false};
+
+  /** @brief keep the connection open after the current response */
+  bool keep_alive{false};
+
+  /** @brief the connection moved on to a websocket thread */
+  bool upgraded{false};
+
+  /** @brief phase the deadline timer runs for */
+  Deadline deadline{Deadline::None};
+
+  /** @brief pending deadline timer */
+  Reactor::TimerId deadline_timer{0};
+};
+} // namespace W
@@ -0,0 +1,333 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/executor.hpp>
+#include <webli/reactor.hpp>
+#include <webli/thread_pool.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace W {
+template <typename T = void> class Task;
+
+namespace Detail {
+/**
+ * @brief State shared by all task promises
+ *
+ */
+class TaskPromiseBase {
+public:
+  /**
+   * @brief Resumes whoever waits for the finished task
+   *
+   */
+  struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<>
+    await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      auto &promise = handle.promise();
+      if (promise.continuation) {
+        return promise.continuation;
+      }
+
+      // detached task, nobody owns the frame anymore
+      auto done = std::move(promise.done);
+      auto error = promise.error;
+      handle.destroy();
+
+      if (done) {
+        done(error);
+      }
+      return std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+  };
+
+  std::suspend_always initial_suspend() const noexcept { return {}; }
+
+  FinalAwaiter final_suspend() const noexcept { return {}; }
+
+  void unhandled_exception() noexcept { this->error = std::current_exception(); }
+
+  /** @brief coroutine awaiting this task */
+  std::coroutine_handle<> continuation;
+
+  /** @brief callback of a detached task */
+  std::function<void(std::exception_ptr)> done;
+
+  /** @brief exception that escaped the coroutine */
+  std::exception_ptr error;
+};
+
+template <typename T> class TaskPromise : public TaskPromiseBase {
+public:
+  Task<T> get_return_object() noexcept;
+
+  template <typename U> void return_value(U &&value) {
+    this->value.emplace(std::forward<U>(value));
+  }
+
+  T result() {
+    if (this->error) {
+      std::rethrow_exception(this->error);
+    }
+    return std::move(*this->value);
+  }
+
+  /** @brief returned value */
+  std::optional<T> value;
+};
+
+template <> class TaskPromise<void> : public TaskPromiseBase {
+public:
+  Task<void> get_return_object() noexcept;
+
+  void return_void() const noexcept {}
+
+  void result() {
+    if (this->error) {
+      std::rethrow_exception(this->error);
+    }
+  }
+};
+} // namespace Detail
+
+/**
+ * @brief Lazily started coroutine. A task runs when it gets awaited by
+ * another task, `detach`ed or `get`ed.
+ *
+ * @tparam T result type
+ */
+template <typename T> class Task {
+public:
+  using promise_type = Detail::TaskPromise<T>;
+
+  explicit Task(std::coroutine_handle<promise_type> handle) noexcept
+      : handle(handle) {}
+
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      if (this->handle) {
+        this->handle.destroy();
+      }
+      this->handle = std::exchange(other.handle, {});
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() {
+    if (this->handle) {
+      this->handle.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+
+  std::coroutine_handle<>
+  await_suspend(std::coroutine_handle<> caller) noexcept {
+    this->handle.promise().continuation = caller;
+    return this->handle;
+  }
+
+  T await_resume() { return this->handle.promise().result(); }
+
+  /**
+   * @brief start the task without waiting for it, the task owns itself
+   * until it finishes
+   *
+   * @param done called with the escaped exception (or null) when the task is
+   * done, possibly before `detach` returns
+   */
+  void detach(std::function<void(std::exception_ptr)> done)
+    requires std::is_void_v<T>
+  {
+    auto handle = std::exchange(this->handle, {});
+    handle.promise().done = std::move(done);
+    handle.resume();
+  }
+
+  /**
+   * @brief run the task on the current thread and block until it is done.
+   * Awaited operations run inline, so this is meant for threads without
+   * an executor.
+   *
+   * @throws whatever escaped the coroutine
+   */
+  void get()
+    requires std::is_void_v<T>
+  {
+    struct State {
+      std::mutex lock;
+      std::condition_variable cv;
+      bool done{false};
+      std::exception_ptr error;
+    };
+
+    auto state = std::make_shared<State>();
+    Executor::Scope scope{nullptr};
+
+    this->detach([state](std::exception_ptr error) {
+      std::lock_guard guard(state->lock);
+      state->done = true;
+      state->error = error;
+      state->cv.notify_all();
+    });
+
+    std::unique_lock guard(state->lock);
+    state->cv.wait(guard, [&state]() { return state->done; });
+
+    if (state->error) {
+      std::rethrow_exception(state->error);
+    }
+  }
+
+private:
+  /** @brief coroutine frame */
+  std::coroutine_handle<promise_type> handle;
+};
+
+namespace Detail {
+template <typename T> Task<T> TaskPromise<T>::get_return_object() noexcept {
+  return Task<T>{std::coroutine_handle<TaskPromise<T>>::from_promise(*this)};
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+  return Task<void>{
+      std::coroutine_handle<TaskPromise<void>>::from_promise(*this)};
+}
+
+/**
+ * @brief Awaiter running a blocking function on the blocking pool
+ *
+ * @tparam F function type
+ */
+template <typename F> class BlockingAwaiter {
+public:
+  using Result = std::invoke_result_t<F &>;
+
+  explicit BlockingAwaiter(F function) : function(std::move(function)) {}
+
+  bool await_ready() noexcept {
+    this->executor = Executor::current();
+    return this->executor == nullptr;
+  }
+
+  void await_suspend(std::coroutine_handle<> caller) {
+    ThreadPool::blocking().submit([this, caller]() {
+      try {
+        if constexpr (std::is_void_v<Result>) {
+          this->function();
+        } else {
+          this->value.emplace(this->function());
+        }
+      } catch (...) {
+        this->error = std::current_exception();
+      }
+
+      this->executor->execute([caller]() { caller.resume(); });
+    });
+  }
+
+  Result await_resume() {
+    // no executor, the function runs right here
+    if (this->executor == nullptr) {
+      return this->function();
+    }
+
+    if (this->error) {
+      std::rethrow_exception(this->error);
+    }
+
+    if constexpr (!std::is_void_v<Result>) {
+      return std::move(*this->value);
+    }
+  }
+
+private:
+  /** @brief blocking function */
+  F function;
+
+  /** @brief executor resuming the coroutine */
+  Executor *executor{nullptr};
+
+  /** @brief function result */
+  std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>>
+      value{};
+
+  /** @brief exception thrown by the function */
+  std::exception_ptr error;
+};
+
+/**
+ * @brief Awaiter resuming after a delay
+ *
+ */
+class SleepAwaiter {
+public:
+  explicit SleepAwaiter(std::chrono::milliseconds delay) : delay(delay) {}
+
+  bool await_ready() noexcept {
+    this->reactor = dynamic_cast<Reactor *>(Executor::current());
+    if (this->reactor == nullptr) {
+      std::this_thread::sleep_for(this->delay);
+      return true;
+    }
+    return false;
+  }
+
+  void await_suspend(std::coroutine_handle<> caller) {
+    this->reactor->after(this->delay, [caller]() { caller.resume(); });
+  }
+
+  void await_resume() const noexcept {}
+
+private:
+  /** @brief time to sleep */
+  std::chrono::milliseconds delay;
+
+  /** @brief reactor owning the timer */
+  Reactor *reactor{nullptr};
+};
+} // namespace Detail
+
+/**
+ * @brief await a blocking function (an `HttpsClient` request, a file read)
+ * without blocking the executor. The function runs on the blocking pool and
+ * the coroutine continues on its executor afterwards.
+ *
+ * @param function function to run
+ * @return awaitable yielding the function result
+ */
+template <typename F> auto blocking(F function) {
+  return Detail::BlockingAwaiter<F>(std::move(function));
+}
+
+/**
+ * @brief await a delay, reactors keep serving other requests meanwhile
+ *
+ * @param delay time to sleep
+ * @return awaitable
+ */
+inline auto sleep(std::chrono::milliseconds delay) {
+  return Detail::SleepAwaiter(delay);
+}
+} // namespace W
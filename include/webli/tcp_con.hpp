@@ -0,0 +1,97 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/con.hpp>
+
+#include <string>
+#include <sys/types.h>
+
+namespace W {
+/**
+ * @brief Plain TCP Client Connection, for servers behind a tls terminating
+ * proxy
+ *
+ */
+class TcpCon : public Con {
+public:
+  /**
+   * @brief Construct a new TcpCon object
+   *
+   * @param sd socket descriptor
+   * @param address internet address
+   * @param mode how the bytes are moved
+   */
+  TcpCon(int sd, struct in_addr address, ConMode mode = ConMode::Blocking);
+
+  /**
+   * @brief there is no handshake
+   *
+   * @return IoStatus - always Ok
+   */
+  IoStatus accept() override;
+
+  IoStatus readSome(std::uint8_t *buffer, int buffer_size,
+                    std::size_t &read) override;
+
+  IoStatus writeSome(const std::uint8_t *data, int data_size,
+                     std::size_t &written) override;
+
+  void feed(const std::uint8_t *data, std::size_t data_size) override;
+
+  void feedEnd() override;
+
+  std::size_t drain(std::uint8_t *buffer, std::size_t buffer_size) override;
+
+  std::size_t pending() const noexcept override;
+
+  /**
+   * @brief files go through sendfile, except in memory mode
+   *
+   * @return true
+   * @return false
+   */
+  bool canSendFile() const noexcept override;
+
+  IoStatus sendFileSome(int fd, std::size_t offset, std::size_t size,
+                        std::size_t &sent) override;
+
+protected:
+  std::size_t readAvailable(std::uint8_t *buffer,
+                            int buffer_size) const override;
+
+  void writeAll(const std::uint8_t *data, int data_size) const override;
+
+private:
+  /**
+   * @brief translate a failed socket call into an IoStatus
+   *
+   * @param ret return value of the socket call
+   * @param blocked status if the call would block
+   * @return IoStatus
+   */
+  static IoStatus status(ssize_t ret, IoStatus blocked) noexcept;
+
+  /**
+   * @brief send all buffered output to the socket, blocks (memory mode only)
+   *
+   * @return true on success
+   */
+  bool transmit() const;
+
+  /**
+   * @brief received bytes not read yet (memory mode only), the blocking
+   * `read` takes them first
+   */
+  mutable std::string input;
+
+  /**
+   * @brief bytes waiting to be drained (memory mode only), the blocking
+   * `write` sends them first
+   */
+  mutable std::string output;
+
+  /** @brief no more bytes get fed (memory mode only) */
+  bool eof{false};
+};
+} // namespace W
@@ -0,0 +1,143 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/executor.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace W {
+/**
+ * @brief Fixed size work-stealing thread pool.
+ *
+ * Every worker owns a task deque. Tasks submitted from a worker go to its own
+ * deque, tasks submitted from other threads are spread round robin. Workers
+ * take from the front of their own deque and idle workers steal from the back
+ * of the others.
+ *
+ */
+class ThreadPool : public Executor {
+public:
+  /**
+   * @brief Typedef for pool tasks
+   *
+   */
+  using Task = std::function<void()>;
+
+  /**
+   * @brief Typedef for the routine every worker runs before taking tasks
+   *
+   */
+  using Setup = std::function<void(std::size_t index)>;
+
+  /**
+   * @brief Construct a new Thread Pool and start the workers
+   *
+   * @param size number of workers (0 = one per core)
+   * @param setup called on every worker thread with its index before it
+   * takes the first task, e.g. to pin it
+   */
+  explicit ThreadPool(std::size_t size = 0, Setup setup = nullptr);
+
+  /**
+   * @brief Stop the workers after they finished their queued tasks
+   *
+   */
+  ~ThreadPool() override;
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /**
+   * @brief queue a task, can be called from any thread
+   *
+   * @param task task to run on a worker
+   */
+  void submit(Task task);
+
+  /**
+   * @brief same as `submit`
+   *
+   * @param job job to run on a worker
+   */
+  void execute(Job job) override;
+
+  /**
+   * @brief Get the pool blocking functions awaited by coroutine handlers
+   * run on, created on first use
+   *
+   * @return ThreadPool&
+   */
+  static ThreadPool &blocking();
+
+  /**
+   * @brief Get the number of workers
+   *
+   * @return std::size_t
+   */
+  std::size_t size() const noexcept;
+
+private:
+  /**
+   * @brief per worker task deque
+   *
+   */
+  struct Worker {
+    /** @brief lock protecting the deque */
+    std::mutex lock;
+
+    /** @brief queued tasks */
+    std::deque<Task> tasks;
+  };
+
+  /**
+   * @brief worker thread routine
+   *
+   * @param index worker index
+   * @param setup worker setup (or null)
+   */
+  void work(std::size_t index, const Setup &setup);
+
+  /**
+   * @brief take the next task from the own deque or steal one
+   *
+   * @param index worker index
+   * @param task output task
+   * @param wait wait for the locks of busy victims instead of skipping them
+   * @return true if a task was found
+   */
+  bool take(std::size_t index, Task &task, bool wait);
+
+  /** @brief worker deques */
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  /** @brief worker threads */
+  std::vector<std::jthread> threads;
+
+  /** @brief round robin counter for external submits */
+  std::atomic<std::size_t> next{0};
+
+  /** @brief number of queued tasks */
+  std::atomic<std::size_t> pending{0};
+
+  /** @brief tasks submitted so far, idle workers sleep until it changes */
+  std::atomic<std::size_t> submitted{0};
+
+  /** @brief running indicator */
+  std::atomic<bool> running{true};
+
+  /** @brief lock used by idle workers to sleep */
+  std::mutex sleep_lock;
+
+  /** @brief wakes idle workers on submit */
+  std::condition_variable wakeup;
+};
+} // namespace W
@@ -0,0 +1,208 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace W {
+/**
+ * @brief Hierarchical timing wheel.
+ *
+ * Timers are kept in `Levels` wheels of `Slots` slots each. A slot of the
+ * first wheel covers one tick, a slot of every further wheel covers a whole
+ * turn of the wheel below. Adding and cancelling a timer links it into or out
+ * of a slot, so both are O(1) however many timers are pending. When a wheel
+ * turns over, the next slot of the wheel above cascades its timers down.
+ *
+ * Timers live in a slab and are addressed by index and generation, so a
+ * stale handle never cancels a reused timer.
+ *
+ * Not thread safe, the owning reactor drives it from its thread.
+ *
+ */
+class TimerWheel {
+public:
+  /**
+   * @brief Typedef for the task run when a timer expires
+   *
+   */
+  using Task = std::function<void()>;
+
+  /**
+   * @brief Typedef for timer handles (0 is never a valid timer)
+   *
+   */
+  using TimerId = std::uint64_t;
+
+  /**
+   * @brief Construct a new Timer Wheel
+   *
+   * @param resolution length of a tick, deadlines get rounded up to it
+   */
+  explicit TimerWheel(
+      std::chrono::milliseconds resolution = std::chrono::milliseconds{1});
+
+  TimerWheel(const TimerWheel &) = delete;
+  TimerWheel &operator=(const TimerWheel &) = delete;
+
+  /**
+   * @brief add a timer
+   *
+   * @param deadline time the task runs at the earliest
+   * @param task task to run
+   * @return TimerId - handle to cancel the timer
+   */
+  TimerId add(std::chrono::steady_clock::time_point deadline, Task task);
+
+  /**
+   * @brief cancel a pending timer, expired or unknown timers are ignored
+   *
+   * @param id timer handle
+   */
+  void cancel(TimerId id) noexcept;
+
+  /**
+   * @brief run all timers expired until now. The tasks may add and cancel
+   * timers.
+   *
+   * @param now current time
+   */
+  void advance(std::chrono::steady_clock::time_point now);
+
+  /**
+   * @brief get the time until the wheel has to be advanced again. It is the
+   * next expiry or the next cascade, whatever comes first.
+   *
+   * @param now current time
+   * @return int - milliseconds (-1 without timers)
+   */
+  int timeout(std::chrono::steady_clock::time_point now) const noexcept;
+
+  /**
+   * @brief Get the number of pending timers
+   *
+   * @return std::size_t
+   */
+  std::size_t size() const noexcept;
+
+private:
+  /** @brief index bits of a slot */
+  static constexpr const unsigned SlotBits = 6;
+
+  /** @brief slots per wheel */
+  static constexpr const unsigned Slots = 1u << SlotBits;
+
+  /** @brief number of wheels, covers 2^24 ticks (4.6 hours at 1 ms) */
+  static constexpr const unsigned Levels = 4;
+
+  /** @brief list of timers being run (after the slots) */
+  static constexpr const unsigned Due = Levels * Slots;
+
+  /** @brief end of a list */
+  static constexpr const std::uint32_t Nil = UINT32_MAX;
+
+  /**
+   * @brief Timer slab entry
+   *
+   */
+  struct Node {
+    /** @brief task to run */
+    Task task;
+
+    /** @brief tick the timer expires at */
+    std::uint64_t expiry{0};
+
+    /** @brief previous timer in the list */
+    std::uint32_t prev{Nil};
+
+    /** @brief next timer in the list (or next free entry) */
+    std::uint32_t next{Nil};
+
+    /** @brief list the timer is linked into (Nil = free) */
+    std::uint32_t list{Nil};
+
+    /** @brief bumped on every reuse of the entry */
+    std::uint32_t generation{0};
+  };
+
+  /**
+   * @brief convert a time into the tick it falls into
+   *
+   * @param time time to convert
+   * @return std::uint64_t
+   */
+  std::uint64_t tickOf(std::chrono::steady_clock::time_point time) const;
+
+  /**
+   * @brief link a timer into the slot its expiry belongs to
+   *
+   * @param index slab index
+   */
+  void schedule(std::uint32_t index) noexcept;
+
+  /**
+   * @brief link a timer into the front of a list
+   *
+   * @param index slab index
+   * @param list list index
+   */
+  void link(std::uint32_t index, std::uint32_t list) noexcept;
+
+  /**
+   * @brief unlink a timer from its list
+   *
+   * @param index slab index
+   */
+  void unlink(std::uint32_t index) noexcept;
+
+  /**
+   * @brief put an unlinked timer back into the free list
+   *
+   * @param index slab index
+   */
+  void release(std::uint32_t index) noexcept;
+
+  /**
+   * @brief move all timers of a slot into another list
+   *
+   * @param slot slot index
+   * @param list target list (Due or Nil to reschedule them)
+   */
+  void take(std::uint32_t slot, std::uint32_t list) noexcept;
+
+  /**
+   * @brief get the next tick that expires timers or cascades a wheel
+   *
+   * @return std::uint64_t
+   */
+  std::uint64_t nextEvent() const noexcept;
+
+  /** @brief length of a tick */
+  std::chrono::steady_clock::duration resolution;
+
+  /** @brief time of tick 0 */
+  std::chrono::steady_clock::time_point origin;
+
+  /** @brief last processed tick */
+  std::uint64_t current{0};
+
+  /** @brief timer slab */
+  std::vector<Node> nodes;
+
+  /** @brief first free slab entry */
+  std::uint32_t free_list{Nil};
+
+  /** @brief first timer of every slot and of the due list */
+  std::array<std::uint32_t, Due + 1> heads;
+
+  /** @brief non-empty slots of every wheel */
+  std::array<std::uint64_t, Levels> occupied{};
+
+  /** @brief pending timers */
+  std::size_t pending{0};
+};
+} // namespace W
@@ -0,0 +1,143 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/con.hpp>
+
+#include <openssl/ssl.h>
+#include <string>
+
+namespace W {
+/**
+ * @brief TLS TCP Client Connection
+ *
+ */
+class TlsCon : public Con {
+public:
+  /**
+   * @brief Construct a new TlsCon object
+   *
+   * @param sd socket descriptor
+   * @param address internet address
+   * @param ctx tls context
+   * @param mode how tls records are moved
+   * @throws W::Exception when the blocking handshake fails
+   */
+  TlsCon(int sd, struct in_addr address, SSL_CTX *ctx,
+         ConMode mode = ConMode::Blocking);
+
+  /**
+   * @brief Shut the tls session down and free it
+   *
+   */
+  ~TlsCon() override;
+
+  IoStatus accept() override;
+
+  IoStatus readSome(std::uint8_t *buffer, int buffer_size,
+                    std::size_t &read) override;
+
+  IoStatus writeSome(const std::uint8_t *data, int data_size,
+                     std::size_t &written) override;
+
+  void feed(const std::uint8_t *data, std::size_t data_size) override;
+
+  void feedEnd() override;
+
+  std::size_t drain(std::uint8_t *buffer, std::size_t buffer_size) override;
+
+  std::size_t pending() const noexcept override;
+
+  /**
+   * @brief Get the protocol selected through ALPN
+   *
+   * @return std::string_view - `http/1.1` if the client offered none
+   */
+  std::string_view getProtocol() const noexcept override;
+
+  /**
+   * @brief files go through SSL_sendfile once kTLS took over the sending
+   * side of the socket
+   *
+   * @return true
+   * @return false without kTLS (or in memory mode)
+   */
+  bool canSendFile() const noexcept override;
+
+  IoStatus sendFileSome(int fd, std::size_t offset, std::size_t size,
+                        std::size_t &sent) override;
+
+  bool isResumed() const noexcept override;
+
+  bool isEarly() const noexcept override;
+
+protected:
+  std::size_t readAvailable(std::uint8_t *buffer,
+                            int buffer_size) const override;
+
+  void writeAll(const std::uint8_t *data, int data_size) const override;
+
+private:
+  /**
+   * @brief read application data, early data while the client sends it
+   *
+   * @param buffer pointer to buffer
+   * @param buffer_size size to read in bytes
+   * @return int - bytes read, <= 0 on failure like `SSL_read`
+   */
+  int receiveData(std::uint8_t *buffer, int buffer_size) const;
+
+  /**
+   * @brief write application data, as early data (0.5-RTT) before the
+   * handshake finished
+   *
+   * @param data pointer to data
+   * @param data_size size to write in bytes
+   * @return int - bytes written, <= 0 on failure like `SSL_write`
+   */
+  int sendData(const std::uint8_t *data, int data_size) const;
+
+  /**
+   * @brief translate the result of a tls call into an IoStatus
+   *
+   * @param ret return value of the tls call
+   * @return IoStatus
+   */
+  IoStatus status(int ret) const noexcept;
+
+  /**
+   * @brief receive tls records from the socket into the read buffer, blocks
+   * (memory mode only)
+   *
+   * @return true on success
+   */
+  bool receive() const;
+
+  /**
+   * @brief send all drained tls records to the socket, blocks (memory mode
+   * only)
+   *
+   * @param flags send flags
+   * @return true on success
+   */
+  bool transmit(int flags = 0) const;
+
+  /** @brief tls context  */
+  SSL *ssl;
+
+  /** @brief incoming records (memory mode only, owned by ssl) */
+  BIO *rbio{nullptr};
+
+  /** @brief outgoing records (memory mode only, owned by ssl) */
+  BIO *wbio{nullptr};
+
+  /** @brief the handshake may still bring early data */
+  bool early_pending{false};
+
+  /** @brief the client is still sending early data */
+  mutable bool early{false};
+
+  /** @brief early data read along with the handshake, not yet taken */
+  mutable std::string early_input;
+};
+} // namespace W
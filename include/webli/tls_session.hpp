@@ -0,0 +1,304 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <openssl/ssl.h>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace W {
+/**
+ * @brief TLS session resumption options
+ *
+ */
+using TlsSessionOptions = struct TlsSessionOptions {
+  /** @brief stateless resumption through session tickets */
+  bool tickets{true};
+
+  /**
+   * @brief how long a session can be resumed. Ticket keys rotate at the same
+   * pace and decrypt for one more period after.
+   */
+  std::chrono::seconds lifetime{std::chrono::hours(1)};
+
+  /**
+   * @brief secret the ticket keys derive from. Processes (and machines)
+   * sharing it resume each others tickets and rotate in step. Empty = random
+   * keys per process.
+   */
+  std::string ticket_secret{};
+
+  /**
+   * @brief sessions kept in the in-process cache for clients without
+   * tickets (0 = no cache)
+   */
+  std::size_t cache_size{0};
+
+  /** @brief shards of the cache, each with its own lock */
+  std::size_t cache_shards{16};
+
+  /**
+   * @brief bytes of tls 1.3 early data (0-RTT) a resumed connection may send
+   * (0 = off). Early requests reach idempotent routes only. Replays are
+   * refused per process, so early data stays off when tickets use the
+   * `ticket_secret` other processes may share.
+   */
+  std::uint32_t max_early_data{0};
+
+  /**
+   * @brief how long client hellos with early data are remembered to refuse
+   * replays. OpenSSL takes early data only from tickets whose age is off by
+   * 10s at most, so shorter windows let replays through.
+   */
+  std::chrono::seconds early_data_window{10};
+};
+
+/**
+ * @brief Rotating session ticket keys.
+ *
+ * A key encrypts new tickets for one period of the wall clock and decrypts
+ * them for one more. Periods are counted from the unix epoch, so servers
+ * deriving their keys from the same secret agree on them without talking to
+ * each other.
+ *
+ */
+class TicketKeys {
+public:
+  /**
+   * @brief Construct new Ticket Keys
+   *
+   * @param rotation period of a key
+   * @param secret secret to derive the keys from (empty = random keys)
+   */
+  TicketKeys(std::chrono::seconds rotation, std::string secret);
+
+  /**
+   * @brief let the context encrypt its tickets with these keys, they have
+   * to outlive it
+   *
+   * @param ctx server context
+   */
+  void install(SSL_CTX *ctx);
+
+  /**
+   * @brief set up the cipher and the mac of a ticket, the ticket key
+   * callback of OpenSSL
+   *
+   * @param name key name, written when encrypting
+   * @param iv initialization vector, written when encrypting
+   * @param cipher cipher context
+   * @param mac hmac context
+   * @param encrypt 1 for a new ticket, 0 for a received one
+   * @return int - 1 = ok, 2 = ok but renew the ticket, 0 = unknown key,
+   * -1 = error
+   */
+  int crypt(unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *cipher,
+            EVP_MAC_CTX *mac, int encrypt);
+
+private:
+  /**
+   * @brief Key of one period
+   *
+   */
+  struct Key {
+    /** @brief period the key encrypts in */
+    std::uint64_t period{0};
+
+    /** @brief key name, sent in the clear in every ticket */
+    std::array<unsigned char, 16> name{};
+
+    /** @brief aes-256 key */
+    std::array<unsigned char, 32> aes{};
+
+    /** @brief hmac-sha256 key */
+    std::array<unsigned char, 32> hmac{};
+  };
+
+  /**
+   * @brief move on to the current period (locked)
+   *
+   * @return true
+   * @return false if no key could be made
+   */
+  bool rotate();
+
+  /**
+   * @brief make the key of a period
+   *
+   * @param period period
+   * @param key key to fill
+   * @return true
+   * @return false if no key could be made
+   */
+  bool derive(std::uint64_t period, Key &key) const;
+
+  /** @brief period of a key */
+  std::chrono::seconds rotation;
+
+  /** @brief secret the keys derive from */
+  std::string secret;
+
+  /** @brief guards the keys */
+  std::mutex mutex;
+
+  /** @brief key of the current period */
+  Key current;
+
+  /** @brief key of the previous period, only decrypts */
+  Key previous;
+};
+
+/**
+ * @brief Anti-replay window for tls early data (RFC 8446 8.2). Early data is
+ * only taken from client hellos whose random was not seen in the window
+ * before. Randoms are kept in two generations that turn over every window.
+ * The guard sees the client hellos of its own process only, a ticket that
+ * another process can decrypt as well may be replayed there.
+ *
+ */
+class EarlyDataGuard {
+public:
+  /**
+   * @brief Construct a new Early Data Guard
+   *
+   * @param window time a client random is remembered at least
+   */
+  explicit EarlyDataGuard(std::chrono::seconds window);
+
+  /**
+   * @brief let the context take early data from fresh client hellos only,
+   * the guard has to outlive it
+   *
+   * @param ctx server context
+   */
+  void install(SSL_CTX *ctx);
+
+  /**
+   * @brief remember a client random
+   *
+   * @param random client random
+   * @return true
+   * @return false if it was seen before, a replay
+   */
+  bool fresh(std::string_view random);
+
+private:
+  /** @brief lifetime of a generation */
+  std::chrono::steady_clock::duration window;
+
+  /** @brief guards the generations */
+  std::mutex mutex;
+
+  /** @brief start of the current generation */
+  std::chrono::steady_clock::time_point started;
+
+  /** @brief randoms of the current generation */
+  std::unordered_set<std::string> current;
+
+  /** @brief randoms of the previous generation */
+  std::unordered_set<std::string> previous;
+};
+
+/**
+ * @brief Server side TLS session cache shared by all threads of the process.
+ * Sessions are spread over shards by their id, so concurrent handshakes
+ * rarely wait for each other. Every shard drops its oldest session when it
+ * is full.
+ *
+ */
+class SessionCache {
+public:
+  /**
+   * @brief Construct a new Session Cache
+   *
+   * @param capacity sessions at most
+   * @param shards number of shards
+   */
+  SessionCache(std::size_t capacity, std::size_t shards);
+
+  /**
+   * @brief replace the internal cache of the context, the cache has to
+   * outlive it
+   *
+   * @param ctx server context
+   */
+  void install(SSL_CTX *ctx);
+
+  /**
+   * @brief store a session
+   *
+   * @param id session id
+   * @param session serialized session
+   */
+  void add(std::string_view id, std::string session);
+
+  /**
+   * @brief look up a session
+   *
+   * @param id session id
+   * @return std::string - serialized session, empty if unknown
+   */
+  std::string find(std::string_view id);
+
+  /**
+   * @brief forget a session
+   *
+   * @param id session id
+   */
+  void remove(std::string_view id);
+
+private:
+  /**
+   * @brief Cached session
+   *
+   */
+  struct Entry {
+    /** @brief serialized session */
+    std::string session;
+
+    /** @brief position in the insertion order */
+    std::list<std::string>::iterator order;
+  };
+
+  /**
+   * @brief Part of the cache with its own lock
+   *
+   */
+  struct Shard {
+    /** @brief guards the shard */
+    std::mutex mutex;
+
+    /** @brief sessions by id */
+    std::unordered_map<std::string, Entry> entries;
+
+    /** @brief session ids, oldest first */
+    std::list<std::string> order;
+  };
+
+  /**
+   * @brief get the shard of a session
+   *
+   * @param id session id
+   * @return Shard&
+   */
+  Shard &shardOf(std::string_view id) noexcept;
+
+  /** @brief sessions per shard at most */
+  std::size_t capacity;
+
+  /** @brief number of shards */
+  std::size_t shard_count;
+
+  /** @brief shards */
+  std::unique_ptr<Shard[]> shards;
+};
+} // namespace W
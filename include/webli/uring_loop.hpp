@@ -0,0 +1,321 @@
+// Copyright 2024 Mina
+
+#pragma once
+
+#include <webli/reactor.hpp>
+
+#include <arpa/inet.h>
+#include <cstdint>
+#include <deque>
+#include <linux/io_uring.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace W {
+/**
+ * @brief Single threaded io_uring reactor. Accepts, receives and sends are
+ * queued in the submission ring and submitted together with the wait for
+ * completions, so a loop iteration costs one syscall however many
+ * connections are ready.
+ *
+ * Connections run in `ConMode::Memory`: received tls records are fed into
+ * the memory BIO from a pool of provided buffers, outgoing records are
+ * drained into registered buffers and sent from there.
+ *
+ */
+class UringLoop : public Reactor {
+public:
+  /**
+   * @brief Construct a new Uring Loop
+   *
+   * @param entries submission ring size
+   * @throws W::Exception when the ring can't be set up
+   */
+  explicit UringLoop(unsigned entries = 256);
+
+  /**
+   * @brief Destroy the Uring Loop and drop all registered connections
+   *
+   */
+  ~UringLoop() override;
+
+  /**
+   * @brief check if the kernel supports everything the loop needs
+   *
+   * @return true
+   * @return false
+   */
+  static bool supported() noexcept;
+
+  void accept(int sd, const AcceptCallback &callback) override;
+
+  void stopAccept(int sd) override;
+
+  void attach(Con &con, std::uint32_t events,
+              const Callback &callback) override;
+
+  void modify(Con &con, std::uint32_t events) override;
+
+  void detach(Con &con, Task done) override;
+
+  void close(std::unique_ptr<Con> con) override;
+
+  void flush(Con &con) override;
+
+  ConMode connectionMode() const noexcept override;
+
+  void run() override;
+
+private:
+  /**
+   * @brief Operation a completion belongs to, stored in the low byte of the
+   * user data
+   *
+   */
+  enum class Op : std::uint8_t {
+    Wake,
+    Accept,
+    Ready,
+    Recv,
+    Send,
+    Cancel,
+    Provide
+  };
+
+  /**
+   * @brief Listening socket and the address storage of its pending accept
+   *
+   */
+  using Listener = struct Listener {
+    /** @brief listening socket descriptor */
+    int sd;
+
+    /** @brief called with every accepted connection */
+    AcceptCallback callback;
+
+    /** @brief peer address written by the kernel */
+    struct sockaddr_in addr;
+
+    /** @brief peer address size written by the kernel */
+    socklen_t addr_len;
+
+    /** @brief `stopAccept` was called */
+    bool stopped;
+  };
+
+  /**
+   * @brief Registered connection
+   *
+   */
+  using Connection = struct Connection {
+    /** @brief connection */
+    Con *con;
+
+    /** @brief connection owned by the loop after `close` */
+    std::unique_ptr<Con> owned;
+
+    /** @brief ready callback, null once the connection left the loop */
+    std::shared_ptr<Callback> callback;
+
+    /** @brief hands a detached connection over once nothing is in flight */
+    Task handover;
+
+    /** @brief interest mask */
+    std::uint32_t events;
+
+    /** @brief a recv is in flight */
+    bool receiving;
+
+    /** @brief the peer hung up or a send failed */
+    bool eof;
+
+    /** @brief waiting for a free send buffer */
+    bool waiting;
+
+    /** @brief send buffer in flight (-1 if none) */
+    int slot;
+
+    /** @brief bytes of the send buffer already sent */
+    std::size_t sent;
+
+    /** @brief bytes in the send buffer */
+    std::size_t size;
+  };
+
+  /**
+   * @brief get the next free submission entry, submits the ring if it is
+   * full
+   *
+   * @return struct io_uring_sqe* - zeroed entry
+   */
+  struct io_uring_sqe *nextEntry();
+
+  /**
+   * @brief submit queued entries and wait for completions
+   *
+   * @param wait minimum number of completions to wait for
+   * @param timeout_ms wait timeout (-1 = infinite)
+   * @return int - io_uring_enter result
+   */
+  int enter(unsigned wait, int timeout_ms);
+
+  /**
+   * @brief handle one completion
+   *
+   * @param cqe completion entry
+   */
+  void complete(const struct io_uring_cqe &cqe);
+
+  /**
+   * @brief queue a poll for the wakeup descriptor
+   *
+   */
+  void armWake();
+
+  /**
+   * @brief queue an accept on a listener
+   *
+   * @param index listener index
+   */
+  void armAccept(std::size_t index);
+
+  /**
+   * @brief queue a poll for a listener that had no connection ready
+   *
+   * @param index listener index
+   */
+  void armReady(std::size_t index);
+
+  /**
+   * @brief queue a cancel for a pending operation
+   *
+   * @param id connection or listener id
+   * @param op pending operation
+   */
+  void cancelOp(std::uint64_t id, Op op);
+
+  /**
+   * @brief queue a recv into a provided buffer
+   *
+   * @param id connection id
+   * @param entry connection
+   */
+  void armRecv(std::uint64_t id, Connection &entry);
+
+  /**
+   * @brief hand receive buffers back to the kernel
+   *
+   * @param bid first buffer id
+   * @param count number of buffers
+   */
+  void provide(std::uint16_t bid, std::uint16_t count);
+
+  /**
+   * @brief queue the send buffer of a connection
+   *
+   * @param id connection id
+   * @param entry connection
+   */
+  void send(std::uint64_t id, Connection &entry);
+
+  /**
+   * @brief drain pending records into a send buffer and send them
+   *
+   * @param id connection id
+   * @param entry connection
+   */
+  void transmit(std::uint64_t id, Connection &entry);
+
+  /**
+   * @brief forget a connection that left the loop once no operation refers
+   * to it anymore
+   *
+   * @param id connection id
+   */
+  void reap(std::uint64_t id);
+
+  /**
+   * @brief find the id of a registered connection
+   *
+   * @param con registered connection
+   * @return std::uint64_t - id (0 if unknown)
+   */
+  std::uint64_t find(const Con &con) const noexcept;
+
+  /** @brief ring descriptor */
+  int ringfd;
+
+  /** @brief number of submission entries */
+  unsigned entries;
+
+  /** @brief mapped submission and completion rings */
+  void *rings;
+
+  /** @brief size of the ring mapping */
+  std::size_t rings_size;
+
+  /** @brief mapped submission entries */
+  struct io_uring_sqe *sqes;
+
+  /** @brief size of the submission entry mapping */
+  std::size_t sqes_size;
+
+  /** @brief submission ring head (written by the kernel) */
+  unsigned *sq_head;
+
+  /** @brief submission ring tail */
+  unsigned *sq_tail;
+
+  /** @brief submission ring index mask */
+  unsigned sq_mask;
+
+  /** @brief submission index array */
+  unsigned *sq_array;
+
+  /** @brief tail including entries not yet published */
+  unsigned sq_local_tail;
+
+  /** @brief completion ring head */
+  unsigned *cq_head;
+
+  /** @brief completion ring tail (written by the kernel) */
+  unsigned *cq_tail;
+
+  /** @brief completion ring index mask */
+  unsigned cq_mask;
+
+  /** @brief completion entries */
+  struct io_uring_cqe *cqes;
+
+  /** @brief memory of the provided receive buffers */
+  std::unique_ptr<std::uint8_t[]> recv_buffers;
+
+  /** @brief memory of the send buffers */
+  std::unique_ptr<std::uint8_t[]> send_buffers;
+
+  /** @brief send buffers are registered, send with WRITE_FIXED */
+  bool fixed_buffers{false};
+
+  /** @brief unused send buffers */
+  std::vector<int> free_slots;
+
+  /** @brief connections waiting for a free send buffer */
+  std::deque<std::uint64_t> send_waiters;
+
+  /** @brief connections whose recv found no free buffer */
+  std::vector<std::uint64_t> starved;
+
+  /** @brief listening sockets */
+  std::vector<std::unique_ptr<Listener>> listeners;
+
+  /** @brief connections by id */
+  std::unordered_map<std::uint64_t, Connection> connections;
+
+  /** @brief ids of the attached connections by descriptor */
+  std::unordered_map<int, std::uint64_t> ids;
+
+  /** @brief next connection id */
+  std::uint64_t next_id{1};
+};
+} // namespace W
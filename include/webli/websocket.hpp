@@ -281,6 +281,14 @@ public:
   void close();
 
 private:
+  /**
+   * @brief write a ws frame into the write buffer of the connection, it
+   * leaves with the next flush
+   *
+   * @param frame ws frame
+   */
+  void queueFrame(const WebsocketFrame &frame) const;
+
   /** @brief generic message handler */
   WebsocketHandler handler;
 
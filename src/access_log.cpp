@@ -0,0 +1,328 @@
+// Copyright 2024 Mina
+
+#include <webli/access_log.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+namespace W {
+/** @brief first bytes of a binary log */
+static constexpr std::string_view BinaryMagic{"WEBLILOG"};
+
+/** @brief diagnostic lines buffered per thread */
+static constexpr std::size_t NoteCapacity = 64;
+
+/** @brief source of the log ids */
+static std::atomic<std::uint64_t> g_next_log{1};
+
+AccessLog::Ring::Ring(std::size_t capacity)
+    : records(std::bit_ceil(std::max<std::size_t>(capacity, 2))),
+      notes(NoteCapacity) {}
+
+AccessLog::AccessLog(const AccessLogOptions &options, bool notes)
+    : options(options), id(g_next_log++) {
+  if (!this->options.enabled) {
+    if (notes) {
+      this->writer =
+          std::jthread([this](std::stop_token stop) { this->write(stop); });
+    }
+    return;
+  }
+
+  if (!this->options.path.empty()) {
+    this->fd = open(this->options.path.c_str(),
+                    O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (this->fd == -1) {
+      perror("[Webli] AccessLog");
+      this->fd = 2;
+    }
+  }
+
+  // appending to an existing binary log keeps its header
+  if (this->options.format == AccessLogFormat::Binary &&
+      lseek(this->fd, 0, SEEK_END) <= 0) {
+    std::uint32_t record_size = sizeof(AccessRecord);
+
+    std::string header{BinaryMagic};
+    header.append(reinterpret_cast<const char *>(&record_size),
+                  sizeof(record_size));
+    this->output(this->fd, header);
+  }
+
+  this->writer =
+      std::jthread([this](std::stop_token stop) { this->write(stop); });
+}
+
+AccessLog::~AccessLog() {
+  if (this->writer.joinable()) {
+    this->writer.request_stop();
+    this->writer.join();
+  }
+
+  if (this->fd != 2) {
+    close(this->fd);
+  }
+}
+
+void AccessLog::record(struct in_addr address, std::string_view method,
+                       std::string_view path, int status, std::size_t bytes,
+                       bool websocket) noexcept {
+  if (!this->options.enabled) {
+    return;
+  }
+
+  auto &ring = this->local();
+  if (status < 500 && this->options.sample > 1 &&
+      ring.seen++ % this->options.sample != 0) {
+    return;
+  }
+
+  auto tail = ring.tail.load(std::memory_order_relaxed);
+  if (tail - ring.head.load(std::memory_order_acquire) ==
+      ring.records.size()) {
+    this->dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  auto &entry = ring.records[tail & (ring.records.size() - 1)];
+  entry.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch())
+                   .count();
+  entry.address = address.s_addr;
+  entry.bytes = static_cast<std::uint32_t>(
+      std::min<std::size_t>(bytes, UINT32_MAX));
+  entry.status = static_cast<std::uint16_t>(status);
+  entry.websocket = websocket ? 1 : 0;
+
+  std::memset(entry.method, 0, sizeof(entry.method));
+  std::memcpy(entry.method, method.data(),
+              std::min(method.size(), sizeof(entry.method)));
+
+  // records get written whole, so the bytes of an earlier longer path must
+  // not stay behind
+  entry.path_size =
+      static_cast<std::uint8_t>(std::min(path.size(), sizeof(entry.path)));
+  std::memcpy(entry.path, path.data(), entry.path_size);
+  std::memset(entry.path + entry.path_size, 0,
+              sizeof(entry.path) - entry.path_size);
+
+  ring.tail.store(tail + 1, std::memory_order_release);
+}
+
+void AccessLog::note(std::string line) noexcept {
+  if (!this->writer.joinable()) {
+    return;
+  }
+
+  auto &ring = this->local();
+  auto tail = ring.notes_tail.load(std::memory_order_relaxed);
+  if (tail - ring.notes_head.load(std::memory_order_acquire) ==
+      ring.notes.size()) {
+    this->dropped_notes.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  ring.notes[tail & (ring.notes.size() - 1)] = std::move(line);
+  ring.notes_tail.store(tail + 1, std::memory_order_release);
+}
+
+std::uint64_t AccessLog::getDropped() const noexcept {
+  return this->dropped.load(std::memory_order_relaxed);
+}
+
+std::string AccessLog::format(const AccessRecord &record,
+                              AccessLogFormat format) {
+  std::string_view method{record.method,
+                          strnlen(record.method, sizeof(record.method))};
+  std::string_view path{record.path, record.path_size};
+  auto status = std::to_string(record.status);
+
+  if (format != AccessLogFormat::Common) {
+    std::string line{record.websocket ? std::string_view{"WSS"} : method};
+    line.append("\t").append(status).append(" | ").append(path).append("\n");
+    return line;
+  }
+
+  std::array<char, INET_ADDRSTRLEN> address{};
+  struct in_addr in{};
+  in.s_addr = record.address;
+  inet_ntop(AF_INET, &in, address.data(), address.size());
+
+  std::array<char, 32> time{};
+  std::time_t seconds = record.time / 1000000000;
+  struct tm utc{};
+  gmtime_r(&seconds, &utc);
+  std::strftime(time.data(), time.size(), "%d/%b/%Y:%H:%M:%S +0000", &utc);
+
+  // the record keeps no protocol, so the request line ends after the path
+  std::string line{address.data()};
+  line.append(" - - [")
+      .append(time.data())
+      .append("] \"")
+      .append(method)
+      .append(" ")
+      .append(path)
+      .append("\" ")
+      .append(status)
+      .append(" ")
+      .append(record.bytes != 0 ? std::to_string(record.bytes) : "-")
+      .append("\n");
+  return line;
+}
+
+bool AccessLog::decode(std::istream &in, std::ostream &out,
+                       AccessLogFormat format) {
+  std::array<char, BinaryMagic.size()> magic{};
+  std::uint32_t record_size{0};
+
+  in.read(magic.data(), magic.size());
+  in.read(reinterpret_cast<char *>(&record_size), sizeof(record_size));
+  if (!in || std::string_view(magic.data(), magic.size()) != BinaryMagic ||
+      record_size != sizeof(AccessRecord)) {
+    return false;
+  }
+
+  AccessRecord record{};
+  while (in.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+    out << AccessLog::format(record, format);
+  }
+
+  // a partial record means the log got cut off
+  return in.gcount() == 0;
+}
+
+AccessLog::Ring &AccessLog::local() {
+  // rings of every log the thread wrote to, closed when the thread exits
+  struct Local {
+    std::vector<std::pair<std::uint64_t, std::shared_ptr<Ring>>> rings;
+
+    ~Local() {
+      for (auto &entry : this->rings) {
+        entry.second->closed = true;
+      }
+    }
+  };
+  thread_local Local local;
+
+  for (auto &[id, ring] : local.rings) {
+    if (id == this->id) {
+      return *ring;
+    }
+  }
+
+  auto ring = std::make_shared<Ring>(this->options.buffer_records);
+  {
+    std::lock_guard guard(this->rings_lock);
+    this->rings.push_back(ring);
+  }
+
+  local.rings.emplace_back(this->id, ring);
+  return *ring;
+}
+
+void AccessLog::write(std::stop_token stop) {
+  while (!stop.stop_requested()) {
+    if (!this->drain()) {
+      std::this_thread::sleep_for(this->options.flush_interval);
+    }
+  }
+
+  while (this->drain()) {
+  }
+}
+
+bool AccessLog::drain() {
+  std::vector<std::shared_ptr<Ring>> rings;
+  {
+    std::lock_guard guard(this->rings_lock);
+
+    // rings of exited threads go once the writer emptied them
+    std::erase_if(this->rings, [](const auto &ring) {
+      return ring->closed &&
+             ring->head.load(std::memory_order_relaxed) ==
+                 ring->tail.load(std::memory_order_acquire) &&
+             ring->notes_head.load(std::memory_order_relaxed) ==
+                 ring->notes_tail.load(std::memory_order_acquire);
+    });
+    rings = this->rings;
+  }
+
+  std::string buffer;
+  std::string notes;
+  for (auto &ring : rings) {
+    auto head = ring->head.load(std::memory_order_relaxed);
+    auto tail = ring->tail.load(std::memory_order_acquire);
+
+    for (; head != tail; head++) {
+      const auto &entry = ring->records[head & (ring->records.size() - 1)];
+
+      if (this->options.format == AccessLogFormat::Binary) {
+        buffer.append(reinterpret_cast<const char *>(&entry), sizeof(entry));
+      } else {
+        buffer.append(AccessLog::format(entry, this->options.format));
+      }
+    }
+
+    ring->head.store(head, std::memory_order_release);
+
+    auto notes_head = ring->notes_head.load(std::memory_order_relaxed);
+    auto notes_tail = ring->notes_tail.load(std::memory_order_acquire);
+
+    for (; notes_head != notes_tail; notes_head++) {
+      auto &line = ring->notes[notes_head & (ring->notes.size() - 1)];
+      notes.append(line);
+      line.clear();
+    }
+
+    ring->notes_head.store(notes_head, std::memory_order_release);
+  }
+
+  if (auto dropped = this->getDropped(); dropped != this->reported) {
+    std::cerr << "[Webli] access log dropped " << dropped - this->reported
+              << " records\n";
+    this->reported = dropped;
+  }
+
+  if (auto dropped = this->dropped_notes.load(std::memory_order_relaxed);
+      dropped != this->reported_notes) {
+    notes.append("[Webli] dropped ")
+        .append(std::to_string(dropped - this->reported_notes))
+        .append(" log lines\n");
+    this->reported_notes = dropped;
+  }
+
+  if (!notes.empty()) {
+    this->output(2, notes);
+  }
+
+  if (buffer.empty()) {
+    return !notes.empty();
+  }
+
+  this->output(this->fd, buffer);
+  return true;
+}
+
+void AccessLog::output(int fd, std::string_view data) noexcept {
+  while (!data.empty()) {
+    auto ret = ::write(fd, data.data(), data.size());
+    if (ret == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (ret <= 0) {
+      return;
+    }
+
+    data.remove_prefix(static_cast<std::size_t>(ret));
+  }
+}
+} // namespace W
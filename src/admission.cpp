@@ -0,0 +1,63 @@
+// Copyright 2024 Mina
+
+#include <webli/admission.hpp>
+
+namespace W {
+Admission::Admission(std::size_t max_in_flight,
+                     std::chrono::milliseconds target,
+                     std::chrono::milliseconds interval)
+    : max_in_flight(max_in_flight), target(target), interval(interval) {}
+
+bool Admission::admit(std::chrono::steady_clock::duration sojourn) {
+  if (this->target.count() != 0 && this->congested(sojourn)) {
+    this->shed++;
+    return false;
+  }
+
+  if (this->in_flight++ >= this->max_in_flight && this->max_in_flight != 0) {
+    this->in_flight--;
+    this->shed++;
+    return false;
+  }
+
+  return true;
+}
+
+void Admission::release() noexcept { this->in_flight--; }
+
+std::size_t Admission::getInFlight() const noexcept {
+  return this->in_flight.load(std::memory_order_relaxed);
+}
+
+std::uint64_t Admission::getShed() const noexcept {
+  return this->shed.load(std::memory_order_relaxed);
+}
+
+bool Admission::congested(std::chrono::steady_clock::duration sojourn) {
+  // a request in time means the queue drained, it was only a burst. Most
+  // requests end here, they only read the shared state.
+  if (sojourn <= this->target) {
+    if (this->above_until.load(std::memory_order_relaxed) != 0) {
+      this->above_until.store(0, std::memory_order_relaxed);
+    }
+    if (this->overloaded.load(std::memory_order_relaxed)) {
+      this->overloaded.store(false, std::memory_order_relaxed);
+    }
+    return false;
+  }
+
+  auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+  auto until = this->above_until.load(std::memory_order_relaxed);
+
+  // the first late request starts the interval, concurrent ones agree on it
+  if (until == 0) {
+    this->above_until.compare_exchange_strong(
+        until, now + this->interval.count(), std::memory_order_relaxed);
+  } else if (now >= until &&
+             !this->overloaded.load(std::memory_order_relaxed)) {
+    this->overloaded.store(true, std::memory_order_relaxed);
+  }
+
+  return this->overloaded.load(std::memory_order_relaxed);
+}
+} // namespace W
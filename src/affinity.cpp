@@ -0,0 +1,156 @@
+// Copyright 2024 Mina
+
+#include <webli/affinity.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+
+namespace W {
+const Topology &Topology::system() {
+  static const Topology topology{};
+  return topology;
+}
+
+Topology::Topology() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return;
+  }
+
+  auto keep = [&allowed](std::vector<int> cores) {
+    std::erase_if(cores, [&allowed](int core) {
+      return core < 0 || core >= CPU_SETSIZE || !CPU_ISSET(core, &allowed);
+    });
+    return cores;
+  };
+
+  std::error_code error;
+  for (const auto &entry : std::filesystem::directory_iterator(
+           "/sys/devices/system/node", error)) {
+    auto name = entry.path().filename().string();
+    if (!name.starts_with("node") || name.size() == 4 ||
+        !std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+      continue;
+    }
+
+    std::ifstream file(entry.path() / "cpulist");
+    std::string list;
+    std::getline(file, list);
+
+    auto node = static_cast<std::size_t>(std::stoul(name.substr(4)));
+    if (this->nodes.size() <= node) {
+      this->nodes.resize(node + 1);
+    }
+    this->nodes[node] = keep(Topology::parseList(list));
+  }
+
+  std::erase_if(this->nodes, [](const auto &cores) { return cores.empty(); });
+
+  // without sysfs every allowed core counts as one node
+  if (this->nodes.empty()) {
+    std::vector<int> cores;
+    for (int core = 0; core < CPU_SETSIZE; core++) {
+      if (CPU_ISSET(core, &allowed)) {
+        cores.push_back(core);
+      }
+    }
+    this->nodes.push_back(std::move(cores));
+  }
+}
+
+const std::vector<std::vector<int>> &Topology::getNodes() const noexcept {
+  return this->nodes;
+}
+
+std::vector<int> Topology::select(Placement placement, std::size_t index,
+                                  const std::vector<int> &cores) const {
+  if (placement == Placement::None) {
+    return {};
+  }
+
+  std::vector<std::vector<int>> nodes;
+  for (const auto &node : this->nodes) {
+    std::vector<int> usable;
+    std::copy_if(node.begin(), node.end(), std::back_inserter(usable),
+                 [&cores](int core) {
+                   return cores.empty() ||
+                          std::find(cores.begin(), cores.end(), core) !=
+                              cores.end();
+                 });
+
+    if (!usable.empty()) {
+      nodes.push_back(std::move(usable));
+    }
+  }
+
+  if (nodes.empty()) {
+    return {};
+  }
+
+  if (placement == Placement::Node) {
+    return nodes[index % nodes.size()];
+  }
+
+  // the given order decides, otherwise neighbouring threads share a node
+  std::vector<int> order = cores;
+  if (order.empty()) {
+    for (const auto &node : nodes) {
+      order.insert(order.end(), node.begin(), node.end());
+    }
+  }
+
+  return {order[index % order.size()]};
+}
+
+bool Topology::pin(const std::vector<int> &cores) noexcept {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  for (int core : cores) {
+    if (core >= 0 && core < CPU_SETSIZE) {
+      CPU_SET(core, &set);
+    }
+  }
+
+  return CPU_COUNT(&set) != 0 &&
+         pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+std::vector<int> Topology::parseList(std::string_view list) {
+  std::vector<int> cores;
+
+  while (!list.empty()) {
+    auto comma = list.find(',');
+    auto range = list.substr(0, comma);
+    list = (comma == std::string_view::npos) ? std::string_view{}
+                                             : list.substr(comma + 1);
+
+    int first{0};
+    int last{0};
+    auto [end, error] =
+        std::from_chars(range.data(), range.data() + range.size(), first);
+    if (error != std::errc{}) {
+      continue;
+    }
+
+    last = first;
+    if (end != range.data() + range.size() && *end == '-') {
+      std::from_chars(end + 1, range.data() + range.size(), last);
+    }
+
+    for (int core = first; core <= last; core++) {
+      cores.push_back(core);
+    }
+  }
+
+  return cores;
+}
+} // namespace W
@@ -0,0 +1,253 @@
+// Copyright 2024 Mina
+
+#include <webli/buffer_pool.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace W {
+/** @brief things of every kind a thread keeps at most */
+static std::atomic<std::size_t> pool_size{64};
+
+/** @brief capacity of a kept buffer or body at most */
+static std::atomic<std::size_t> max_buffer_size{1 << 16};
+
+/**
+ * @brief Pools of one thread
+ *
+ */
+struct ThreadPools {
+  ThreadPools();
+  ~ThreadPools();
+
+  /** @brief free buffers */
+  std::vector<std::string> buffers;
+
+  /** @brief free requests */
+  std::vector<std::shared_ptr<Http::Request>> requests;
+
+  /** @brief free responses */
+  std::vector<std::shared_ptr<Http::Response>> responses;
+
+  /** @brief takes served from the pools, written by the owner only */
+  std::array<std::atomic<std::uint64_t>, PoolKindCount> hits{};
+
+  /** @brief takes that had to allocate, written by the owner only */
+  std::array<std::atomic<std::uint64_t>, PoolKindCount> misses{};
+};
+
+/**
+ * @brief Pools of all threads, for the counters
+ *
+ */
+struct PoolRegistry {
+  /** @brief guards the registry */
+  std::mutex mutex;
+
+  /** @brief pools of the running threads */
+  std::vector<ThreadPools *> threads;
+
+  /** @brief counters of the threads that ended */
+  BufferPool::Stats retired;
+};
+
+/**
+ * @brief get the registry, it lives as long as the last thread
+ *
+ * @return PoolRegistry&
+ */
+static PoolRegistry &registry() {
+  static auto *pools = new PoolRegistry();
+  return *pools;
+}
+
+/** @brief the pools of this thread are gone, it is about to end */
+static thread_local bool pools_destroyed{false};
+
+ThreadPools::ThreadPools() {
+  std::lock_guard lock{registry().mutex};
+  registry().threads.push_back(this);
+}
+
+ThreadPools::~ThreadPools() {
+  pools_destroyed = true;
+
+  std::lock_guard lock{registry().mutex};
+  auto &threads = registry().threads;
+  threads.erase(std::find(threads.begin(), threads.end(), this));
+
+  for (std::size_t kind = 0; kind < PoolKindCount; kind++) {
+    registry().retired.hits[kind] +=
+        this->hits[kind].load(std::memory_order_relaxed);
+    registry().retired.misses[kind] +=
+        this->misses[kind].load(std::memory_order_relaxed);
+  }
+}
+
+/**
+ * @brief get the pools of the calling thread
+ *
+ * @return ThreadPools* - null while the thread ends
+ */
+static ThreadPools *local() {
+  if (pools_destroyed) {
+    return nullptr;
+  }
+
+  thread_local ThreadPools pools;
+  return &pools;
+}
+
+/**
+ * @brief count a take
+ *
+ * @param pools pools of the thread
+ * @param kind kind taken
+ * @param hit served from the pool
+ */
+static void count(ThreadPools &pools, PoolKind kind, bool hit) noexcept {
+  auto &counter = hit ? pools.hits[static_cast<std::size_t>(kind)]
+                      : pools.misses[static_cast<std::size_t>(kind)];
+  counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+}
+
+/**
+ * @brief take an object from a pool of the calling thread
+ *
+ * @tparam T request or response
+ * @param list pool to take from
+ * @param kind kind taken
+ * @return std::shared_ptr<T>
+ */
+template <typename T>
+static std::shared_ptr<T>
+takeObject(std::vector<std::shared_ptr<T>> ThreadPools::*list, PoolKind kind) {
+  auto *pools = local();
+  if (pools != nullptr) {
+    count(*pools, kind, !(pools->*list).empty());
+  }
+
+  if (pools == nullptr || (pools->*list).empty()) {
+    auto object = std::make_shared<T>();
+    object->reset();
+    return object;
+  }
+
+  auto &free = pools->*list;
+  auto object = std::move(free.back());
+  free.pop_back();
+  return object;
+}
+
+/**
+ * @brief give an object back to a pool of the calling thread
+ *
+ * @tparam T request or response
+ * @param list pool to give to
+ * @param object object
+ */
+template <typename T>
+static void giveObject(std::vector<std::shared_ptr<T>> ThreadPools::*list,
+                       std::shared_ptr<T> &&object) noexcept {
+  auto held = std::move(object);
+
+  // another owner may still read it, a grown body would stay allocated
+  if (!held || held.use_count() != 1 ||
+      held->getBody().capacity() >
+          max_buffer_size.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  auto *pools = local();
+  if (pools == nullptr ||
+      (pools->*list).size() >= pool_size.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  held->reset();
+  try {
+    (pools->*list).push_back(std::move(held));
+  } catch (const std::bad_alloc &) {
+  }
+}
+
+void BufferPool::configure(std::size_t size, std::size_t max_buffer) noexcept {
+  pool_size.store(size, std::memory_order_relaxed);
+  max_buffer_size.store(max_buffer, std::memory_order_relaxed);
+}
+
+std::string BufferPool::takeBuffer() {
+  auto *pools = local();
+  if (pools == nullptr) {
+    return {};
+  }
+
+  count(*pools, PoolKind::Buffer, !pools->buffers.empty());
+  if (pools->buffers.empty()) {
+    return {};
+  }
+
+  auto buffer = std::move(pools->buffers.back());
+  pools->buffers.pop_back();
+  return buffer;
+}
+
+void BufferPool::giveBuffer(std::string &&buffer) noexcept {
+  auto held = std::move(buffer);
+
+  // buffers that never allocated are not worth keeping
+  if (held.capacity() <= std::string().capacity() ||
+      held.capacity() > max_buffer_size.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  auto *pools = local();
+  if (pools == nullptr ||
+      pools->buffers.size() >= pool_size.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  held.clear();
+  try {
+    pools->buffers.push_back(std::move(held));
+  } catch (const std::bad_alloc &) {
+  }
+}
+
+std::shared_ptr<Http::Request> BufferPool::takeRequest() {
+  return takeObject(&ThreadPools::requests, PoolKind::Request);
+}
+
+void BufferPool::giveRequest(
+    std::shared_ptr<Http::Request> &&request) noexcept {
+  giveObject(&ThreadPools::requests, std::move(request));
+}
+
+std::shared_ptr<Http::Response> BufferPool::takeResponse() {
+  return takeObject(&ThreadPools::responses, PoolKind::Response);
+}
+
+void BufferPool::giveResponse(
+    std::shared_ptr<Http::Response> &&response) noexcept {
+  giveObject(&ThreadPools::responses, std::move(response));
+}
+
+BufferPool::Stats BufferPool::stats() {
+  std::lock_guard lock{registry().mutex};
+  auto stats = registry().retired;
+
+  for (const auto *pools : registry().threads) {
+    for (std::size_t kind = 0; kind < PoolKindCount; kind++) {
+      stats.hits[kind] += pools->hits[kind].load(std::memory_order_relaxed);
+      stats.misses[kind] +=
+          pools->misses[kind].load(std::memory_order_relaxed);
+    }
+  }
+
+  return stats;
+}
+} // namespace W
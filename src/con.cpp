@@ -1,57 +1,101 @@
 // Copyright 2024 Mina
 
 #include <webli/con.hpp>
-#include <webli/exceptions.hpp>
 
-#include <openssl/err.h>
+#include <algorithm>
+#include <cstring>
 #include <unistd.h>
 
 namespace W {
-Con::Con(int sd, struct in_addr address, SSL_CTX *ctx)
-    : sd(sd), address(address), ssl(SSL_new(ctx)) {
+Con::Con(int sd, struct in_addr address, ConMode mode) noexcept
+    : sd(sd), address(address), mode(mode) {}
 
-  SSL_set_fd(this->ssl, this->sd);
+Con::~Con() { ::close(this->sd); }
 
-  if (SSL_accept(this->ssl) != 1) {
-    ERR_print_errors_fp(stderr);
-    this->close();
-    throw Exception("TLS Handshake failed");
+std::size_t Con::write(const std::uint8_t *data, int data_size) const {
+  auto size = static_cast<std::size_t>(data_size);
+
+  if (this->write_buffer.size() + size <= BufferSize) {
+    this->write_buffer.insert(this->write_buffer.end(), data, data + size);
+    return size;
+  }
+
+  // top the buffer up to a whole record, so a frame header leaves together
+  // with the start of its payload
+  if (!this->write_buffer.empty()) {
+    auto part = BufferSize - this->write_buffer.size();
+    this->write_buffer.insert(this->write_buffer.end(), data, data + part);
+    this->flush();
+    data += part;
+    size -= part;
+  }
+
+  if (size >= BufferSize) {
+    this->writeAll(data, static_cast<int>(size));
+  } else {
+    this->write_buffer.assign(data, data + size);
   }
-}
 
-Con::~Con() {
-  SSL_shutdown(this->ssl);
-  this->close();
+  return static_cast<std::size_t>(data_size);
 }
 
-std::size_t Con::write(const std::uint8_t *data, int data_size) const {
-  int ret;
+void Con::flush() const {
+  if (this->write_buffer.empty()) {
+    return;
+  }
 
-  ret = SSL_write(this->ssl, data, data_size);
-  if (ret <= 0) {
-    ERR_print_errors_fp(stderr);
-    throw Exception("Write to client failed");
+  try {
+    this->writeAll(this->write_buffer.data(),
+                   static_cast<int>(this->write_buffer.size()));
+  } catch (...) {
+    // a failed connection is not retried
+    this->write_buffer.clear();
+    throw;
   }
 
-  return ret;
+  this->write_buffer.clear();
 }
 
 std::size_t Con::read(std::uint8_t *buffer, int buffer_size) const {
-  int ret;
+  auto size = static_cast<std::size_t>(buffer_size);
+
+  for (std::size_t got = 0; got < size;) {
+    if (this->read_pos == this->read_end) {
+      // large reads skip the copy through the buffer
+      if (size - got >= BufferSize) {
+        got += this->readAvailable(buffer + got,
+                                   static_cast<int>(size - got));
+        continue;
+      }
 
-  ret = SSL_read(this->ssl, buffer, buffer_size);
-  if (ret <= 0) {
-    ERR_print_errors_fp(stderr);
-    throw Exception("Read from client failed");
+      this->read_buffer.resize(BufferSize);
+      this->read_pos = 0;
+      this->read_end = this->readAvailable(this->read_buffer.data(),
+                                           static_cast<int>(BufferSize));
+    }
+
+    auto part = std::min(this->read_end - this->read_pos, size - got);
+    std::memcpy(buffer + got, this->read_buffer.data() + this->read_pos, part);
+    this->read_pos += part;
+    got += part;
   }
 
-  return ret;
+  return size;
 }
 
-struct in_addr Con::getAddress() { return this->address; }
+std::string_view Con::getProtocol() const noexcept { return "http/1.1"; }
+
+bool Con::canSendFile() const noexcept { return false; }
 
-void Con::close() noexcept {
-  SSL_free(this->ssl);
-  ::close(this->sd);
+bool Con::isResumed() const noexcept { return false; }
+
+bool Con::isEarly() const noexcept { return false; }
+
+IoStatus Con::sendFileSome(int, std::size_t, std::size_t, std::size_t &) {
+  return IoStatus::Error;
 }
+
+struct in_addr Con::getAddress() const noexcept { return this->address; }
+
+int Con::getDescriptor() const noexcept { return this->sd; }
 } // namespace W
@@ -0,0 +1,163 @@
+// Copyright 2024 Mina
+
+#include <webli/event_loop.hpp>
+#include <webli/exceptions.hpp>
+
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace W {
+/** @brief maximum events processed per epoll_wait call */
+static constexpr const int MaxEvents = 256;
+
+EventLoop::EventLoop() : epfd(epoll_create1(EPOLL_CLOEXEC)) {
+  if (this->epfd == -1) {
+    perror("[Webli] EventLoop");
+    throw Exception("EventLoop setup failed");
+  }
+
+  struct epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = this->wakefd;
+  epoll_ctl(this->epfd, EPOLL_CTL_ADD, this->wakefd, &ev);
+}
+
+EventLoop::~EventLoop() {
+  // callbacks may own connections that want to unregister on destruction
+  auto callbacks = std::move(this->callbacks);
+  callbacks.clear();
+
+  ::close(this->epfd);
+}
+
+void EventLoop::add(int fd, std::uint32_t events, const Callback &callback) {
+  struct epoll_event ev{};
+  ev.events = events;
+  ev.data.fd = fd;
+
+  if (epoll_ctl(this->epfd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+    perror("[Webli] EventLoop::add");
+    throw Exception("epoll_ctl add failed");
+  }
+
+  this->callbacks[fd] = std::make_shared<Callback>(callback);
+}
+
+void EventLoop::modify(int fd, std::uint32_t events) {
+  struct epoll_event ev{};
+  ev.events = events;
+  ev.data.fd = fd;
+
+  if (epoll_ctl(this->epfd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+    perror("[Webli] EventLoop::modify");
+  }
+}
+
+void EventLoop::remove(int fd) {
+  epoll_ctl(this->epfd, EPOLL_CTL_DEL, fd, nullptr);
+  this->callbacks.erase(fd);
+}
+
+void EventLoop::accept(int sd, const AcceptCallback &callback) {
+  fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+  this->add(sd, EPOLLIN, [sd, callback](std::uint32_t) {
+    struct sockaddr_in addr;
+    socklen_t addr_len;
+
+    while (true) {
+      addr_len = sizeof(addr);
+      int client_sd =
+          ::accept4(sd, reinterpret_cast<struct sockaddr *>(&addr), &addr_len,
+                    SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+      if (client_sd == -1) {
+        if (errno == EINTR) {
+          continue;
+        }
+
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+          perror("[Webli] Accept");
+        }
+        return;
+      }
+
+      callback(client_sd, addr.sin_addr);
+    }
+  });
+}
+
+void EventLoop::stopAccept(int sd) { this->remove(sd); }
+
+void EventLoop::attach(Con &con, std::uint32_t events,
+                       const Callback &callback) {
+  this->add(con.getDescriptor(), events, callback);
+}
+
+void EventLoop::modify(Con &con, std::uint32_t events) {
+  this->modify(con.getDescriptor(), events);
+}
+
+void EventLoop::detach(Con &con, Task done) {
+  // nothing is in flight, the socket reads go straight to the connection
+  this->remove(con.getDescriptor());
+  done();
+}
+
+void EventLoop::close(std::unique_ptr<Con> con) {
+  // socket connections write directly, nothing left to send
+  this->remove(con->getDescriptor());
+}
+
+ConMode EventLoop::connectionMode() const noexcept {
+  return ConMode::NonBlocking;
+}
+
+void EventLoop::run() {
+  std::array<struct epoll_event, MaxEvents> events;
+  Executor::Scope scope{this};
+
+  while (this->running) {
+    int ready =
+        epoll_wait(this->epfd, events.data(), MaxEvents, this->timeout());
+    if (ready == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      perror("[Webli] EventLoop::run");
+      break;
+    }
+
+    for (int i = 0; i < ready; i++) {
+      int fd = events[i].data.fd;
+
+      if (fd == this->wakefd) {
+        std::uint64_t counter;
+        [[maybe_unused]] auto ret =
+            ::read(this->wakefd, &counter, sizeof(counter));
+
+        this->runPosted();
+        continue;
+      }
+
+      auto it = this->callbacks.find(fd);
+      if (it == this->callbacks.end()) {
+        // removed by an earlier callback of this batch
+        continue;
+      }
+
+      // keep the callback alive in case it unregisters itself
+      auto callback = it->second;
+      (*callback)(events[i].events);
+    }
+
+    this->runTimers();
+  }
+}
+} // namespace W
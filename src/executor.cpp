@@ -0,0 +1,17 @@
+// Copyright 2024 Mina
+
+#include <webli/executor.hpp>
+
+namespace W {
+/** @brief executor of the current thread */
+static thread_local Executor *g_current_executor{nullptr};
+
+Executor *Executor::current() noexcept { return g_current_executor; }
+
+Executor::Scope::Scope(Executor *executor) noexcept
+    : previous(g_current_executor) {
+  g_current_executor = executor;
+}
+
+Executor::Scope::~Scope() { g_current_executor = this->previous; }
+} // namespace W
@@ -0,0 +1,165 @@
+// Copyright 2024 Mina
+
+#include <webli/handoff.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace W {
+/** @brief most listeners passed in one handoff */
+static constexpr const std::size_t MaxListeners = 64;
+
+/**
+ * @brief fill a unix socket address
+ *
+ * @param path socket path
+ * @param addr output address
+ * @return true if the path fits
+ */
+static bool unixAddress(const std::string &path, struct sockaddr_un &addr) {
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+
+  if (path.size() >= sizeof(addr.sun_path)) {
+    return false;
+  }
+
+  std::memcpy(addr.sun_path, path.c_str(), path.size());
+  return true;
+}
+
+Handoff::Handoff(std::string_view path) : path(path) {}
+
+Handoff::~Handoff() {
+  if (this->sd != -1) {
+    close(this->sd);
+  }
+}
+
+std::vector<int> Handoff::adopt() const {
+  std::vector<int> sds;
+  struct sockaddr_un addr;
+
+  if (!unixAddress(this->path, addr)) {
+    return sds;
+  }
+
+  int peer = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (peer == -1 ||
+      connect(peer, reinterpret_cast<struct sockaddr *>(&addr),
+              sizeof(addr)) != 0) {
+    // no predecessor, start fresh
+    if (peer != -1) {
+      close(peer);
+    }
+    return sds;
+  }
+
+  std::uint32_t count{0};
+  struct iovec iov{&count, sizeof(count)};
+
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MaxListeners)];
+  struct msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t ret;
+  do {
+    ret = recvmsg(peer, &msg, MSG_CMSG_CLOEXEC);
+  } while (ret == -1 && errno == EINTR);
+  close(peer);
+
+  if (ret != sizeof(count)) {
+    perror("[Webli] Handoff::adopt");
+    return sds;
+  }
+
+  for (auto *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+
+    auto received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    sds.resize(received);
+    std::memcpy(sds.data(), CMSG_DATA(cmsg), received * sizeof(int));
+  }
+
+  if (sds.size() != count) {
+    std::fprintf(stderr, "[Webli] Handoff: expected %u listeners, got %zu\n",
+                 count, sds.size());
+  }
+
+  return sds;
+}
+
+void Handoff::open() {
+  struct sockaddr_un addr;
+
+  if (!unixAddress(this->path, addr)) {
+    std::fprintf(stderr, "[Webli] Handoff: socket path too long\n");
+    std::exit(EXIT_FAILURE);
+    __builtin_unreachable();
+  }
+
+  // the previous generation already handed off, its path is ours now
+  unlink(this->path.c_str());
+
+  this->sd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (this->sd == -1 ||
+      bind(this->sd, reinterpret_cast<struct sockaddr *>(&addr),
+           sizeof(addr)) != 0 ||
+      ::listen(this->sd, 1) != 0) {
+    perror("[Webli] Handoff::open");
+    std::exit(EXIT_FAILURE);
+    __builtin_unreachable();
+  }
+}
+
+bool Handoff::serve(const std::vector<int> &sds) const {
+  int peer = accept4(this->sd, nullptr, nullptr, SOCK_CLOEXEC);
+  if (peer == -1) {
+    return false;
+  }
+
+  auto count = static_cast<std::uint32_t>(std::min(sds.size(), MaxListeners));
+  struct iovec iov{&count, sizeof(count)};
+
+  alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MaxListeners)];
+  struct msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+  auto *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+  std::memcpy(CMSG_DATA(cmsg), sds.data(), sizeof(int) * count);
+
+  ssize_t ret;
+  do {
+    ret = sendmsg(peer, &msg, MSG_NOSIGNAL);
+  } while (ret == -1 && errno == EINTR);
+  close(peer);
+
+  if (ret != sizeof(count)) {
+    perror("[Webli] Handoff::serve");
+    return false;
+  }
+
+  return true;
+}
+
+int Handoff::getDescriptor() const noexcept { return this->sd; }
+} // namespace W
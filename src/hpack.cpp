@@ -0,0 +1,574 @@
+// Copyright 2024 Mina
+
+#include <webli/hpack.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace W {
+/**
+ * @brief Huffman code of a symbol
+ *
+ */
+struct HuffmanCode {
+  /** @brief code, right aligned */
+  std::uint32_t code;
+
+  /** @brief code length in bits */
+  std::uint8_t bits;
+};
+
+/** @brief huffman code of every byte and EOS (RFC 7541 Appendix B) */
+static constexpr std::array<HuffmanCode, 257> Huffman{{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+    {0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+    {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+    {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+    {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+    {0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+    {0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+    {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12}, {0x1ff9, 13}, {0x15, 6},
+    {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+    {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6},
+    {0x5c, 7}, {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+    {0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7},
+    {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7},
+    {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+    {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7}, {0xfd, 8},
+    {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+    {0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6},
+    {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6},
+    {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5}, {0x9, 5},
+    {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+    {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22},
+    {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22},
+    {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24},
+    {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24},
+    {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22},
+    {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22},
+    {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23},
+    {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21},
+    {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23},
+    {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20},
+    {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26},
+    {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22},
+    {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27},
+    {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19},
+    {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27},
+    {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24}, {0x1fffe4, 21},
+    {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20},
+    {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21}, {0x3fffe9, 22},
+    {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24},
+    {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26},
+    {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27},
+    {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27},
+    {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30}
+}};
+
+/** @brief static table (RFC 7541 Appendix A) */
+static const std::array<HpackField, 61> StaticTable{{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""}
+}};
+
+/** @brief end of string symbol */
+static constexpr const std::size_t Eos = 256;
+
+/**
+ * @brief Binary tree of the huffman codes, leaves carry the symbol
+ *
+ */
+class HuffmanTree {
+public:
+  HuffmanTree() {
+    this->nodes.push_back({});
+
+    for (std::size_t symbol = 0; symbol < Huffman.size(); symbol++) {
+      std::size_t node{0};
+
+      for (int bit = Huffman[symbol].bits - 1; bit >= 0; bit--) {
+        auto branch = (Huffman[symbol].code >> bit) & 1;
+        if (this->nodes[node].next[branch] == 0) {
+          this->nodes[node].next[branch] =
+              static_cast<std::uint16_t>(this->nodes.size());
+          this->nodes.push_back({});
+        }
+        node = this->nodes[node].next[branch];
+      }
+
+      this->nodes[node].symbol = static_cast<std::int16_t>(symbol);
+    }
+  }
+
+  /**
+   * @brief decode a huffman encoded string
+   *
+   * @param data encoded string
+   * @param out output buffer to append to
+   * @throws HpackError on invalid codes or padding
+   */
+  void decode(std::string_view data, std::string &out) const {
+    std::size_t node{0};
+
+    // the padding is the most significant bits of EOS, so up to 7 ones
+    std::size_t depth{0};
+    bool ones{true};
+
+    for (auto byte : data) {
+      for (int bit = 7; bit >= 0; bit--) {
+        auto branch = (static_cast<std::uint8_t>(byte) >> bit) & 1;
+
+        node = this->nodes[node].next[branch];
+        depth++;
+        ones = ones && branch == 1;
+
+        if (node == 0) {
+          throw HpackError("invalid huffman code");
+        }
+
+        auto symbol = this->nodes[node].symbol;
+        if (symbol == static_cast<std::int16_t>(Eos)) {
+          throw HpackError("huffman string contains EOS");
+        }
+
+        if (symbol >= 0) {
+          out.push_back(static_cast<char>(symbol));
+          node = 0;
+          depth = 0;
+          ones = true;
+        }
+      }
+    }
+
+    if (depth > 7 || !ones) {
+      throw HpackError("invalid huffman padding");
+    }
+  }
+
+private:
+  /**
+   * @brief Tree node
+   *
+   */
+  struct Node {
+    /** @brief child per bit, 0 = none (the root is never a child) */
+    std::array<std::uint16_t, 2> next{};
+
+    /** @brief symbol of a leaf, -1 for inner nodes */
+    std::int16_t symbol{-1};
+  };
+
+  /** @brief nodes, the root first */
+  std::vector<Node> nodes;
+};
+
+/**
+ * @brief size of an entry as defined by HPACK
+ *
+ * @param name field name
+ * @param value field value
+ * @return std::size_t
+ */
+static std::size_t entrySize(std::string_view name,
+                             std::string_view value) noexcept {
+  return name.size() + value.size() + 32;
+}
+
+/**
+ * @brief decode a prefixed integer
+ *
+ * @param data input, the integer gets consumed
+ * @param prefix bits of the first byte belonging to the integer
+ * @return std::size_t
+ * @throws HpackError on truncated or too large integers
+ */
+static std::size_t decodeInteger(std::string_view &data, int prefix) {
+  if (data.empty()) {
+    throw HpackError("truncated integer");
+  }
+
+  std::size_t limit = (1U << prefix) - 1;
+  std::size_t value = static_cast<std::uint8_t>(data.front()) & limit;
+  data.remove_prefix(1);
+
+  if (value < limit) {
+    return value;
+  }
+
+  for (int shift = 0;; shift += 7) {
+    // nothing sane needs more than 28 bits
+    if (data.empty() || shift > 21) {
+      throw HpackError("invalid integer");
+    }
+
+    auto byte = static_cast<std::uint8_t>(data.front());
+    data.remove_prefix(1);
+
+    value += static_cast<std::size_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+}
+
+/**
+ * @brief decode a string literal
+ *
+ * @param data input, the string gets consumed
+ * @return std::string
+ * @throws HpackError on truncated strings or invalid huffman codes
+ */
+static std::string decodeString(std::string_view &data) {
+  static const HuffmanTree tree{};
+
+  if (data.empty()) {
+    throw HpackError("truncated string");
+  }
+
+  bool huffman = (data.front() & 0x80) != 0;
+  auto size = decodeInteger(data, 7);
+  if (size > data.size()) {
+    throw HpackError("truncated string");
+  }
+
+  std::string value;
+  if (huffman) {
+    tree.decode(data.substr(0, size), value);
+  } else {
+    value.assign(data.substr(0, size));
+  }
+
+  data.remove_prefix(size);
+  return value;
+}
+
+/**
+ * @brief encode a prefixed integer
+ *
+ * @param value integer
+ * @param prefix bits of the first byte belonging to the integer
+ * @param flags bits of the first byte above the prefix
+ * @param out output buffer to append to
+ */
+static void encodeInteger(std::size_t value, int prefix, std::uint8_t flags,
+                          std::string &out) {
+  std::size_t limit = (1U << prefix) - 1;
+
+  if (value < limit) {
+    out.push_back(static_cast<char>(flags | value));
+    return;
+  }
+
+  out.push_back(static_cast<char>(flags | limit));
+  value -= limit;
+
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+/**
+ * @brief encode a string literal, huffman coded if that is shorter
+ *
+ * @param value string
+ * @param out output buffer to append to
+ */
+static void encodeString(std::string_view value, std::string &out) {
+  std::size_t bits{0};
+  for (auto c : value) {
+    bits += Huffman[static_cast<std::uint8_t>(c)].bits;
+  }
+
+  auto huffman_size = (bits + 7) / 8;
+  if (huffman_size >= value.size()) {
+    encodeInteger(value.size(), 7, 0x00, out);
+    out.append(value);
+    return;
+  }
+
+  encodeInteger(huffman_size, 7, 0x80, out);
+
+  std::uint64_t buffer{0};
+  std::size_t pending{0};
+
+  for (auto c : value) {
+    const auto &code = Huffman[static_cast<std::uint8_t>(c)];
+    buffer = (buffer << code.bits) | code.code;
+    pending += code.bits;
+
+    while (pending >= 8) {
+      pending -= 8;
+      out.push_back(static_cast<char>(buffer >> pending));
+    }
+  }
+
+  // pad with the most significant bits of EOS
+  if (pending > 0) {
+    out.push_back(
+        static_cast<char>((buffer << (8 - pending)) | (0xFF >> pending)));
+  }
+}
+
+HpackTable::HpackTable(std::size_t max_size) : max_size(max_size) {}
+
+const HpackField &HpackTable::get(std::size_t index) const {
+  if (index == 0 || index > StaticTable.size() + this->entries.size()) {
+    throw HpackError("invalid hpack index");
+  }
+
+  if (index <= StaticTable.size()) {
+    return StaticTable[index - 1];
+  }
+
+  return this->entries[index - StaticTable.size() - 1];
+}
+
+std::size_t HpackTable::find(std::string_view name, std::string_view value,
+                             bool &exact) const noexcept {
+  std::size_t found{0};
+  exact = false;
+
+  for (std::size_t i = 0; i < StaticTable.size(); i++) {
+    if (StaticTable[i].first != name) {
+      continue;
+    }
+
+    if (StaticTable[i].second == value) {
+      exact = true;
+      return i + 1;
+    }
+
+    if (found == 0) {
+      found = i + 1;
+    }
+  }
+
+  for (std::size_t i = 0; i < this->entries.size(); i++) {
+    if (this->entries[i].first != name) {
+      continue;
+    }
+
+    if (this->entries[i].second == value) {
+      exact = true;
+      return StaticTable.size() + i + 1;
+    }
+
+    if (found == 0) {
+      found = StaticTable.size() + i + 1;
+    }
+  }
+
+  return found;
+}
+
+void HpackTable::add(std::string name, std::string value) {
+  auto size = entrySize(name, value);
+
+  // an entry larger than the table empties it
+  if (size > this->max_size) {
+    this->evict(0);
+    return;
+  }
+
+  this->evict(this->max_size - size);
+  this->entries.emplace_front(std::move(name), std::move(value));
+  this->size += size;
+}
+
+void HpackTable::resize(std::size_t max_size) {
+  this->max_size = max_size;
+  this->evict(max_size);
+}
+
+std::size_t HpackTable::getMaxSize() const noexcept { return this->max_size; }
+
+void HpackTable::evict(std::size_t limit) noexcept {
+  while (this->size > limit) {
+    const auto &oldest = this->entries.back();
+    this->size -= entrySize(oldest.first, oldest.second);
+    this->entries.pop_back();
+  }
+}
+
+HpackDecoder::HpackDecoder(std::size_t max_table_size)
+    : table(max_table_size), max_table_size(max_table_size) {}
+
+bool HpackDecoder::decode(std::string_view block,
+                          std::vector<HpackField> &fields,
+                          std::size_t max_list_size) {
+  std::size_t list_size{0};
+  bool first{true};
+
+  fields.clear();
+
+  while (!block.empty()) {
+    auto byte = static_cast<std::uint8_t>(block.front());
+    HpackField field;
+
+    if (byte & 0x80) {
+      // indexed field
+      field = this->table.get(decodeInteger(block, 7));
+
+    } else if ((byte & 0xE0) == 0x20) {
+      // table size updates only start a block
+      auto size = decodeInteger(block, 5);
+      if (!first || size > this->max_table_size) {
+        throw HpackError("invalid table size update");
+      }
+
+      this->table.resize(size);
+      continue;
+
+    } else {
+      // literal with incremental indexing, without indexing or never indexed
+      bool indexing = (byte & 0xC0) == 0x40;
+      auto index = decodeInteger(block, indexing ? 6 : 4);
+
+      field.first =
+          (index != 0) ? this->table.get(index).first : decodeString(block);
+      field.second = decodeString(block);
+
+      if (indexing) {
+        this->table.add(field.first, field.second);
+      }
+    }
+
+    first = false;
+    list_size += entrySize(field.first, field.second);
+    if (list_size <= max_list_size) {
+      fields.push_back(std::move(field));
+    }
+  }
+
+  if (list_size > max_list_size) {
+    fields.clear();
+    return false;
+  }
+
+  return true;
+}
+
+void HpackEncoder::resize(std::size_t max_size) {
+  // the peer may allow more, but the default size suffices for responses
+  max_size = std::min<std::size_t>(max_size, 4096);
+  if (max_size != this->table.getMaxSize()) {
+    this->table.resize(max_size);
+    this->resized = true;
+  }
+}
+
+void HpackEncoder::encode(const std::vector<HpackField> &fields,
+                          std::string &out) {
+  if (this->resized) {
+    encodeInteger(this->table.getMaxSize(), 5, 0x20, out);
+    this->resized = false;
+  }
+
+  for (const auto &[name, value] : fields) {
+    bool exact{false};
+    auto index = this->table.find(name, value, exact);
+
+    if (exact) {
+      encodeInteger(index, 7, 0x80, out);
+      continue;
+    }
+
+    // values changing with every response would only flush the table, and
+    // cookies must not be guessable through the compression
+    bool sensitive = name == "set-cookie";
+    bool volatile_value = name == "content-length" || name == "date" ||
+                          name == "etag" || name == "last-modified";
+
+    if (sensitive) {
+      encodeInteger(index, 4, 0x10, out);
+    } else if (volatile_value) {
+      encodeInteger(index, 4, 0x00, out);
+    } else {
+      encodeInteger(index, 6, 0x40, out);
+    }
+
+    if (index == 0) {
+      encodeString(name, out);
+    }
+    encodeString(value, out);
+
+    if (!sensitive && !volatile_value) {
+      this->table.add(name, value);
+    }
+  }
+}
+} // namespace W
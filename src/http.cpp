@@ -1,12 +1,16 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <filesystem>
 #include <ctime>
 #include <iomanip>
 #include <string>
+#include <utility>
 
 #include <webli/exceptions.hpp>
 #include <webli/http.hpp>
+#include <webli/request_parser.hpp>
+#include <webli/storage.hpp>
 
 namespace W::Http {
 
@@ -280,6 +284,8 @@ std::string_view Object::getHeader(const std::string &key) const noexcept {
                                     : std::string_view("");
 }
 
+const StringMap &Object::getHeaders() const noexcept { return this->header; }
+
 const std::string &Object::getBody() const noexcept { return this->body; }
 
 nlohmann::json Object::getBodyJson() const noexcept {
@@ -305,6 +311,16 @@ void Object::setBody(const std::string &data) noexcept {
   this->body = data;
 }
 
+void Object::appendBody(std::string_view data) { this->body.append(data); }
+
+std::string Object::takeBody() noexcept { return std::exchange(this->body, {}); }
+
+void Object::reset() noexcept {
+  this->header.clear();
+  this->body.clear();
+  this->version = "HTTP/1.1";
+}
+
 void Object::setBodyJson(const nlohmann::json &json) noexcept {
   this->setBody(json.dump());
   this->setHeader(Http::Header::ContentType, "application/json");
@@ -343,7 +359,9 @@ void Object::parseHeader(std::stringstream &data) {
 }
 
 void Object::parseBody(std::stringstream &data) {
-  std::getline(data, this->body);
+  // bodies may hold line breaks, so the body is all that is left
+  this->body.assign(std::istreambuf_iterator<char>(data),
+                    std::istreambuf_iterator<char>());
 }
 
 Request::Request() : Object() {}
@@ -372,6 +390,37 @@ StringMap Request::getCookies() const noexcept {
 
 void Request::setPath(const std::string &path) noexcept { this->path = path; }
 
+bool Request::isEarlyData() const noexcept {
+  return this->early_data || this->getHeader(Header::EarlyData) == "1";
+}
+
+void Request::setEarlyData(bool early_data) noexcept {
+  this->early_data = early_data;
+}
+
+void Request::assign(const RequestParser &head) {
+  this->method.assign(head.getMethod());
+  this->path.assign(head.getPath());
+  this->version.assign(head.getVersion());
+
+  // a repeated field keeps its last value, like the stream parser
+  for (const auto &[key, value] : head.getHeaders()) {
+    if (auto it = this->header.find(key); it != this->header.end()) {
+      it->second.assign(value);
+      continue;
+    }
+
+    this->header.emplace(key, value);
+  }
+}
+
+void Request::reset() noexcept {
+  Object::reset();
+  this->method.clear();
+  this->path.clear();
+  this->early_data = false;
+}
+
 std::string Request::build() const noexcept {
   std::string req;
 
@@ -443,6 +492,38 @@ void Response::setStatusCode(StatusCode code) noexcept {
   this->status_code = code;
 }
 
+void Response::setBody(const std::string &data) noexcept {
+  this->file.clear();
+  this->file_size = 0;
+  Object::setBody(data);
+}
+
+void Response::setFile(const std::string &path) noexcept {
+  std::error_code error;
+  auto size = std::filesystem::file_size(path, error);
+
+  this->setBody("");
+  if (error) {
+    return;
+  }
+
+  this->file = path;
+  this->file_size = size;
+  this->setHeader(Header::ContentLength, std::to_string(size));
+}
+
+const std::string &Response::getFile() const noexcept { return this->file; }
+
+std::size_t Response::getFileSize() const noexcept { return this->file_size; }
+
+void Response::loadFile() noexcept {
+  if (this->file.empty()) {
+    return;
+  }
+
+  this->setBody(Storage::loadAsString(this->file));
+}
+
 void Response::setCookie(std::string_view name, std::string_view value,
                          bool httpOnly, std::string_view domain_scope,
                          std::string_view path_scope,
@@ -480,19 +561,40 @@ void Response::setCookie(
 }
 
 std::string Response::build() const noexcept {
-  std::string req;
+  auto resp = this->buildHead();
+  resp += this->body;
+  return resp;
+}
+
+void Response::reset() noexcept {
+  Object::reset();
+  this->status_code = StatusCode::Ok;
+  this->file.clear();
+  this->file_size = 0;
+}
 
-  req += (this->version + " " +
-          std::to_string(static_cast<int>(this->status_code)) + " " +
-          StatusCodeToString(this->status_code) + "\r\n");
+std::string Response::buildHead() const noexcept {
+  auto status = std::to_string(static_cast<int>(this->status_code));
+  auto reason = StatusCodeToString(this->status_code);
 
+  // one allocation for the whole head
+  std::size_t size = this->version.size() + status.size() + reason.size() + 6;
   for (const auto &[k, v] : this->header) {
-    req += (k + ": " + v + "\r\n");
+    size += k.size() + v.size() + 4;
   }
 
-  req += ("\r\n" + body);
+  std::string head;
+  head.reserve(size);
 
-  return req;
+  head.append(this->version).append(" ").append(status).append(" ");
+  head.append(reason).append("\r\n");
+
+  for (const auto &[k, v] : this->header) {
+    head.append(k).append(": ").append(v).append("\r\n");
+  }
+
+  head.append("\r\n");
+  return head;
 }
 
 void Response::parseFirstLine(std::stringstream &data) {
@@ -0,0 +1,885 @@
+// Copyright 2024 Mina
+
+#include <webli/http2.hpp>
+#include <webli/storage.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+namespace W {
+/** @brief first bytes of every client connection */
+static constexpr std::string_view ClientPreface{
+    "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"};
+
+/** @brief size of a frame header */
+static constexpr const std::size_t FrameHeaderSize = 9;
+
+/** @brief largest frame payload the server accepts (the default) */
+static constexpr const std::uint32_t MaxFrameSize = 16384;
+
+/** @brief largest flow control window */
+static constexpr const std::int64_t MaxWindow = 0x7FFFFFFF;
+
+/** @brief initial flow control window of every connection */
+static constexpr const std::int64_t DefaultWindow = 65535;
+
+/** @brief END_STREAM flag (DATA, HEADERS) */
+static constexpr const std::uint8_t FlagEndStream = 0x1;
+
+/** @brief ACK flag (SETTINGS, PING) */
+static constexpr const std::uint8_t FlagAck = 0x1;
+
+/** @brief END_HEADERS flag (HEADERS, CONTINUATION) */
+static constexpr const std::uint8_t FlagEndHeaders = 0x4;
+
+/** @brief PADDED flag (DATA, HEADERS) */
+static constexpr const std::uint8_t FlagPadded = 0x8;
+
+/** @brief PRIORITY flag (HEADERS) */
+static constexpr const std::uint8_t FlagPriority = 0x20;
+
+/**
+ * @brief Setting identifiers
+ *
+ */
+enum class Setting : std::uint16_t {
+  HeaderTableSize = 1,
+  EnablePush,
+  MaxConcurrentStreams,
+  InitialWindowSize,
+  MaxFrameSize,
+  MaxHeaderListSize
+};
+
+/**
+ * @brief read a big endian integer
+ *
+ * @param data at least `bytes` bytes
+ * @param bytes integer size
+ * @return std::uint32_t
+ */
+static std::uint32_t readInteger(std::string_view data, std::size_t bytes) {
+  std::uint32_t value{0};
+  for (std::size_t i = 0; i < bytes; i++) {
+    value = (value << 8) | static_cast<std::uint8_t>(data[i]);
+  }
+  return value;
+}
+
+/**
+ * @brief append a big endian integer
+ *
+ * @param value integer
+ * @param bytes integer size
+ * @param out output buffer
+ */
+static void writeInteger(std::uint32_t value, std::size_t bytes,
+                         std::string &out) {
+  for (std::size_t i = bytes; i > 0; i--) {
+    out.push_back(static_cast<char>(value >> ((i - 1) * 8)));
+  }
+}
+
+/**
+ * @brief check if a header only concerns a HTTP/1.1 connection
+ *
+ * @param name lower case header name
+ * @return true
+ * @return false
+ */
+static bool connectionSpecific(std::string_view name) noexcept {
+  return name == "connection" || name == "keep-alive" ||
+         name == "proxy-connection" || name == "transfer-encoding" ||
+         name == "upgrade";
+}
+
+/**
+ * @brief turn a lower case header name into the spelling handlers look for,
+ * e.g. `content-type` into `Content-Type`
+ *
+ * @param name lower case header name
+ * @return std::string
+ */
+static std::string canonicalName(std::string_view name) {
+  std::string canonical{name};
+
+  bool start{true};
+  for (auto &c : canonical) {
+    if (start) {
+      c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    start = c == '-';
+  }
+
+  return canonical;
+}
+
+Http2Connection::Http2Connection(const Http2Options &options)
+    : options(options),
+      receive_window(std::max<std::int64_t>(options.window_size,
+                                            DefaultWindow)) {
+  this->options.window_size =
+      static_cast<std::uint32_t>(this->receive_window);
+
+  std::string payload;
+  auto setting = [&payload](Setting id, std::uint32_t value) {
+    writeInteger(static_cast<std::uint32_t>(id), 2, payload);
+    writeInteger(value, 4, payload);
+  };
+
+  setting(Setting::EnablePush, 0);
+  setting(Setting::MaxConcurrentStreams, this->options.max_streams);
+  setting(Setting::InitialWindowSize, this->options.window_size);
+  setting(Setting::MaxHeaderListSize, this->options.max_header_list_size);
+  this->write(FrameType::Settings, 0, 0, payload);
+
+  // the connection window can only grow through updates
+  if (this->receive_window > DefaultWindow) {
+    this->writeWindowUpdate(
+        0, static_cast<std::uint32_t>(this->receive_window - DefaultWindow));
+  }
+}
+
+bool Http2Connection::receive(std::string_view data) {
+  if (this->failed) {
+    return false;
+  }
+
+  this->input.append(data);
+  std::string_view rest{this->input};
+
+  if (!this->preface) {
+    auto size = std::min(rest.size(), ClientPreface.size());
+    if (rest.substr(0, size) != ClientPreface.substr(0, size)) {
+      this->fail(Http2Error::ProtocolError);
+      return false;
+    }
+
+    if (size < ClientPreface.size()) {
+      return true;
+    }
+
+    rest.remove_prefix(size);
+    this->preface = true;
+  }
+
+  while (!this->failed && rest.size() >= FrameHeaderSize) {
+    auto length = readInteger(rest, 3);
+    if (length > MaxFrameSize) {
+      this->fail(Http2Error::FrameSizeError);
+      break;
+    }
+
+    if (rest.size() < FrameHeaderSize + length) {
+      break;
+    }
+
+    this->frame(static_cast<FrameType>(rest[3]),
+                static_cast<std::uint8_t>(rest[4]),
+                readInteger(rest.substr(5), 4) & 0x7FFFFFFF,
+                rest.substr(FrameHeaderSize, length));
+    rest.remove_prefix(FrameHeaderSize + length);
+  }
+
+  this->input.erase(0, this->input.size() - rest.size());
+  return !this->failed;
+}
+
+std::optional<std::pair<std::uint32_t, Http::Request>> Http2Connection::next() {
+  if (this->ready.empty()) {
+    return std::nullopt;
+  }
+
+  auto request = std::move(this->ready.front());
+  this->ready.pop_front();
+  return request;
+}
+
+void Http2Connection::respond(std::uint32_t stream,
+                              const Http::Response &resp) {
+  // DATA frames carry every body, so file bodies get read in
+  this->answer(stream, resp,
+               resp.getFile().empty() ? resp.getBody()
+                                      : Storage::loadAsString(resp.getFile()));
+}
+
+void Http2Connection::respond(std::uint32_t stream, Http::Response &&resp) {
+  this->answer(stream, resp,
+               resp.getFile().empty() ? resp.takeBody()
+                                      : Storage::loadAsString(resp.getFile()));
+}
+
+void Http2Connection::answer(std::uint32_t stream, const Http::Response &resp,
+                             std::string body) {
+  auto it = this->streams.find(stream);
+  if (this->failed || it == this->streams.end() || it->second.responding) {
+    return;
+  }
+
+  // the client is not interested anymore, the stream stops counting now
+  if (it->second.cancelled) {
+    this->streams.erase(it);
+    return;
+  }
+
+  auto &state = it->second;
+  state.responding = true;
+
+  auto status = static_cast<int>(resp.getStatusCode());
+  bool bodyless = status < 200 || status == 204 || status == 304;
+
+  std::vector<HpackField> fields{{":status", std::to_string(status)}};
+  for (const auto &[key, value] : resp.getHeaders()) {
+    std::string name{key};
+    std::transform(name.begin(), name.end(), name.begin(), [](char c) {
+      return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    });
+
+    if (!connectionSpecific(name) && name != "content-length") {
+      fields.emplace_back(std::move(name), value);
+    }
+  }
+
+  if (!bodyless) {
+    fields.emplace_back("content-length", std::to_string(body.size()));
+  }
+
+  if (!bodyless && !state.head) {
+    state.pending = std::move(body);
+  }
+
+  std::string block;
+  this->encoder.encode(fields, block);
+
+  // blocks larger than a frame continue in CONTINUATION frames
+  std::string_view rest{block};
+  auto type = FrameType::Headers;
+  std::uint8_t end_stream = state.pending.empty() ? FlagEndStream : 0;
+
+  do {
+    auto chunk = rest.substr(0, this->max_frame_size);
+    rest.remove_prefix(chunk.size());
+
+    this->write(type, (rest.empty() ? FlagEndHeaders : 0) | end_stream, stream,
+                chunk);
+    type = FrameType::Continuation;
+    end_stream = 0;
+  } while (!rest.empty());
+
+  if (state.pending.empty()) {
+    this->finish(stream);
+    return;
+  }
+
+  this->flush();
+}
+
+void Http2Connection::reset(std::uint32_t stream, Http2Error error) {
+  if (this->failed) {
+    return;
+  }
+
+  // the client reset the stream already
+  auto it = this->streams.find(stream);
+  if (it == this->streams.end() || !it->second.cancelled) {
+    std::string payload;
+    writeInteger(static_cast<std::uint32_t>(error), 4, payload);
+    this->write(FrameType::RstStream, 0, stream, payload);
+  }
+
+  this->streams.erase(stream);
+}
+
+std::string Http2Connection::takeOutput() noexcept {
+  return std::exchange(this->output, {});
+}
+
+std::size_t Http2Connection::getActiveStreams() const noexcept {
+  return this->streams.size();
+}
+
+bool Http2Connection::isDone() const noexcept {
+  return this->failed ||
+         (this->gone && this->streams.empty() && this->ready.empty());
+}
+
+void Http2Connection::frame(FrameType type, std::uint8_t flags,
+                            std::uint32_t id, std::string_view payload) {
+  // a header block must not be interrupted, and the client starts with its
+  // settings
+  if ((this->block_stream != 0 &&
+       (type != FrameType::Continuation || id != this->block_stream)) ||
+      (!this->settled && type != FrameType::Settings)) {
+    this->fail(Http2Error::ProtocolError);
+    return;
+  }
+
+  switch (type) {
+  case FrameType::Data:
+    this->data(flags, id, payload);
+    break;
+
+  case FrameType::Headers:
+    this->headers(flags, id, payload);
+    break;
+
+  case FrameType::Priority:
+    // priorities are advisory, requests run in the order they arrive
+    if (id == 0) {
+      this->fail(Http2Error::ProtocolError);
+    } else if (payload.size() != 5) {
+      this->abort(id, Http2Error::FrameSizeError);
+    }
+    break;
+
+  case FrameType::RstStream:
+    if (id == 0 || id > this->last_stream) {
+      this->fail(Http2Error::ProtocolError);
+    } else if (payload.size() != 4) {
+      this->fail(Http2Error::FrameSizeError);
+    } else if (this->streams.contains(id)) {
+      // opening and resetting streams over and over costs the client
+      // nothing but keeps the handlers busy (Rapid Reset)
+      if (this->options.max_resets != 0 &&
+          ++this->resets > this->options.max_resets) {
+        this->fail(Http2Error::EnhanceYourCalm);
+        return;
+      }
+
+      this->cancel(id);
+    }
+    break;
+
+  case FrameType::Settings:
+    this->settings(flags, id, payload);
+    break;
+
+  case FrameType::PushPromise:
+    // only servers push
+    this->fail(Http2Error::ProtocolError);
+    break;
+
+  case FrameType::Ping:
+    if (id != 0) {
+      this->fail(Http2Error::ProtocolError);
+    } else if (payload.size() != 8) {
+      this->fail(Http2Error::FrameSizeError);
+    } else if (!(flags & FlagAck)) {
+      this->write(FrameType::Ping, FlagAck, 0, payload);
+    }
+    break;
+
+  case FrameType::Goaway:
+    if (id != 0) {
+      this->fail(Http2Error::ProtocolError);
+    } else {
+      this->gone = true;
+    }
+    break;
+
+  case FrameType::WindowUpdate:
+    this->windowUpdate(id, payload);
+    break;
+
+  case FrameType::Continuation:
+    if (this->block_stream == 0) {
+      this->fail(Http2Error::ProtocolError);
+      break;
+    }
+
+    // a compressed block never exceeds its decoded size by much
+    this->block.append(payload);
+    if (this->block.size() > this->options.max_header_list_size + 1024) {
+      this->fail(Http2Error::EnhanceYourCalm);
+      break;
+    }
+
+    if (flags & FlagEndHeaders) {
+      auto stream = std::exchange(this->block_stream, 0);
+      this->headerBlock(stream, this->block_end_stream);
+    }
+    break;
+
+  default:
+    // unknown frame types are ignored
+    break;
+  }
+}
+
+void Http2Connection::headers(std::uint8_t flags, std::uint32_t id,
+                              std::string_view payload) {
+  // clients open odd streams only
+  if (id == 0 || id % 2 == 0) {
+    this->fail(Http2Error::ProtocolError);
+    return;
+  }
+
+  if (!this->unpad(flags, payload)) {
+    return;
+  }
+
+  if (flags & FlagPriority) {
+    if (payload.size() < 5) {
+      this->fail(Http2Error::FrameSizeError);
+      return;
+    }
+    payload.remove_prefix(5);
+  }
+
+  this->block.assign(payload);
+  this->block_end_stream = (flags & FlagEndStream) != 0;
+
+  if (flags & FlagEndHeaders) {
+    this->headerBlock(id, this->block_end_stream);
+  } else {
+    this->block_stream = id;
+  }
+}
+
+void Http2Connection::headerBlock(std::uint32_t id, bool end_stream) {
+  std::vector<HpackField> fields;
+  bool fits{false};
+
+  // every block has to be decoded, the table would get out of sync otherwise
+  try {
+    fits = this->decoder.decode(this->block, fields,
+                                this->options.max_header_list_size);
+  } catch (const HpackError &) {
+    this->fail(Http2Error::CompressionError);
+    return;
+  }
+  this->block.clear();
+
+  if (auto it = this->streams.find(id); it != this->streams.end()) {
+    // trailers end the request, their fields get dropped
+    if (it->second.received || !end_stream) {
+      this->abort(id, it->second.received ? Http2Error::StreamClosed
+                                          : Http2Error::ProtocolError);
+      return;
+    }
+
+    it->second.received = true;
+    this->complete(id, it->second);
+    return;
+  }
+
+  // streams closed already, e.g. reset by the server, stay closed
+  if (id <= this->last_stream) {
+    return;
+  }
+  this->last_stream = id;
+
+  if (this->streams.size() >= this->options.max_streams) {
+    this->abort(id, Http2Error::RefusedStream);
+    return;
+  }
+
+  auto &stream = this->streams[id];
+  stream.received = end_stream;
+  stream.receive_window = this->options.window_size;
+  stream.send_window = this->initial_send_window;
+
+  if (!fits) {
+    Http::Response too_large{};
+    too_large.setStatusCode(Http::StatusCode::RequestHeaderFieldsTooLarge);
+    this->respond(id, too_large);
+    return;
+  }
+
+  stream.fields = std::move(fields);
+  if (end_stream) {
+    this->complete(id, stream);
+  }
+}
+
+void Http2Connection::data(std::uint8_t flags, std::uint32_t id,
+                           std::string_view payload) {
+  if (id == 0 || id > this->last_stream) {
+    this->fail(Http2Error::ProtocolError);
+    return;
+  }
+
+  // padding counts against the windows too
+  auto size = static_cast<std::uint32_t>(payload.size());
+
+  this->receive_window -= size;
+  if (this->receive_window < 0) {
+    this->fail(Http2Error::FlowControlError);
+    return;
+  }
+
+  this->consumed += size;
+  if (this->consumed >= this->options.window_size / 2) {
+    this->writeWindowUpdate(0, this->consumed);
+    this->receive_window += this->consumed;
+    this->consumed = 0;
+  }
+
+  if (!this->unpad(flags, payload)) {
+    return;
+  }
+
+  auto it = this->streams.find(id);
+  if (it == this->streams.end()) {
+    return;
+  }
+
+  auto &stream = it->second;
+  if (stream.received) {
+    this->abort(id, Http2Error::StreamClosed);
+    return;
+  }
+
+  stream.receive_window -= size;
+  if (stream.receive_window < 0) {
+    this->abort(id, Http2Error::FlowControlError);
+    return;
+  }
+
+  if (stream.body.size() + payload.size() > this->options.max_body_size) {
+    this->abort(id, Http2Error::Cancel);
+    return;
+  }
+  stream.body.append(payload);
+
+  if (flags & FlagEndStream) {
+    stream.received = true;
+    this->complete(id, stream);
+    return;
+  }
+
+  stream.consumed += size;
+  if (stream.consumed >= this->options.window_size / 2) {
+    this->writeWindowUpdate(id, stream.consumed);
+    stream.receive_window += stream.consumed;
+    stream.consumed = 0;
+  }
+}
+
+void Http2Connection::settings(std::uint8_t flags, std::uint32_t id,
+                               std::string_view payload) {
+  if (id != 0 || (!this->settled && (flags & FlagAck))) {
+    this->fail(Http2Error::ProtocolError);
+    return;
+  }
+
+  if ((flags & FlagAck) ? !payload.empty() : payload.size() % 6 != 0) {
+    this->fail(Http2Error::FrameSizeError);
+    return;
+  }
+
+  if (flags & FlagAck) {
+    return;
+  }
+
+  for (; !payload.empty(); payload.remove_prefix(6)) {
+    auto value = readInteger(payload.substr(2), 4);
+
+    switch (static_cast<Setting>(readInteger(payload, 2))) {
+    case Setting::HeaderTableSize:
+      this->encoder.resize(value);
+      break;
+
+    case Setting::EnablePush:
+      if (value > 1) {
+        this->fail(Http2Error::ProtocolError);
+        return;
+      }
+      break;
+
+    case Setting::InitialWindowSize: {
+      if (value > MaxWindow) {
+        this->fail(Http2Error::FlowControlError);
+        return;
+      }
+
+      // open streams move by the difference
+      auto delta = static_cast<std::int64_t>(value) - this->initial_send_window;
+      for (auto &[stream_id, stream] : this->streams) {
+        stream.send_window += delta;
+        if (stream.send_window > MaxWindow) {
+          this->fail(Http2Error::FlowControlError);
+          return;
+        }
+      }
+      this->initial_send_window = value;
+      break;
+    }
+
+    case Setting::MaxFrameSize:
+      if (value < MaxFrameSize || value > 0xFFFFFF) {
+        this->fail(Http2Error::ProtocolError);
+        return;
+      }
+      this->max_frame_size = value;
+      break;
+
+    default:
+      // the server never pushes and limits nothing else
+      break;
+    }
+  }
+
+  this->settled = true;
+  this->write(FrameType::Settings, FlagAck, 0, {});
+  this->flush();
+}
+
+void Http2Connection::windowUpdate(std::uint32_t id, std::string_view payload) {
+  if (payload.size() != 4) {
+    this->fail(Http2Error::FrameSizeError);
+    return;
+  }
+
+  auto increment = readInteger(payload, 4) & 0x7FFFFFFF;
+
+  if (id == 0) {
+    this->send_window += increment;
+    if (increment == 0 || this->send_window > MaxWindow) {
+      this->fail(increment == 0 ? Http2Error::ProtocolError
+                                : Http2Error::FlowControlError);
+      return;
+    }
+
+    this->flush();
+    return;
+  }
+
+  if (id > this->last_stream) {
+    this->fail(Http2Error::ProtocolError);
+    return;
+  }
+
+  auto it = this->streams.find(id);
+  if (it == this->streams.end()) {
+    return;
+  }
+
+  it->second.send_window += increment;
+  if (increment == 0 || it->second.send_window > MaxWindow) {
+    this->abort(id, increment == 0 ? Http2Error::ProtocolError
+                                   : Http2Error::FlowControlError);
+    return;
+  }
+
+  this->flush();
+}
+
+void Http2Connection::complete(std::uint32_t id, Stream &stream) {
+  // an early answer (431) already ends the stream
+  if (stream.responding) {
+    return;
+  }
+
+  std::string method;
+  std::string path;
+  std::string scheme;
+  std::string authority;
+  Http::StringMap header;
+  bool regular{false};
+
+  for (auto &[name, value] : stream.fields) {
+    if (name.starts_with(':')) {
+      std::string *pseudo = (name == ":method")      ? &method
+                            : (name == ":path")      ? &path
+                            : (name == ":scheme")    ? &scheme
+                            : (name == ":authority") ? &authority
+                                                     : nullptr;
+
+      // pseudo headers come first, each once
+      if (regular || pseudo == nullptr || !pseudo->empty()) {
+        this->abort(id, Http2Error::ProtocolError);
+        return;
+      }
+
+      *pseudo = std::move(value);
+      continue;
+    }
+
+    regular = true;
+    if (name.empty() ||
+        std::any_of(name.begin(), name.end(),
+                    [](char c) { return c >= 'A' && c <= 'Z'; }) ||
+        connectionSpecific(name) || (name == "te" && value != "trailers")) {
+      this->abort(id, Http2Error::ProtocolError);
+      return;
+    }
+
+    // split cookies get joined again, other repeated headers become a list
+    auto [entry, added] = header.try_emplace(canonicalName(name), value);
+    if (!added) {
+      entry->second.append(name == "cookie" ? "; " : ", ").append(value);
+    }
+  }
+
+  // CONNECT has no path, tunnels are not supported
+  if (method.empty() || path.empty() || scheme.empty()) {
+    this->abort(id, Http2Error::ProtocolError);
+    return;
+  }
+
+  if (!authority.empty()) {
+    header.try_emplace(Http::Header::Host, authority);
+  }
+
+  auto length = header.find(Http::Header::ContentLength);
+  if (length != header.end() &&
+      length->second != std::to_string(stream.body.size())) {
+    this->abort(id, Http2Error::ProtocolError);
+    return;
+  }
+
+  if (!stream.body.empty()) {
+    header[Http::Header::ContentLength] = std::to_string(stream.body.size());
+  }
+
+  stream.head = method == "HEAD";
+  stream.handling = true;
+  this->ready.emplace_back(
+      id, Http::Request(method, path, header, stream.body, "HTTP/2"));
+
+  stream.fields.clear();
+  stream.body.clear();
+  stream.body.shrink_to_fit();
+}
+
+void Http2Connection::flush() {
+  for (auto it = this->streams.begin();
+       it != this->streams.end() && this->send_window > 0;) {
+    auto id = it->first;
+    auto &stream = it->second;
+    auto left = stream.pending.size() - stream.sent;
+
+    if (!stream.responding || left == 0 || stream.send_window <= 0) {
+      ++it;
+      continue;
+    }
+
+    auto size = std::min<std::int64_t>(
+        {static_cast<std::int64_t>(left), this->max_frame_size,
+         this->send_window, stream.send_window});
+    bool last = static_cast<std::size_t>(size) == left;
+
+    this->write(FrameType::Data, last ? FlagEndStream : 0, id,
+                std::string_view{stream.pending}.substr(
+                    stream.sent, static_cast<std::size_t>(size)));
+
+    stream.sent += static_cast<std::size_t>(size);
+    stream.send_window -= size;
+    this->send_window -= size;
+
+    if (last) {
+      ++it;
+      this->finish(id);
+    }
+  }
+}
+
+void Http2Connection::finish(std::uint32_t id) {
+  auto it = this->streams.find(id);
+  if (it == this->streams.end()) {
+    return;
+  }
+
+  // the rest of a request answered early is not needed anymore
+  if (!it->second.received) {
+    std::string payload;
+    writeInteger(static_cast<std::uint32_t>(Http2Error::NoError), 4, payload);
+    this->write(FrameType::RstStream, 0, id, payload);
+  }
+
+  // answered streams make up for the ones the client reset
+  if (this->resets > 0) {
+    this->resets--;
+  }
+
+  this->streams.erase(it);
+}
+
+void Http2Connection::abort(std::uint32_t id, Http2Error error) {
+  // a cancelled stream is closed for the client already
+  if (auto it = this->streams.find(id);
+      it != this->streams.end() && it->second.cancelled) {
+    return;
+  }
+
+  std::string payload;
+  writeInteger(static_cast<std::uint32_t>(error), 4, payload);
+  this->write(FrameType::RstStream, 0, id, payload);
+
+  this->cancel(id);
+}
+
+void Http2Connection::cancel(std::uint32_t id) {
+  auto it = this->streams.find(id);
+  if (it == this->streams.end()) {
+    return;
+  }
+
+  auto &stream = it->second;
+  if (stream.handling && !stream.responding) {
+    auto queued = std::find_if(
+        this->ready.begin(), this->ready.end(),
+        [id](const auto &request) { return request.first == id; });
+
+    // a handler runs already, its stream counts against max_streams until
+    // the answer is back
+    if (queued == this->ready.end()) {
+      stream.cancelled = true;
+      return;
+    }
+
+    this->ready.erase(queued);
+  }
+
+  this->streams.erase(it);
+}
+
+bool Http2Connection::unpad(std::uint8_t flags, std::string_view &payload) {
+  if (!(flags & FlagPadded)) {
+    return true;
+  }
+
+  if (payload.empty() ||
+      static_cast<std::uint8_t>(payload.front()) >= payload.size()) {
+    this->fail(Http2Error::ProtocolError);
+    return false;
+  }
+
+  auto padding = static_cast<std::uint8_t>(payload.front());
+  payload = payload.substr(1, payload.size() - 1 - padding);
+  return true;
+}
+
+void Http2Connection::fail(Http2Error error) {
+  if (this->failed) {
+    return;
+  }
+
+  std::string payload;
+  writeInteger(this->last_stream, 4, payload);
+  writeInteger(static_cast<std::uint32_t>(error), 4, payload);
+  this->write(FrameType::Goaway, 0, 0, payload);
+
+  this->failed = true;
+  this->streams.clear();
+  this->ready.clear();
+}
+
+void Http2Connection::write(FrameType type, std::uint8_t flags,
+                            std::uint32_t id, std::string_view payload) {
+  writeInteger(static_cast<std::uint32_t>(payload.size()), 3, this->output);
+  this->output.push_back(static_cast<char>(type));
+  this->output.push_back(static_cast<char>(flags));
+  writeInteger(id, 4, this->output);
+  this->output.append(payload);
+}
+
+void Http2Connection::writeWindowUpdate(std::uint32_t id,
+                                        std::uint32_t increment) {
+  std::string payload;
+  writeInteger(increment, 4, payload);
+  this->write(FrameType::WindowUpdate, 0, id, payload);
+}
+} // namespace W
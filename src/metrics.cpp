@@ -0,0 +1,490 @@
+// Copyright 2024 Mina
+
+#include <webli/buffer_pool.hpp>
+#include <webli/metrics.hpp>
+#include <webli/router.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <functional>
+#include <sched.h>
+#include <thread>
+
+namespace W {
+/** @brief smallest rendered histogram bound, 2^4 us */
+static constexpr const unsigned FirstBound = 4;
+
+/** @brief largest rendered histogram bound, 2^25 us (33.5 s) */
+static constexpr const unsigned LastBound = 25;
+
+/**
+ * @brief escape a Prometheus label value
+ *
+ * @param value raw value
+ * @return std::string
+ */
+static std::string label(std::string_view value) {
+  std::string escaped;
+  escaped.reserve(value.size());
+
+  for (char c : value) {
+    if (c == '\\' || c == '"') {
+      escaped += '\\';
+    } else if (c == '\n') {
+      escaped += "\\n";
+      continue;
+    }
+    escaped += c;
+  }
+
+  return escaped;
+}
+
+/**
+ * @brief append the series of a histogram in the Prometheus text format
+ *
+ * @param out output
+ * @param name metric name
+ * @param labels labels of the series
+ * @param counts bucket counts
+ * @param sum sum of all values in microseconds
+ */
+static void appendHistogram(
+    std::string &out, std::string_view name, const std::string &labels,
+    const std::array<std::uint64_t, Histogram::Buckets> &counts,
+    std::uint64_t sum) {
+  std::string prefix{name};
+  std::uint64_t cumulative{0};
+  std::size_t bucket{0};
+
+  // every power of two starts a bucket, so the bounds are exact
+  for (unsigned bound = FirstBound; bound <= LastBound; bound++) {
+    for (; Histogram::lowerBound(bucket) < (1ull << bound); bucket++) {
+      cumulative += counts[bucket];
+    }
+
+    out += prefix + "_bucket{" + labels + ",le=\"" +
+           std::to_string(static_cast<double>(1ull << bound) / 1e6) + "\"} " +
+           std::to_string(cumulative) + "\n";
+  }
+
+  for (; bucket < Histogram::Buckets; bucket++) {
+    cumulative += counts[bucket];
+  }
+
+  out += prefix + "_bucket{" + labels + ",le=\"+Inf\"} " +
+         std::to_string(cumulative) + "\n";
+  out += prefix + "_sum{" + labels + "} " +
+         std::to_string(static_cast<double>(sum) / 1e6) + "\n";
+  out += prefix + "_count{" + labels + "} " + std::to_string(cumulative) +
+         "\n";
+}
+
+void RequestTiming::start() noexcept {
+  this->phases.fill(std::chrono::nanoseconds::zero());
+  this->measured = 0;
+  this->last = std::chrono::steady_clock::now();
+}
+
+void RequestTiming::skip() noexcept {
+  this->last = std::chrono::steady_clock::now();
+}
+
+void RequestTiming::lap(Phase phase) noexcept {
+  auto now = std::chrono::steady_clock::now();
+  auto index = static_cast<std::size_t>(phase);
+
+  this->phases[index] += now - this->last;
+  this->measured |= 1u << index;
+  this->last = now;
+}
+
+bool RequestTiming::has(Phase phase) const noexcept {
+  return (this->measured & (1u << static_cast<std::size_t>(phase))) != 0;
+}
+
+std::chrono::nanoseconds RequestTiming::get(Phase phase) const noexcept {
+  return this->phases[static_cast<std::size_t>(phase)];
+}
+
+std::chrono::nanoseconds RequestTiming::total() const noexcept {
+  auto sum = std::chrono::nanoseconds::zero();
+  for (auto phase : this->phases) {
+    sum += phase;
+  }
+  return sum;
+}
+
+std::string RequestTiming::describe() const {
+  std::string description;
+
+  for (std::size_t i = 0; i < PhaseCount; i++) {
+    auto phase = static_cast<Phase>(i);
+    if (!this->has(phase)) {
+      continue;
+    }
+
+    std::array<char, 32> millis{};
+    std::snprintf(millis.data(), millis.size(), "%.3fms",
+                  static_cast<double>(this->get(phase).count()) / 1e6);
+
+    if (!description.empty()) {
+      description += ' ';
+    }
+    description.append(RequestTiming::name(phase))
+        .append("=")
+        .append(millis.data());
+  }
+
+  return description;
+}
+
+std::string_view RequestTiming::name(Phase phase) noexcept {
+  switch (phase) {
+  case Phase::Handshake:
+    return "handshake";
+  case Phase::Read:
+    return "read";
+  case Phase::Parse:
+    return "parse";
+  case Phase::Queue:
+    return "queue";
+  case Phase::Route:
+    return "route";
+  case Phase::Handler:
+    return "handler";
+  case Phase::Write:
+    return "write";
+  }
+
+  return "unknown";
+}
+
+void Histogram::record(std::chrono::nanoseconds value) noexcept {
+  auto micros = static_cast<std::uint64_t>(
+      std::max<std::int64_t>(0, value.count() / 1000));
+
+  this->counts[Histogram::bucketOf(micros)].fetch_add(
+      1, std::memory_order_relaxed);
+  this->sum.fetch_add(micros, std::memory_order_relaxed);
+}
+
+void Histogram::collect(std::array<std::uint64_t, Buckets> &counts,
+                        std::uint64_t &sum) const noexcept {
+  for (std::size_t i = 0; i < Buckets; i++) {
+    counts[i] += this->counts[i].load(std::memory_order_relaxed);
+  }
+  sum += this->sum.load(std::memory_order_relaxed);
+}
+
+std::size_t Histogram::bucketOf(std::uint64_t micros) noexcept {
+  if (micros < 16) {
+    return static_cast<std::size_t>(micros);
+  }
+
+  // the top four bits select the bucket, the first one is always set
+  auto shift = static_cast<std::size_t>(std::bit_width(micros)) - 4;
+  auto bucket = 16 + (shift - 1) * 8 + ((micros >> shift) - 8);
+
+  return std::min<std::size_t>(bucket, Buckets - 1);
+}
+
+std::uint64_t Histogram::lowerBound(std::size_t bucket) noexcept {
+  if (bucket < 16) {
+    return bucket;
+  }
+
+  auto shift = (bucket - 16) / 8 + 1;
+  return static_cast<std::uint64_t>((bucket - 16) % 8 + 8) << shift;
+}
+
+Metrics::Metrics(std::size_t max_routes)
+    : max_routes(max_routes),
+      entries(std::make_unique<RouteEntry[]>(max_routes)),
+      shards(std::max(1u, std::thread::hardware_concurrency())) {
+  // the last slot holds the unmatched requests
+  for (auto &shard : this->shards) {
+    shard.routes =
+        std::make_unique<std::atomic<RouteShard *>[]>(max_routes + 1);
+  }
+}
+
+Metrics::~Metrics() {
+  for (auto &shard : this->shards) {
+    for (std::size_t i = 0; i <= this->max_routes; i++) {
+      delete shard.routes[i].load();
+    }
+  }
+}
+
+void Metrics::request(const Route *route, std::string_view method,
+                      std::string_view prefix, int status,
+                      std::chrono::nanoseconds latency) {
+  auto index = this->find(route, method, prefix);
+  auto &shard = this->local();
+
+  auto *counters = shard.routes[index].load(std::memory_order_acquire);
+  if (counters == nullptr) {
+    auto fresh = std::make_unique<RouteShard>();
+    if (shard.routes[index].compare_exchange_strong(
+            counters, fresh.get(), std::memory_order_acq_rel)) {
+      counters = fresh.release();
+    }
+  }
+
+  counters->latency.record(latency);
+
+  if (status >= 100 && status < 600) {
+    counters->classes[status / 100 - 1].fetch_add(1,
+                                                  std::memory_order_relaxed);
+    shard.statuses[status].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Metrics::phases(const RequestTiming &timing) noexcept {
+  auto &shard = this->local();
+
+  for (std::size_t i = 0; i < PhaseCount; i++) {
+    if (timing.has(static_cast<Phase>(i))) {
+      shard.phases[i].record(timing.get(static_cast<Phase>(i)));
+    }
+  }
+}
+
+void Metrics::transfer(std::size_t received, std::size_t sent) noexcept {
+  auto &shard = this->local();
+  shard.received.fetch_add(received, std::memory_order_relaxed);
+  shard.sent.fetch_add(sent, std::memory_order_relaxed);
+}
+
+void Metrics::connections(std::int64_t delta) noexcept {
+  this->local().connections.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void Metrics::websockets(std::int64_t delta) noexcept {
+  this->local().websockets.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void Metrics::handshake(bool resumed) noexcept {
+  this->local().handshakes[resumed ? 1 : 0].fetch_add(
+      1, std::memory_order_relaxed);
+}
+
+void Metrics::pendingHandshakes(std::int64_t delta) noexcept {
+  this->local().pending_handshakes.fetch_add(delta, std::memory_order_relaxed);
+}
+
+void Metrics::handshakeRejected() noexcept {
+  this->local().rejected_handshakes.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string Metrics::render() const {
+  struct Series {
+    std::string labels;
+    std::array<std::uint64_t, 5> classes{};
+    std::array<std::uint64_t, Histogram::Buckets> counts{};
+    std::uint64_t sum{0};
+  };
+
+  std::vector<Series> series;
+  for (std::size_t i = 0; i <= this->max_routes; i++) {
+    Series route{};
+    bool used{false};
+
+    if (i == this->max_routes) {
+      route.labels = "method=\"\",route=\"unmatched\"";
+    } else if (this->entries[i].ready.load(std::memory_order_acquire)) {
+      route.labels = "method=\"" + label(this->entries[i].method) +
+                     "\",route=\"" + label(this->entries[i].path) + "\"";
+    } else {
+      continue;
+    }
+
+    for (const auto &shard : this->shards) {
+      const auto *counters = shard.routes[i].load(std::memory_order_acquire);
+      if (counters == nullptr) {
+        continue;
+      }
+
+      used = true;
+      counters->latency.collect(route.counts, route.sum);
+      for (std::size_t c = 0; c < route.classes.size(); c++) {
+        route.classes[c] +=
+            counters->classes[c].load(std::memory_order_relaxed);
+      }
+    }
+
+    if (used) {
+      series.push_back(std::move(route));
+    }
+  }
+
+  std::array<std::uint64_t, 600> statuses{};
+  std::uint64_t received{0};
+  std::uint64_t sent{0};
+  std::int64_t connections{0};
+  std::int64_t websockets{0};
+  std::array<std::uint64_t, 2> handshakes{};
+  std::int64_t pending_handshakes{0};
+  std::uint64_t rejected_handshakes{0};
+
+  for (const auto &shard : this->shards) {
+    for (std::size_t code = 0; code < statuses.size(); code++) {
+      statuses[code] += shard.statuses[code].load(std::memory_order_relaxed);
+    }
+    received += shard.received.load(std::memory_order_relaxed);
+    sent += shard.sent.load(std::memory_order_relaxed);
+    connections += shard.connections.load(std::memory_order_relaxed);
+    websockets += shard.websockets.load(std::memory_order_relaxed);
+    for (std::size_t i = 0; i < handshakes.size(); i++) {
+      handshakes[i] += shard.handshakes[i].load(std::memory_order_relaxed);
+    }
+    pending_handshakes +=
+        shard.pending_handshakes.load(std::memory_order_relaxed);
+    rejected_handshakes +=
+        shard.rejected_handshakes.load(std::memory_order_relaxed);
+  }
+
+  std::string out;
+
+  out += "# HELP webli_requests_total Requests by route and status class.\n"
+         "# TYPE webli_requests_total counter\n";
+  for (const auto &route : series) {
+    for (std::size_t c = 0; c < route.classes.size(); c++) {
+      if (route.classes[c] == 0) {
+        continue;
+      }
+
+      out += "webli_requests_total{" + route.labels + ",class=\"" +
+             std::to_string(c + 1) + "xx\"} " +
+             std::to_string(route.classes[c]) + "\n";
+    }
+  }
+
+  out += "# HELP webli_request_duration_seconds Handler latency by route.\n"
+         "# TYPE webli_request_duration_seconds histogram\n";
+  for (const auto &route : series) {
+    appendHistogram(out, "webli_request_duration_seconds", route.labels,
+                    route.counts, route.sum);
+  }
+
+  out += "# HELP webli_request_phase_seconds Time per request phase.\n"
+         "# TYPE webli_request_phase_seconds histogram\n";
+  for (std::size_t i = 0; i < PhaseCount; i++) {
+    std::array<std::uint64_t, Histogram::Buckets> counts{};
+    std::uint64_t sum{0};
+
+    for (const auto &shard : this->shards) {
+      shard.phases[i].collect(counts, sum);
+    }
+
+    appendHistogram(out, "webli_request_phase_seconds",
+                    "phase=\"" +
+                        std::string(RequestTiming::name(static_cast<Phase>(i))) +
+                        "\"",
+                    counts, sum);
+  }
+
+  out += "# HELP webli_responses_total Responses by status code.\n"
+         "# TYPE webli_responses_total counter\n";
+  for (std::size_t code = 0; code < statuses.size(); code++) {
+    if (statuses[code] != 0) {
+      out += "webli_responses_total{code=\"" + std::to_string(code) + "\"} " +
+             std::to_string(statuses[code]) + "\n";
+    }
+  }
+
+  out += "# HELP webli_received_bytes_total Request bytes.\n"
+         "# TYPE webli_received_bytes_total counter\n"
+         "webli_received_bytes_total " +
+         std::to_string(received) + "\n";
+  out += "# HELP webli_sent_bytes_total Response bytes.\n"
+         "# TYPE webli_sent_bytes_total counter\n"
+         "webli_sent_bytes_total " +
+         std::to_string(sent) + "\n";
+  out += "# HELP webli_open_connections Open connections.\n"
+         "# TYPE webli_open_connections gauge\n"
+         "webli_open_connections " +
+         std::to_string(connections) + "\n";
+  out += "# HELP webli_open_websockets Open websockets.\n"
+         "# TYPE webli_open_websockets gauge\n"
+         "webli_open_websockets " +
+         std::to_string(websockets) + "\n";
+  out += "# HELP webli_tls_handshakes_total TLS handshakes by resumption.\n"
+         "# TYPE webli_tls_handshakes_total counter\n"
+         "webli_tls_handshakes_total{resumed=\"false\"} " +
+         std::to_string(handshakes[0]) +
+         "\n"
+         "webli_tls_handshakes_total{resumed=\"true\"} " +
+         std::to_string(handshakes[1]) + "\n";
+  out += "# HELP webli_tls_handshakes_pending Handshakes waiting for a "
+         "handshake thread.\n"
+         "# TYPE webli_tls_handshakes_pending gauge\n"
+         "webli_tls_handshakes_pending " +
+         std::to_string(pending_handshakes) + "\n";
+  out += "# HELP webli_tls_handshakes_rejected_total Connections closed "
+         "because too many handshakes waited.\n"
+         "# TYPE webli_tls_handshakes_rejected_total counter\n"
+         "webli_tls_handshakes_rejected_total " +
+         std::to_string(rejected_handshakes) + "\n";
+
+  // the pools belong to the threads, not to the shards or the server
+  static constexpr std::array<const char *, PoolKindCount> kinds{
+      "buffer", "request", "response"};
+  auto pools = BufferPool::stats();
+
+  out += "# HELP webli_pool_hits_total Buffers and objects reused from a "
+         "thread pool, for the whole process.\n"
+         "# TYPE webli_pool_hits_total counter\n";
+  for (std::size_t kind = 0; kind < PoolKindCount; kind++) {
+    out += std::string("webli_pool_hits_total{kind=\"") + kinds[kind] +
+           "\"} " + std::to_string(pools.hits[kind]) + "\n";
+  }
+
+  out += "# HELP webli_pool_misses_total Buffers and objects allocated "
+         "because a thread pool was empty, for the whole process.\n"
+         "# TYPE webli_pool_misses_total counter\n";
+  for (std::size_t kind = 0; kind < PoolKindCount; kind++) {
+    out += std::string("webli_pool_misses_total{kind=\"") + kinds[kind] +
+           "\"} " + std::to_string(pools.misses[kind]) + "\n";
+  }
+
+  return out;
+}
+
+Metrics::Shard &Metrics::local() noexcept {
+  int cpu = sched_getcpu();
+  return this->shards[static_cast<std::size_t>(std::max(cpu, 0)) %
+                      this->shards.size()];
+}
+
+std::size_t Metrics::find(const Route *route, std::string_view method,
+                          std::string_view prefix) {
+  if (route == nullptr || this->max_routes == 0) {
+    return this->max_routes;
+  }
+
+  auto hash = std::hash<const Route *>{}(route);
+  for (std::size_t probe = 0; probe < this->max_routes; probe++) {
+    auto index = (hash + probe) % this->max_routes;
+    auto &entry = this->entries[index];
+
+    const Route *owner = entry.route.load(std::memory_order_acquire);
+    if (owner == nullptr &&
+        entry.route.compare_exchange_strong(owner, route,
+                                            std::memory_order_acq_rel)) {
+      entry.method = method;
+      entry.path = std::string(prefix) + route->path;
+      entry.ready.store(true, std::memory_order_release);
+      return index;
+    }
+
+    if (owner == route) {
+      return index;
+    }
+  }
+
+  return this->max_routes;
+}
+} // namespace W
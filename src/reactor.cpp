@@ -0,0 +1,67 @@
+// Copyright 2024 Mina
+
+#include <webli/exceptions.hpp>
+#include <webli/reactor.hpp>
+
+#include <cstdio>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace W {
+Reactor::Reactor() : wakefd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+  if (this->wakefd == -1) {
+    perror("[Webli] Reactor");
+    throw Exception("Reactor setup failed");
+  }
+}
+
+Reactor::~Reactor() { ::close(this->wakefd); }
+
+void Reactor::flush(Con &) {}
+
+void Reactor::post(Task task) {
+  {
+    std::lock_guard guard(this->queue_lock);
+    this->queue.push_back(std::move(task));
+  }
+
+  std::uint64_t one = 1;
+  [[maybe_unused]] auto ret = ::write(this->wakefd, &one, sizeof(one));
+}
+
+void Reactor::execute(Job job) { this->post(std::move(job)); }
+
+void Reactor::stop() {
+  this->running = false;
+
+  std::uint64_t one = 1;
+  [[maybe_unused]] auto ret = ::write(this->wakefd, &one, sizeof(one));
+}
+
+Reactor::TimerId Reactor::after(std::chrono::milliseconds delay, Task task) {
+  return this->timers.add(std::chrono::steady_clock::now() + delay,
+                          std::move(task));
+}
+
+void Reactor::cancel(TimerId id) noexcept { this->timers.cancel(id); }
+
+void Reactor::runPosted() {
+  std::vector<Task> tasks;
+  {
+    std::lock_guard guard(this->queue_lock);
+    tasks.swap(this->queue);
+  }
+
+  for (auto &task : tasks) {
+    task();
+  }
+}
+
+void Reactor::runTimers() {
+  this->timers.advance(std::chrono::steady_clock::now());
+}
+
+int Reactor::timeout() const noexcept {
+  return this->timers.timeout(std::chrono::steady_clock::now());
+}
+} // namespace W
@@ -0,0 +1,211 @@
+// Copyright 2024 Mina
+
+#include <webli/request_parser.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <strings.h>
+
+namespace W::Http {
+/**
+ * @brief check if a character may be part of a token (RFC 9110 5.6.2), the
+ * method and field names
+ *
+ * @param c character
+ * @return true
+ * @return false
+ */
+static bool isToken(char c) noexcept {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+         (c >= 'A' && c <= 'Z') ||
+         (c != '\0' && std::strchr("!#$%&'*+-.^_`|~", c) != nullptr);
+}
+
+/**
+ * @brief check if a string is a non-empty token
+ *
+ * @param value value
+ * @return true
+ * @return false
+ */
+static bool isToken(std::string_view value) noexcept {
+  return !value.empty() &&
+         std::all_of(value.begin(), value.end(),
+                     [](char c) { return isToken(c); });
+}
+
+RequestParser::Status RequestParser::parse(std::string_view data) {
+  this->data = data;
+
+  while (this->stage == Stage::RequestLine || this->stage == Stage::Fields) {
+    // a lone LF ends a line too, a CR before it is dropped (RFC 9112 2.2)
+    auto end = data.find('\n', std::max(this->scanned, this->line));
+    if (end == std::string_view::npos) {
+      this->scanned = data.size();
+      return Status::Incomplete;
+    }
+
+    Span current{this->line, end - this->line};
+    if (current.size > 0 && data[end - 1] == '\r') {
+      current.size--;
+    }
+    this->line = end + 1;
+    this->scanned = this->line;
+
+    if (this->stage == Stage::RequestLine) {
+      // empty lines before the request line are skipped (RFC 9112 2.2)
+      if (current.size == 0) {
+        continue;
+      }
+
+      this->stage =
+          this->requestLine(current) ? Stage::Fields : Stage::Invalid;
+      continue;
+    }
+
+    if (current.size == 0) {
+      this->head_size = this->line;
+      this->stage = Stage::Done;
+      break;
+    }
+
+    if (!this->field(current)) {
+      this->stage = Stage::Invalid;
+    }
+  }
+
+  if (this->stage == Stage::Invalid) {
+    return Status::Invalid;
+  }
+
+  // the views point into the bytes of this call
+  this->headers.clear();
+  for (const auto &[key, value] : this->fields) {
+    this->headers.push_back({this->view(key), this->view(value)});
+  }
+
+  return Status::Done;
+}
+
+void RequestParser::reset() noexcept {
+  this->data = {};
+  this->stage = Stage::RequestLine;
+  this->line = 0;
+  this->scanned = 0;
+  this->head_size = 0;
+  this->method = {};
+  this->path = {};
+  this->version = {};
+  this->fields.clear();
+  this->headers.clear();
+}
+
+std::size_t RequestParser::getHeadSize() const noexcept {
+  return this->head_size;
+}
+
+std::string_view RequestParser::getMethod() const noexcept {
+  return this->view(this->method);
+}
+
+std::string_view RequestParser::getPath() const noexcept {
+  return this->view(this->path);
+}
+
+std::string_view RequestParser::getVersion() const noexcept {
+  return this->view(this->version);
+}
+
+const std::vector<HeaderView> &RequestParser::getHeaders() const noexcept {
+  return this->headers;
+}
+
+std::string_view RequestParser::getHeader(std::string_view key) const noexcept {
+  for (const auto &header : this->headers) {
+    if (header.key.size() == key.size() &&
+        strncasecmp(header.key.data(), key.data(), key.size()) == 0) {
+      return header.value;
+    }
+  }
+
+  return {};
+}
+
+std::string_view RequestParser::getBody() const noexcept {
+  auto length = this->getHeader("Content-Length");
+
+  std::size_t size{0};
+  auto [ptr, error] =
+      std::from_chars(length.data(), length.data() + length.size(), size);
+  if (length.empty() || error != std::errc() ||
+      ptr != length.data() + length.size()) {
+    return {};
+  }
+
+  auto body = this->data.substr(this->head_size);
+  return body.substr(0, size);
+}
+
+bool RequestParser::requestLine(Span line) {
+  auto text = this->view(line);
+
+  auto method_end = text.find(' ');
+  auto path_end = text.find(' ', method_end + 1);
+  if (method_end == std::string_view::npos ||
+      path_end == std::string_view::npos) {
+    return false;
+  }
+
+  this->method = {line.pos, method_end};
+  this->path = {line.pos + method_end + 1, path_end - method_end - 1};
+  this->version = {line.pos + path_end + 1, text.size() - path_end - 1};
+
+  auto path_text = this->view(this->path);
+  auto version_text = this->view(this->version);
+
+  return isToken(this->view(this->method)) && !path_text.empty() &&
+         std::none_of(path_text.begin(), path_text.end(),
+                      [](char c) {
+                        return static_cast<unsigned char>(c) <= ' ' ||
+                               c == '\x7f';
+                      }) &&
+         version_text.size() == 8 && version_text.starts_with("HTTP/") &&
+         version_text[5] >= '0' && version_text[5] <= '9' &&
+         version_text[6] == '.' && version_text[7] >= '0' &&
+         version_text[7] <= '9';
+}
+
+bool RequestParser::field(Span line) {
+  auto text = this->view(line);
+
+  // no whitespace before the colon, lines folded onto the previous one
+  // start with some and are refused too (RFC 9112 5)
+  auto colon = text.find(':');
+  if (colon == std::string_view::npos || !isToken(text.substr(0, colon)) ||
+      this->fields.size() >= MaxHeaders) {
+    return false;
+  }
+
+  auto begin = text.find_first_not_of(" \t", colon + 1);
+  auto end = text.find_last_not_of(" \t");
+  Span value{line.pos + line.size, 0};
+  if (begin != std::string_view::npos) {
+    value = {line.pos + begin, end - begin + 1};
+  }
+
+  // a lone line break inside a value could end the field elsewhere
+  auto value_text = this->view(value);
+  if (value_text.find_first_of(std::string_view("\r\n\0", 3)) !=
+      std::string_view::npos) {
+    return false;
+  }
+
+  this->fields.emplace_back(Span{line.pos, colon}, value);
+  return true;
+}
+
+std::string_view RequestParser::view(Span span) const noexcept {
+  return this->data.substr(span.pos, span.size);
+}
+} // namespace W::Http
@@ -0,0 +1,259 @@
+// Copyright 2024 Mina
+
+#include <webli/buffer_pool.hpp>
+#include <webli/exceptions.hpp>
+#include <webli/request_reader.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <strings.h>
+#include <utility>
+
+namespace W {
+/**
+ * @brief strip spaces and tabs around a header value or list element
+ *
+ * @param value value
+ * @return std::string_view
+ */
+static std::string_view trim(std::string_view value) noexcept {
+  auto begin = value.find_first_not_of(" \t");
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+
+  return value.substr(begin, value.find_last_not_of(" \t") - begin + 1);
+}
+
+/**
+ * @brief check if a string equals a lowercase key, ignoring case
+ *
+ * @param value value
+ * @param key key
+ * @return true
+ * @return false
+ */
+static bool equalsIgnoreCase(std::string_view value,
+                             std::string_view key) noexcept {
+  return value.size() == key.size() &&
+         strncasecmp(value.data(), key.data(), key.size()) == 0;
+}
+
+RequestReader::RequestReader(const Router &router, std::size_t max_head,
+                             std::size_t max_body)
+    : router(router), max_head(max_head), max_body(max_body),
+      request(BufferPool::takeRequest()) {}
+
+RequestReader::~RequestReader() {
+  BufferPool::giveRequest(std::move(this->request));
+}
+
+std::size_t RequestReader::feed(std::string_view data, bool early_data) {
+  std::size_t consumed{0};
+
+  while (this->stage != Stage::Done && consumed < data.size()) {
+    auto rest = data.substr(consumed);
+
+    switch (this->stage) {
+    case Stage::Head: {
+      // the head stays in the input until it is complete, so the parser
+      // gets it from its first byte every time
+      auto status = this->parser.parse(rest);
+      if (status == Http::RequestParser::Status::Invalid) {
+        throw WebException::BadRequest();
+      }
+
+      if (status == Http::RequestParser::Status::Incomplete) {
+        if (rest.size() >= this->max_head) {
+          throw WebException::HeaderFieldsTooLarge();
+        }
+        return consumed;
+      }
+
+      auto head_size = this->parser.getHeadSize();
+      if (head_size > this->max_head) {
+        throw WebException::HeaderFieldsTooLarge();
+      }
+
+      this->parseHead(early_data);
+      this->parser.reset();
+      consumed += head_size;
+      break;
+    }
+
+    case Stage::Body:
+    case Stage::ChunkData: {
+      auto size = std::min(this->remaining, rest.size());
+      this->append(rest.substr(0, size));
+      this->remaining -= size;
+      consumed += size;
+
+      if (this->remaining == 0) {
+        this->stage =
+            (this->stage == Stage::Body) ? Stage::Done : Stage::ChunkEnd;
+      }
+      break;
+    }
+
+    case Stage::ChunkSize: {
+      auto end = rest.find("\r\n");
+      if (end == std::string_view::npos) {
+        if (rest.size() >= this->max_head) {
+          throw WebException::BadRequest();
+        }
+        return consumed;
+      }
+
+      // chunk extensions after ';' carry nothing the server uses
+      auto line = rest.substr(0, end);
+      auto digits = trim(line.substr(0, line.find(';')));
+
+      std::size_t size{0};
+      auto [ptr, error] = std::from_chars(
+          digits.data(), digits.data() + digits.size(), size, 16);
+      if (digits.empty() || error != std::errc() ||
+          ptr != digits.data() + digits.size()) {
+        throw WebException::BadRequest();
+      }
+
+      consumed += end + 2;
+      this->remaining = size;
+      this->stage = (size == 0) ? Stage::Trailer : Stage::ChunkData;
+      break;
+    }
+
+    case Stage::ChunkEnd:
+      if (rest.size() < 2) {
+        return consumed;
+      }
+
+      if (!rest.starts_with("\r\n")) {
+        throw WebException::BadRequest();
+      }
+
+      consumed += 2;
+      this->stage = Stage::ChunkSize;
+      break;
+
+    case Stage::Trailer: {
+      auto end = rest.find("\r\n");
+      if (end == std::string_view::npos) {
+        if (rest.size() >= this->max_head) {
+          throw WebException::HeaderFieldsTooLarge();
+        }
+        return consumed;
+      }
+
+      // trailer fields are dropped, the empty line ends the request
+      consumed += end + 2;
+      if (end == 0) {
+        this->stage = Stage::Done;
+      }
+      break;
+    }
+
+    case Stage::Done:
+      break;
+    }
+  }
+
+  return consumed;
+}
+
+bool RequestReader::hasHead() const noexcept {
+  return this->stage != Stage::Head;
+}
+
+bool RequestReader::isDone() const noexcept {
+  return this->stage == Stage::Done;
+}
+
+std::shared_ptr<Http::Request> RequestReader::take() {
+  this->stage = Stage::Head;
+  this->body_handler = nullptr;
+  this->remaining = 0;
+  this->buffered = 0;
+  return std::exchange(this->request, BufferPool::takeRequest());
+}
+
+void RequestReader::parseHead(bool early_data) {
+  this->request->assign(this->parser);
+  this->request->setEarlyData(early_data);
+
+  std::string_view encoding;
+  std::string_view length;
+  bool encoded{false};
+
+  for (const auto &[key, value] : this->parser.getHeaders()) {
+    if (equalsIgnoreCase(key, "transfer-encoding")) {
+      // a proxy in front may join repeated fields or take another one
+      if (encoded) {
+        throw WebException::BadRequest();
+      }
+      encoding = value;
+      encoded = true;
+    } else if (equalsIgnoreCase(key, "content-length")) {
+      // lengths that differ would frame the body in two ways
+      if (!length.empty() && length != value) {
+        throw WebException::BadRequest();
+      }
+      length = value;
+    }
+  }
+
+  // early data may be replayed, it never streams into a route that is not
+  // idempotent
+  if (const auto *route = this->router.findRoute(this->parser.getMethod(),
+                                                 this->parser.getPath());
+      route != nullptr && route->body_handler &&
+      (route->idempotent || !this->request->isEarlyData())) {
+    this->body_handler = &route->body_handler;
+  }
+
+  // chunked is the only coding supported. Next to a length the body could
+  // be framed in two ways, an intermediary reading the other one would see
+  // a smuggled request (RFC 9112 6.3).
+  if (encoded) {
+    if (!length.empty() || !equalsIgnoreCase(trim(encoding), "chunked")) {
+      throw WebException::BadRequest();
+    }
+
+    this->stage = Stage::ChunkSize;
+    return;
+  }
+
+  if (length.empty()) {
+    this->stage = Stage::Done;
+    return;
+  }
+
+  std::size_t size{0};
+  auto [ptr, error] =
+      std::from_chars(length.data(), length.data() + length.size(), size);
+  if (length.empty() || error != std::errc() ||
+      ptr != length.data() + length.size()) {
+    throw WebException::BadRequest();
+  }
+
+  if (this->body_handler == nullptr && size > this->max_body) {
+    throw WebException::PayloadTooLarge();
+  }
+
+  this->remaining = size;
+  this->stage = (size == 0) ? Stage::Done : Stage::Body;
+}
+
+void RequestReader::append(std::string_view data) {
+  if (this->body_handler != nullptr) {
+    (*this->body_handler)(*this->request, data);
+    return;
+  }
+
+  this->buffered += data.size();
+  if (this->buffered > this->max_body) {
+    throw WebException::PayloadTooLarge();
+  }
+
+  this->request->appendBody(data);
+}
+} // namespace W
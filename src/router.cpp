@@ -4,6 +4,16 @@
 #include <string>
 
 namespace W {
+/**
+ * @brief check if a method is safe by definition (RFC 9110)
+ *
+ * @param method http method
+ * @return true for GET, HEAD and OPTIONS
+ */
+static bool isSafe(std::string_view method) noexcept {
+  return method == "GET" || method == "HEAD" || method == "OPTIONS";
+}
+
 void Router::get(std::string_view route, const HttpUserHandler &handler) {
   this->custom("GET", route, handler);
 }
@@ -50,21 +60,73 @@ void Router::del(std::string_view route,
 
 void Router::custom(std::string_view method, std::string_view route,
                     const HttpUserHandler &handler) {
-  this->map[std::string(method) + std::string(route)] = {handler};
+  this->map[std::string(method) + std::string(route)] = {
+      {handler}, isSafe(method), {}, std::string(route)};
+}
+
+void Router::custom(std::string_view method, std::string_view route,
+                    const HttpCoroutineHandler &handler) {
+  this->map[std::string(method) + std::string(route)] = {
+      {handler}, isSafe(method), {}, std::string(route)};
 }
 
 void Router::custom(std::string_view method, std::string_view route,
                     const std::vector<HttpUserHandler> &handler) {
-  this->map[std::string(method) + std::string(route)] = handler;
+  this->map[std::string(method) + std::string(route)] = {
+      {handler.begin(), handler.end()}, isSafe(method), {}, std::string(route)};
+}
+
+void Router::setIdempotent(std::string_view method, std::string_view route,
+                           bool idempotent) {
+  auto it = this->map.find(std::string(method) + std::string(route));
+  if (it == this->map.end()) {
+    throw Exception("Router::setIdempotent: route not registered");
+  }
+
+  it->second.idempotent = idempotent;
+}
+
+void Router::setBodyHandler(std::string_view method, std::string_view route,
+                            const BodyHandler &handler) {
+  auto it = this->map.find(std::string(method) + std::string(route));
+  if (it == this->map.end()) {
+    throw Exception("Router::setBodyHandler: route not registered");
+  }
+
+  it->second.body_handler = handler;
 }
 
 void Router::group(std::string_view route, Router *router) {
   this->groups[std::string(route)] = router;
 }
 
-const std::vector<HttpUserHandler> &
+const Route &Router::getRoute(std::string_view method, std::string_view route,
+                              std::size_t *prefix) const {
+  if (const auto *found = this->findRoute(method, route, prefix)) {
+    return *found;
+  }
+
+  throw WebException::NotFound();
+}
+
+std::vector<HttpUserHandler>
 Router::getHandler(std::string_view method, std::string_view route) const {
+  std::vector<HttpUserHandler> handlers;
+
+  for (const auto &handler : this->getRoute(method, route).handlers) {
+    const auto *plain = std::get_if<HttpUserHandler>(&handler);
+    if (plain == nullptr) {
+      throw Exception("Router::getHandler: route has a coroutine handler");
+    }
+
+    handlers.push_back(*plain);
+  }
+
+  return handlers;
+}
 
+const Route *Router::findRoute(std::string_view method, std::string_view route,
+                               std::size_t *prefix) const {
   std::string_view new_route = route;
 
   for (auto &[group_name, router] : this->groups) {
@@ -73,9 +135,16 @@ Router::getHandler(std::string_view method, std::string_view route) const {
     }
 
     new_route.remove_prefix(group_name.size());
-    auto key = (std::string(method) + std::string(new_route));
 
-    return router->getHandler(method, new_route);
+    const auto *found = router->findRoute(method, new_route, prefix);
+    if (prefix != nullptr) {
+      *prefix += group_name.size();
+    }
+    return found;
+  }
+
+  if (prefix != nullptr) {
+    *prefix = 0;
   }
 
   if (auto get_pos = Http::findGetParameter(new_route);
@@ -83,11 +152,11 @@ Router::getHandler(std::string_view method, std::string_view route) const {
     new_route.remove_suffix(new_route.size() - get_pos);
   }
 
-  if (auto key = (std::string(method) + std::string(new_route));
-      this->map.contains(key)) {
-    return this->map.at(key);
+  if (auto it = this->map.find(std::string(method) + std::string(new_route));
+      it != this->map.end()) {
+    return &it->second;
   }
 
-  throw WebException::NotFound();
+  return nullptr;
 }
 } // namespace W
@@ -2,21 +2,34 @@
 
 #include <webli/router.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
+#include <format>
+#include <fcntl.h>
 #include <iostream>
 #include <memory>
 #include <mutex>
 #include <openssl/err.h>
+#include <poll.h>
 #include <signal.h>
 #include <sstream>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <thread>
 #include <unistd.h>
+#include <variant>
+#include <vector>
 
 #include <webli/exceptions.hpp>
 #include <webli/http.hpp>
 #include <webli/server.hpp>
+#include <webli/session.hpp>
 
 namespace W {
 void sigpipeHandler(int) {
@@ -24,21 +37,218 @@ void sigpipeHandler(int) {
   return;
 }
 
+/** @brief stop descriptor of the listening server, written on signals */
+static volatile sig_atomic_t g_stop_fd{-1};
+
+/** @brief action of SIGINT before the server took it */
+static struct sigaction g_previous_int{};
+
+/** @brief action of SIGTERM before the server took it */
+static struct sigaction g_previous_term{};
+
+void stopHandler(int) {
+  int saved_errno = errno;
+  int fd = g_stop_fd;
+
+  if (fd != -1) {
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto ret = write(fd, &one, sizeof(one));
+  }
+
+  // a second signal gets the previous action, e.g. ends a stuck drain
+  sigaction(SIGINT, &g_previous_int, nullptr);
+  sigaction(SIGTERM, &g_previous_term, nullptr);
+
+  errno = saved_errno;
+}
+
+/**
+ * @brief bound every blocking call of a socket in one direction
+ *
+ * @param sd socket descriptor
+ * @param option SO_RCVTIMEO or SO_SNDTIMEO
+ * @param timeout limit of a single call (0 = unlimited)
+ */
+static void socketTimeout(int sd, int option, std::chrono::seconds timeout) {
+  struct timeval value{};
+  value.tv_sec = timeout.count();
+  setsockopt(sd, SOL_SOCKET, option, &value, sizeof(value));
+}
+
+/**
+ * @brief send the file body of a response, blocks
+ *
+ * @param con connection that can send files
+ * @param resp response with a file body
+ * @throws W::Exception if the file can't be sent completely
+ */
+static void sendFile(Con &con, const Http::Response &resp) {
+  int fd = open(resp.getFile().c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    throw Exception("Can't open response file");
+  }
+
+  struct Close {
+    int fd;
+    ~Close() { close(this->fd); }
+  } closer{fd};
+
+  for (std::size_t sent = 0; sent < resp.getFileSize();) {
+    std::size_t size{0};
+    if (con.sendFileSome(fd, sent, resp.getFileSize() - sent, size) !=
+        IoStatus::Ok) {
+      throw Exception("Write to client failed");
+    }
+    sent += size;
+  }
+}
+
+/**
+ * @brief ALPN callback, h2 wins if the client offers it
+ *
+ * @return int - SSL_TLSEXT_ERR_NOACK if the client knows neither protocol
+ */
+static int selectProtocol(SSL *, const unsigned char **out,
+                          unsigned char *out_size, const unsigned char *in,
+                          unsigned int in_size, void *) {
+  static constexpr unsigned char protocols[] = "\x02h2\x08http/1.1";
+
+  unsigned char *selected{nullptr};
+  if (SSL_select_next_proto(&selected, out_size, protocols,
+                            sizeof(protocols) - 1, in,
+                            in_size) != OPENSSL_NPN_NEGOTIATED) {
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+
+  *out = selected;
+  return SSL_TLSEXT_ERR_OK;
+}
+
 Server::Server(const Router &router, std::size_t buffer_size)
-    : sd(socket(AF_INET, SOCK_STREAM, 0)), buffer_size(buffer_size),
-      router(router), ctx(SSL_CTX_new(TLS_server_method())) {
-  if ((this->sd == -1) || (!(this->ctx))) {
+    : Server(router, ServerOptions{.buffer_size = buffer_size}) {}
+
+Server::Server(const Router &router, const ServerOptions &options)
+    : options(options),
+      admission(options.max_in_flight, options.queue_target,
+                options.queue_interval),
+      router(router), ctx(SSL_CTX_new(TLS_server_method())),
+      access_log(options.access_log, options.slow_request.count() != 0) {
+  if (!(this->ctx)) {
+    perror("[Webli] Server");
+    std::exit(EXIT_FAILURE);
+    __builtin_unreachable();
+  }
+
+  // exists from the start, so `stop` works before `listen` too and makes it
+  // return right away
+  this->stop_fd = eventfd(0, EFD_CLOEXEC);
+  if (this->stop_fd == -1) {
     perror("[Webli] Server");
     std::exit(EXIT_FAILURE);
     __builtin_unreachable();
   }
 
+  // shedding has to stay cheap, so the answer is built only once
+  this->overload.setStatusCode(Http::StatusCode::ServiceUnavailable);
+  this->overload.setHeader(Http::Header::RetryAfter,
+                           std::to_string(this->options.retry_after.count()));
+  this->overload.setHeader(Http::Header::Connection, "close");
+  this->overload.setHeader(Http::Header::ContentLength, "0");
+  this->overload_response = this->overload.build();
+
+  // the pools are process-global, the last server sets their limits
+  BufferPool::configure(this->options.pool_size,
+                        this->options.max_pooled_buffer);
+
+  if (!this->options.metrics_path.empty()) {
+    this->router.get(this->options.metrics_path,
+                     [this](const Http::Request &,
+                            std::shared_ptr<Http::Response> resp) {
+                       resp->setHeader(Http::Header::ContentType,
+                                       "text/plain; version=0.0.4");
+                       resp->setBody(this->metrics.render());
+                     });
+  }
+
+  // non-blocking sessions resume writes with a moved output buffer
+  SSL_CTX_set_mode(this->ctx, SSL_MODE_ENABLE_PARTIAL_WRITE |
+                                  SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+  SSL_CTX_set_options(this->ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+
+  if (this->options.http2.enabled) {
+    SSL_CTX_set_alpn_select_cb(this->ctx, &selectProtocol, nullptr);
+  }
+
+  // connections fall back to userspace tls if the kernel refuses
+  if (this->options.ktls) {
+    SSL_CTX_set_options(this->ctx, SSL_OP_ENABLE_KTLS);
+  }
+
+  const auto &sessions = this->options.tls_sessions;
+  SSL_CTX_set_timeout(this->ctx, static_cast<long>(sessions.lifetime.count()));
+  SSL_CTX_set_session_id_context(
+      this->ctx, reinterpret_cast<const unsigned char *>("webli"), 5);
+
+  if (sessions.tickets) {
+    this->ticket_keys = std::make_unique<TicketKeys>(sessions.lifetime,
+                                                     sessions.ticket_secret);
+    this->ticket_keys->install(this->ctx);
+  } else {
+    // tls 1.3 tickets then only name a session of the cache
+    SSL_CTX_set_options(this->ctx, SSL_OP_NO_TICKET);
+  }
+
+  if (sessions.cache_size != 0) {
+    this->session_cache = std::make_unique<SessionCache>(
+        sessions.cache_size, sessions.cache_shards);
+    this->session_cache->install(this->ctx);
+  } else {
+    // the internal cache has a single lock, tickets carry the session anyway
+    SSL_CTX_set_session_cache_mode(this->ctx, SSL_SESS_CACHE_OFF);
+  }
+
+  // the guard only knows the client hellos of this process, while a shared
+  // secret lets every process sharing it take the same ticket
+  bool shared_tickets = sessions.tickets && !sessions.ticket_secret.empty();
+  if (sessions.max_early_data != 0 && shared_tickets) {
+    std::cerr << "[Webli] early data is off, the replay guard can't cover "
+                 "ticket keys shared through the ticket secret\n";
+  }
+
+  if (sessions.max_early_data != 0 && !shared_tickets) {
+    SSL_CTX_set_max_early_data(this->ctx, sessions.max_early_data);
+    SSL_CTX_set_recv_max_early_data(this->ctx, sessions.max_early_data);
+
+    // the guard replaces single use tickets, which only work with a cache
+    // shared by every server
+    SSL_CTX_set_options(this->ctx, SSL_OP_NO_ANTI_REPLAY);
+    this->early_data_guard =
+        std::make_unique<EarlyDataGuard>(sessions.early_data_window);
+    this->early_data_guard->install(this->ctx);
+  }
+
   // thx to gam3b0y
   signal(SIGPIPE, &sigpipeHandler);
 }
 
 Server::~Server() {
-  close(this->sd);
+  this->restoreSignals();
+
+  // workers may still use the tls context
+  this->handshakes.reset();
+  this->pool.reset();
+
+  for (int sd : this->sds) {
+    close(sd);
+  }
+
+  if (this->stop_fd != -1) {
+    if (g_stop_fd == this->stop_fd) {
+      g_stop_fd = -1;
+    }
+    close(this->stop_fd);
+  }
+
   SSL_CTX_free(this->ctx);
 }
 
@@ -59,79 +269,677 @@ void Server::ssl_config(std::string_view key_path, std::string_view cert_path) {
 }
 
 void Server::listen(std::string_view interface, std::uint16_t port) {
-  int client_sd;
-  unsigned int client_addr_len;
   struct sockaddr_in addr;
 
   addr.sin_family = AF_INET;
   addr.sin_port = htons(port);
   addr.sin_addr.s_addr = inet_addr(interface.data());
 
-  if (bind(this->sd, reinterpret_cast<struct sockaddr *>(&addr),
+  if (!this->options.handoff_path.empty()) {
+    this->handoff = std::make_unique<Handoff>(this->options.handoff_path);
+    this->sds = this->handoff->adopt();
+    if (!this->sds.empty()) {
+      std::cerr << "[Webli] took over " << this->sds.size()
+                << " listening sockets\n";
+    }
+
+    this->handoff->open();
+  }
+
+  // adopted sockets are bound already
+  if (this->sds.empty()) {
+    auto acceptor_count = std::max<std::size_t>(1, this->options.acceptors);
+    for (std::size_t i = 0; i < acceptor_count; i++) {
+      this->sds.push_back(this->openListener(addr));
+    }
+  }
+
+  if (this->options.stop_on_signal) {
+    g_stop_fd = this->stop_fd;
+
+    struct sigaction action{};
+    action.sa_handler = &stopHandler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGINT, &action, &g_previous_int);
+    sigaction(SIGTERM, &action, &g_previous_term);
+    this->signals = true;
+  }
+
+  if (this->options.mode == ServerMode::WorkerPool ||
+      (this->options.mode == ServerMode::EventLoop &&
+       this->options.offload_handlers)) {
+    this->pool = std::make_unique<ThreadPool>(
+        this->options.worker_threads, [this](std::size_t index) {
+          this->place(this->options.worker_placement, index);
+        });
+
+    this->max_idle = this->options.pool_keep_alive != 0
+                         ? this->options.pool_keep_alive
+                         : std::max<std::size_t>(1, this->pool->size() / 2);
+  }
+
+  if (this->options.handshake_threads != 0 &&
+      this->options.transport == Transport::Tls) {
+    this->handshakes =
+        std::make_unique<ThreadPool>(this->options.handshake_threads);
+  }
+
+  if (this->options.mode == ServerMode::EventLoop) {
+    this->runEventLoops();
+    return;
+  }
+
+  {
+    std::jthread watcher(&Server::watch, this);
+
+    // one blocking accept loop per listening socket, the first one runs here
+    std::vector<std::jthread> acceptors;
+    for (std::size_t i = 1; i < this->sds.size(); i++) {
+      acceptors.emplace_back([this, i]() {
+        this->place(this->options.acceptor_placement, i);
+        this->acceptThreads(this->sds[i]);
+      });
+    }
+
+    this->place(this->options.acceptor_placement, 0);
+    this->acceptThreads(this->sds.front());
+  }
+
+  this->drain();
+}
+
+void Server::stop() {
+  this->running = false;
+
+  std::uint64_t one = 1;
+  [[maybe_unused]] auto ret = write(this->stop_fd, &one, sizeof(one));
+}
+
+int Server::openListener(const struct sockaddr_in &addr) const {
+  int sd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int enable = 1;
+
+  if (sd == -1 ||
+      (this->options.acceptors > 1 &&
+       setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) !=
+           0) ||
+      bind(sd, reinterpret_cast<const struct sockaddr *>(&addr),
            sizeof(addr)) != 0 ||
-      ::listen(this->sd, 35) != 0) {
+      ::listen(sd, this->options.backlog) != 0) {
     perror("[Webli] Server::listen");
     std::exit(EXIT_FAILURE);
     __builtin_unreachable();
   }
 
+  return sd;
+}
+
+std::unique_ptr<Con> Server::openConnection(int client_sd,
+                                            struct in_addr address,
+                                            ConMode mode) const {
+  if (this->options.transport == Transport::Tcp) {
+    return std::make_unique<TcpCon>(client_sd, address, mode);
+  }
+
+  return std::make_unique<TlsCon>(client_sd, address, this->ctx, mode);
+}
+
+void Server::place(Placement placement, std::size_t index) const {
+  if (placement == Placement::None) {
+    return;
+  }
+
+  auto cores = Topology::system().select(placement, index, this->options.cores);
+  if (!Topology::pin(cores)) {
+    std::cerr << "[Webli] failed to place thread " << index << "\n";
+  }
+}
+
+void Server::acceptThreads(int sd) {
+  int client_sd;
+  socklen_t client_addr_len;
+  struct sockaddr_in addr;
+
   std::memset(&addr, 0, sizeof(addr));
-  client_addr_len = 0;
+
+  // other acceptors or a handed off process may take the connection poll
+  // announced, accepting must not block then
+  fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) | O_NONBLOCK);
+
+  // the stop descriptor stays readable once signaled
+  std::array<struct pollfd, 2> fds{
+      {{sd, POLLIN, 0}, {this->stop_fd, POLLIN, 0}}};
 
   // we reuse the memory place of our sockaddr structure later
-  while (running) {
-    client_sd = ::accept(this->sd, reinterpret_cast<struct sockaddr *>(&addr),
+  while (this->running) {
+    if (poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno != EINTR) {
+        perror("[Webli] Accept");
+      }
+      continue;
+    }
+
+    if (fds[1].revents != 0) {
+      break;
+    }
+
+    client_addr_len = sizeof(addr);
+    client_sd = ::accept(sd, reinterpret_cast<struct sockaddr *>(&addr),
                          &client_addr_len);
     if (client_sd == -1) {
-      perror("[Webli] Accept");
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        perror("[Webli] Accept");
+      }
+      continue;
+    }
+
+    if (!this->connectionOpened()) {
+      close(client_sd);
+      continue;
+    }
+
+    if (this->handshakes) {
+      if (!this->offloadHandshake([this, client_sd, address = addr.sin_addr]() {
+            this->handshakeApart(client_sd, address);
+          })) {
+        close(client_sd);
+        this->connectionClosed();
+      }
+      continue;
+    }
+
+    auto queued = std::chrono::steady_clock::now();
+
+    if (this->pool) {
+      this->pool->submit([client_sd, address = addr.sin_addr, this, queued]() {
+        Server::handle_con(client_sd, address, this, queued);
+      });
       continue;
     }
 
     // make explicit copy of addr to new thread
-    auto t = std::jthread(Server::handle_con, client_sd, addr.sin_addr, this);
+    auto t = std::jthread(Server::handle_con, client_sd, addr.sin_addr, this,
+                          queued);
     t.detach();
   }
 }
 
-void Server::handle_con(int client_sd, struct in_addr address, Server *server) {
-  auto buffer = std::vector<std::uint8_t>();
-  buffer.resize(server->buffer_size);
-  std::stringstream stream{};
+void Server::runEventLoops() {
+  std::size_t loop_count = this->options.loop_threads;
+  if (loop_count == 0) {
+    loop_count = std::max(1u, std::thread::hardware_concurrency());
+  }
 
-  try {
-    auto con = Con(client_sd, address, server->ctx);
+  bool uring = this->options.io_backend == IoBackend::IoUring;
+  if (uring && !UringLoop::supported()) {
+    std::cerr << "[Webli] io_uring not supported, falling back to epoll\n";
+    uring = false;
+  }
+
+  std::vector<std::unique_ptr<Reactor>> loops;
+  for (std::size_t i = 0; i < loop_count; i++) {
+    if (uring) {
+      loops.push_back(std::make_unique<UringLoop>());
+    } else {
+      loops.push_back(std::make_unique<EventLoop>());
+    }
+  }
+
+  std::size_t next_loop{0};
+
+  // every listening socket lives in one loop. A single socket spreads its
+  // connections round robin, sharded sockets keep them on their own loop
+  // because the kernel already balanced them.
+  for (std::size_t i = 0; i < this->sds.size(); i++) {
+    auto &owner = *loops[i % loops.size()];
+
+    owner.accept(this->sds[i], [this, &owner, &loops,
+                                &next_loop](int client_sd,
+                                            struct in_addr address) {
+      // counted right away, so draining waits for posted connections too
+      if (!this->connectionOpened()) {
+        close(client_sd);
+        return;
+      }
+
+      if (this->sds.size() > 1) {
+        this->startSession(owner, client_sd, address);
+        return;
+      }
+
+      auto &loop = *loops[next_loop++ % loops.size()];
+      loop.post([this, &loop, client_sd, address]() {
+        this->startSession(loop, client_sd, address);
+      });
+    });
+  }
+
+  std::jthread watcher([this, &loops]() {
+    this->watch();
+
+    for (std::size_t i = 0; i < this->sds.size(); i++) {
+      auto &owner = *loops[i % loops.size()];
+      owner.post([&owner, sd = this->sds[i]]() { owner.stopAccept(sd); });
+    }
+
+    this->drain();
+
+    for (auto &loop : loops) {
+      loop->stop();
+    }
+  });
+
+  std::vector<std::jthread> threads;
+  for (std::size_t i = 1; i < loops.size(); i++) {
+    threads.emplace_back([this, i, &loop = *loops[i]]() {
+      this->place(this->options.acceptor_placement, i);
+      loop.run();
+    });
+  }
 
-    con.read(buffer.data(), static_cast<int>(buffer.size()));
-    stream.write(reinterpret_cast<char *>(buffer.data()), buffer.size());
-    buffer.clear();
+  this->place(this->options.acceptor_placement, 0);
+  loops.front()->run();
+}
+
+void Server::startSession(Reactor &loop, int client_sd,
+                          struct in_addr address) {
+  // the session releases the connection slot once it exists
+  bool session{false};
+
+  try {
+    auto con = this->openConnection(client_sd, address, loop.connectionMode());
+    auto started = std::make_shared<Session>(*this, loop, std::move(con));
+    session = true;
+    started->start();
+  } catch (const Exception &e) {
+    std::cerr << e.getMessage() << "\n";
+    if (!session) {
+      this->connectionClosed();
+    }
+  }
+}
 
-    Http::Request req_buffer{stream};
+void Server::watch() {
+  int handoff_sd = this->handoff ? this->handoff->getDescriptor() : -1;
 
-    auto resp_buffer = std::make_shared<Http::Response>();
-    resp_buffer->setStatusCode(Http::StatusCode::Ok);
+  // poll skips the negative descriptor without a handoff socket
+  std::array<struct pollfd, 2> fds{
+      {{this->stop_fd, POLLIN, 0}, {handoff_sd, POLLIN, 0}}};
 
-    try {
-      const auto &handler_vec = server->router.getHandler(
-          req_buffer.getMethod(), req_buffer.getPath());
-      for (const auto &handler : handler_vec) {
-        handler(req_buffer, resp_buffer);
+  while (true) {
+    if (poll(fds.data(), fds.size(), -1) == -1) {
+      if (errno == EINTR) {
+        continue;
       }
-    } catch (WebException::UpgradeToWebsocket &u) {
-      server->handle_ws(con, req_buffer.getPath(), u);
+
+      perror("[Webli] Server::watch");
+      break;
+    }
+
+    if (fds[0].revents != 0) {
+      break;
+    }
+
+    if (fds[1].revents != 0 && this->handoff->serve(this->sds)) {
+      std::cerr << "[Webli] listening sockets handed off, draining\n";
+      break;
+    }
+  }
+
+  this->restoreSignals();
+  this->closeWebsockets();
+
+  // wakes the accept loops on a handoff
+  this->stop();
+}
+
+void Server::drain() {
+  for (auto open = this->connections.load(); open != 0;
+       open = this->connections.load()) {
+    this->connections.wait(open);
+  }
+}
+
+void Server::restoreSignals() noexcept {
+  if (!this->signals) {
+    return;
+  }
+
+  sigaction(SIGINT, &g_previous_int, nullptr);
+  sigaction(SIGTERM, &g_previous_term, nullptr);
+  this->signals = false;
+}
+
+void Server::websocketOpened(int sd) {
+  std::lock_guard lock(this->websockets_mutex);
+  this->websockets.insert(sd);
+
+  if (this->websockets_closed) {
+    shutdown(sd, SHUT_RD);
+  }
+}
+
+void Server::websocketClosed(int sd) noexcept {
+  std::lock_guard lock(this->websockets_mutex);
+  this->websockets.erase(sd);
+}
+
+void Server::closeWebsockets() {
+  std::lock_guard lock(this->websockets_mutex);
+  this->websockets_closed = true;
+
+  // blocked reads see the end of the stream, the websocket still sends its
+  // close frame and ends as if the client left
+  for (int sd : this->websockets) {
+    shutdown(sd, SHUT_RD);
+  }
+}
+
+bool Server::connectionOpened() noexcept {
+  this->metrics.connections(1);
+
+  if (this->connections++ >= this->options.max_connections &&
+      this->options.max_connections != 0) {
+    this->connectionClosed();
+    return false;
+  }
+
+  return true;
+}
+
+void Server::connectionClosed() noexcept {
+  this->metrics.connections(-1);
+
+  if (--this->connections == 0) {
+    this->connections.notify_all();
+  }
+}
+
+void Server::handle_con(int client_sd, struct in_addr address, Server *server,
+                        std::chrono::steady_clock::time_point queued) {
+  // only the first request waited, and only the pool has a queue
+  auto sojourn = server->pool ? std::chrono::steady_clock::now() - queued
+                              : std::chrono::steady_clock::duration::zero();
+
+  RequestTiming timing;
+  timing.start();
+
+  if (auto con = server->handshake(client_sd, address, timing)) {
+    server->serve(std::move(con), timing, sojourn);
+  }
+}
+
+bool Server::reserveIdle() noexcept {
+  if (this->idle_connections++ >= this->max_idle) {
+    this->idle_connections--;
+    return false;
+  }
+
+  return true;
+}
+
+bool Server::offloadHandshake(ThreadPool::Task task) {
+  auto limit = this->options.max_pending_handshakes;
+  if (this->pending_handshakes++ >= limit && limit != 0) {
+    this->pending_handshakes--;
+    this->metrics.handshakeRejected();
+    return false;
+  }
+
+  this->metrics.pendingHandshakes(1);
+  this->handshakes->submit([this, task = std::move(task)]() {
+    this->pending_handshakes--;
+    this->metrics.pendingHandshakes(-1);
+    task();
+  });
+  return true;
+}
+
+std::unique_ptr<Con> Server::handshake(int client_sd, struct in_addr address,
+                                       RequestTiming &timing) {
+  // blocking connections have no timers, the deadlines bound every single
+  // socket call instead and a timed out call ends the connection
+  socketTimeout(client_sd, SO_RCVTIMEO, this->options.handshake_timeout);
+  socketTimeout(client_sd, SO_SNDTIMEO, this->options.handshake_timeout);
+
+  try {
+    auto con = this->openConnection(client_sd, address, ConMode::Blocking);
+    if (this->options.transport == Transport::Tls) {
+      timing.lap(Phase::Handshake);
+      this->metrics.handshake(con->isResumed());
+    }
+    return con;
+  } catch (const Exception &e) {
+    std::cerr << e.getMessage() << "\n";
+  } catch (const std::exception &e) {
+    std::cerr << "std::exception: " << e.what() << "\n";
+  }
+
+  this->connectionClosed();
+  return nullptr;
+}
+
+void Server::handshakeApart(int client_sd, struct in_addr address) {
+  RequestTiming timing;
+  timing.start();
+
+  std::shared_ptr<Con> con = this->handshake(client_sd, address, timing);
+  if (!con) {
+    return;
+  }
+
+  // the connection moves on, so it is closed before its slot is released
+  if (!this->pool) {
+    auto t = std::jthread([this, con = std::move(con), timing]() mutable {
+      this->serve(std::move(con), timing,
+                  std::chrono::steady_clock::duration::zero());
+    });
+    t.detach();
+    return;
+  }
+
+  this->pool->submit([this, con = std::move(con), timing,
+                      queued = std::chrono::steady_clock::now()]() mutable {
+    this->serve(std::move(con), timing,
+                std::chrono::steady_clock::now() - queued);
+  });
+}
+
+void Server::serve(std::shared_ptr<Con> established, RequestTiming timing,
+                   std::chrono::steady_clock::duration sojourn) {
+  // releases the connection slot however the thread ends, after the
+  // connection got closed
+  struct Release {
+    Server *server;
+    ~Release() { this->server->connectionClosed(); }
+  } release{this};
+
+  auto con = std::move(established);
+  int sd = con->getDescriptor();
+
+  try {
+    if (con->getProtocol() == "h2") {
+      socketTimeout(sd, SO_RCVTIMEO, this->options.keep_alive_timeout);
+      socketTimeout(sd, SO_SNDTIMEO, this->options.write_timeout);
+      this->handle_h2(*con, timing);
       return;
-    } catch (WebException::HttpException &e) {
-      *resp_buffer = e.getResponse();
     }
 
-    auto resp_str = resp_buffer->build();
-    con.write(reinterpret_cast<const std::uint8_t *>(resp_str.c_str()),
-              static_cast<int>(resp_str.size()));
+    // the idle time covers the header too, every read of the body gets the
+    // same time
+    socketTimeout(sd, SO_RCVTIMEO,
+                  std::max(this->options.keep_alive_timeout,
+                           this->options.header_timeout));
+    socketTimeout(sd, SO_SNDTIMEO, this->options.write_timeout);
+
+    // pipelined requests wait in the input, their responses in the output
+    PooledBuffer input_buffer;
+    PooledBuffer output_buffer;
+    auto &input = *input_buffer;
+    auto &output = *output_buffer;
+
+    // a body written along fills up the tls record of the output and goes
+    // out from where it is
+    auto flush = [&con, &output](std::string_view body = {}) {
+      con->write(reinterpret_cast<const std::uint8_t *>(output.data()),
+                 static_cast<int>(output.size()));
+      if (!body.empty()) {
+        con->write(reinterpret_cast<const std::uint8_t *>(body.data()),
+                   static_cast<int>(body.size()));
+      }
+      con->flush();
+      output.clear();
+    };
+
+    // the reader takes the input as it arrives, bytes of the next request
+    // stay. A request it cannot read gets its error queued and ends the
+    // connection.
+    RequestReader reader{this->router, this->options.buffer_size,
+                         this->options.max_body_size};
+    bool rejected{false};
+
+    // a pool connection waiting for its next request holds a worker, it
+    // keeps a reserved slot until the request arrived
+    struct Idle {
+      Server *server;
+      bool held{false};
+
+      void release() noexcept {
+        if (this->held) {
+          this->server->idle_connections--;
+          this->held = false;
+        }
+      }
+
+      ~Idle() { this->release(); }
+    } idle{this};
 
-    std::lock_guard guard(server->print_lock);
-    std::cerr << req_buffer.getMethod() << "\t"
-              << static_cast<int>(resp_buffer->getStatusCode()) << " | "
-              << req_buffer.getPath() << "\n";
+    auto next = [&]() {
+      try {
+        input.erase(0, reader.feed(input, con->isEarly()));
+      } catch (WebException::HttpException &e) {
+        output += this->reject(e);
+        rejected = true;
+      }
+      return reader.isDone();
+    };
+
+    for (std::size_t served = 1;; served++) {
+      std::size_t reads{0};
+      while (!next() && !rejected) {
+        auto old_size = input.size();
+        input.resize(old_size + this->options.buffer_size);
+
+        std::size_t read_size{0};
+        auto status = con->readSome(
+            reinterpret_cast<std::uint8_t *>(input.data() + old_size),
+            static_cast<int>(this->options.buffer_size), read_size);
+        input.resize(old_size + read_size);
+
+        // a timeout or a peer closing the idle connection ends it quietly
+        if (status != IoStatus::Ok) {
+          return;
+        }
+        this->metrics.transfer(read_size, 0);
+
+        // waiting for the first bytes belongs to no phase
+        if (old_size == 0 && !reader.hasHead()) {
+          timing.skip();
+        }
+        reads++;
+      }
+
+      idle.release();
 
+      if (rejected) {
+        flush();
+        return;
+      }
+
+      if (reads > 1) {
+        timing.lap(Phase::Read);
+      }
+
+      if (!this->admission.admit(served == 1 ? sojourn : sojourn.zero())) {
+        output += this->overload_response;
+        flush();
+        return;
+      }
+
+      auto request = reader.take();
+      const auto &req_buffer = *request;
+      timing.lap(Phase::Parse);
+
+      auto resp_buffer = BufferPool::takeResponse();
+
+      try {
+        this->route(req_buffer, resp_buffer, timing).get();
+      } catch (WebException::UpgradeToWebsocket &u) {
+        this->admission.release();
+        if (!output.empty()) {
+          flush();
+        }
+        this->handle_ws(*con, req_buffer.getPath(), u, timing);
+        return;
+      } catch (...) {
+        this->admission.release();
+        throw;
+      }
+      this->admission.release();
+
+      if (!resp_buffer->getFile().empty() && !con->canSendFile()) {
+        resp_buffer->loadFile();
+      }
+
+      if (this->pool) {
+        idle.held = this->reserveIdle();
+      }
+
+      bool keep_alive = this->keepAlive(req_buffer, *resp_buffer, served,
+                                        !this->pool || idle.held);
+      if (!keep_alive) {
+        idle.release();
+      }
+
+      auto head = resp_buffer->buildHead();
+      const auto &body = resp_buffer->getBody();
+      auto sent = head.size() + body.size() + resp_buffer->getFileSize();
+      output += head;
+      this->metrics.transfer(0, sent);
+
+      // responses to pipelined requests go out together once no complete
+      // request is left, in as few tls records as possible. Bodies larger
+      // than a record are not copied, file bodies follow their head straight
+      // from the page cache.
+      if (!resp_buffer->getFile().empty()) {
+        flush();
+        sendFile(*con, *resp_buffer);
+      } else if (body.size() > Con::BufferSize) {
+        flush(body);
+      } else {
+        output += body;
+        if (!keep_alive || !next()) {
+          flush();
+        }
+      }
+
+      timing.lap(Phase::Write);
+      this->requestDone(timing, req_buffer.getMethod(), req_buffer.getPath());
+
+      this->access_log.record(
+          con->getAddress(), req_buffer.getMethod(), req_buffer.getPath(),
+          static_cast<int>(resp_buffer->getStatusCode()), sent);
+
+      BufferPool::giveRequest(std::move(request));
+      BufferPool::giveResponse(std::move(resp_buffer));
+
+      if (!keep_alive || rejected) {
+        return;
+      }
+      timing.start();
+    }
   } catch (const Exception &e) {
     std::cerr << e.getMessage() << "\n";
   } catch (const std::exception &e) {
@@ -140,15 +948,33 @@ void Server::handle_con(int client_sd, struct in_addr address, Server *server) {
 }
 
 void Server::handle_ws(const Con &con, std::string_view path,
-                       WebException::UpgradeToWebsocket &e) {
+                       WebException::UpgradeToWebsocket &e,
+                       RequestTiming timing) {
+  // a websocket waits for its client, stop has to shut it down
+  this->websocketOpened(con.getDescriptor());
+  struct Tracked {
+    Server *server;
+    int sd;
+    ~Tracked() { this->server->websocketClosed(this->sd); }
+  } tracked{this, con.getDescriptor()};
+
+  socketTimeout(con.getDescriptor(), SO_RCVTIMEO,
+                this->options.websocket_timeout);
+  socketTimeout(con.getDescriptor(), SO_SNDTIMEO, this->options.write_timeout);
+
   auto resp_str = e.getResponse().build();
   con.write(reinterpret_cast<const std::uint8_t *>(resp_str.c_str()),
             static_cast<int>(resp_str.size()));
+  con.flush();
+  this->metrics.transfer(0, resp_str.size());
+
+  // the upgrade request ends here, the websocket itself is not timed
+  timing.lap(Phase::Write);
+  this->requestDone(timing, "GET", path);
 
-  std::unique_lock guard(this->print_lock);
-  std::cerr << "WSS\t" << static_cast<int>(e.getResponse().getStatusCode())
-            << " | " << path << "\n";
-  guard.unlock();
+  this->access_log.record(con.getAddress(), "GET", path,
+                          static_cast<int>(e.getResponse().getStatusCode()),
+                          resp_str.size(), true);
 
   auto ws = std::make_shared<WebsocketConnection>(con, e.getHandler());
 
@@ -159,10 +985,210 @@ void Server::handle_ws(const Con &con, std::string_view path,
     return;
   }
 
+  this->metrics.websockets(1);
   ws->process();
+  this->metrics.websockets(-1);
 
   if (const auto &close_handler = e.getCloseHandler()) {
     close_handler();
   }
 }
+
+void Server::handle_h2(Con &con, RequestTiming timing) {
+  Http2Connection h2{this->options.http2};
+  auto buffer = std::vector<std::uint8_t>(this->options.buffer_size);
+
+  auto flush = [this, &con, &h2]() {
+    auto output = h2.takeOutput();
+    if (output.empty()) {
+      return;
+    }
+
+    con.write(reinterpret_cast<const std::uint8_t *>(output.data()),
+              static_cast<int>(output.size()));
+    con.flush();
+    this->metrics.transfer(0, output.size());
+  };
+
+  // the server preface goes out before the client preface arrives
+  flush();
+
+  for (bool first = true; !h2.isDone();) {
+    std::size_t read_size{0};
+    auto status = con.readSome(buffer.data(), static_cast<int>(buffer.size()),
+                               read_size);
+
+    // a timeout or a peer closing the idle connection ends it quietly
+    if (status != IoStatus::Ok) {
+      return;
+    }
+    this->metrics.transfer(read_size, 0);
+
+    bool alive = h2.receive(
+        {reinterpret_cast<const char *>(buffer.data()), read_size});
+
+    while (auto next = h2.next()) {
+      auto &[stream, req] = *next;
+
+      // the handshake belongs to the first request, waiting to no one
+      if (first) {
+        timing.skip();
+        first = false;
+      } else {
+        timing.start();
+      }
+
+      if (!this->admission.admit(std::chrono::steady_clock::duration{})) {
+        h2.respond(stream, this->overload);
+        flush();
+        continue;
+      }
+
+      auto resp = std::make_shared<Http::Response>();
+      resp->setStatusCode(Http::StatusCode::Ok);
+      req.setEarlyData(con.isEarly());
+
+      try {
+        this->route(req, resp, timing).get();
+      } catch (WebException::UpgradeToWebsocket &) {
+        // websockets need a HTTP/1.1 connection of their own
+        this->admission.release();
+        h2.reset(stream, Http2Error::Http11Required);
+        flush();
+        continue;
+      } catch (...) {
+        this->admission.release();
+        throw;
+      }
+      this->admission.release();
+
+      auto status = static_cast<int>(resp->getStatusCode());
+      auto size = resp->getBody().size();
+      h2.respond(stream, std::move(*resp));
+      flush();
+
+      timing.lap(Phase::Write);
+      this->requestDone(timing, req.getMethod(), req.getPath());
+
+      this->access_log.record(con.getAddress(), req.getMethod(), req.getPath(),
+                              status, size);
+    }
+
+    // settings, pings and window updates get answered too
+    flush();
+
+    if (!alive) {
+      return;
+    }
+  }
+}
+
+Task<> Server::route(const Http::Request &req,
+                     std::shared_ptr<Http::Response> resp,
+                     RequestTiming &timing) {
+  auto started = std::chrono::steady_clock::now();
+  const Route *matched{nullptr};
+  std::size_t prefix{0};
+
+  // series are labelled with the route, not with the path the client sent
+  auto record = [this, &req, &matched, &prefix, &timing, started](int status) {
+    // a failed lookup never reached the handlers
+    timing.lap(matched != nullptr ? Phase::Handler : Phase::Route);
+    this->metrics.request(matched, req.getMethod(),
+                          std::string_view(req.getPath()).substr(0, prefix),
+                          status, std::chrono::steady_clock::now() - started);
+  };
+
+  try {
+    const auto &route =
+        this->router.getRoute(req.getMethod(), req.getPath(), &prefix);
+    timing.lap(Phase::Route);
+    matched = &route;
+
+    // early data may be a replay, only idempotent routes can take that
+    if (req.isEarlyData() && !route.idempotent) {
+      throw WebException::TooEarly();
+    }
+
+    for (const auto &handler : route.handlers) {
+      if (const auto *user = std::get_if<HttpUserHandler>(&handler)) {
+        (*user)(req, resp);
+        continue;
+      }
+
+      co_await std::get<HttpCoroutineHandler>(handler)(req, resp);
+    }
+  } catch (WebException::UpgradeToWebsocket &e) {
+    record(static_cast<int>(e.getResponse().getStatusCode()));
+    throw;
+  } catch (WebException::HttpException &e) {
+    *resp = e.getResponse();
+  } catch (...) {
+    record(static_cast<int>(Http::StatusCode::InternalServerError));
+    throw;
+  }
+
+  record(static_cast<int>(resp->getStatusCode()));
+}
+
+void Server::requestDone(const RequestTiming &timing, std::string_view method,
+                         std::string_view path) {
+  this->metrics.phases(timing);
+
+  auto total = timing.total();
+  if (this->options.slow_request.count() == 0 ||
+      total < this->options.slow_request) {
+    return;
+  }
+
+  // the writer of the access log puts it out, a slow stderr must not hold
+  // up the thread serving requests
+  this->access_log.note(
+      std::format("[Webli] slow request {} {} {:.3f}ms ({})\n", method, path,
+                  static_cast<double>(total.count()) / 1e6, timing.describe()));
+}
+
+bool Server::keepAlive(const Http::Request &req, Http::Response &resp,
+                       std::size_t served, bool may_wait) const {
+  auto connection = req.getHeader(Http::Header::Connection);
+  auto equals = [connection](std::string_view value) {
+    return connection.size() == value.size() &&
+           strncasecmp(connection.data(), value.data(), value.size()) == 0;
+  };
+
+  // HTTP/1.1 is persistent by default, HTTP/1.0 has to ask for it, a
+  // stopping server lets its clients go
+  bool keep_alive = this->options.keep_alive && may_wait && this->running &&
+                    served < this->options.max_requests && !equals("close") &&
+                    (req.getVersion() == "HTTP/1.1" || equals("keep-alive"));
+
+  if (!keep_alive) {
+    resp.setHeader(Http::Header::Connection, "close");
+    return false;
+  }
+
+  // the client can only find the next response with a length
+  resp.setHeader(Http::Header::ContentLength,
+                 std::to_string(resp.getFile().empty()
+                                    ? resp.getBody().size()
+                                    : resp.getFileSize()));
+  resp.setHeader(Http::Header::Connection, "keep-alive");
+  resp.setHeader(Http::Header::KeepAlive,
+                 std::format("timeout={}, max={}",
+                             this->options.keep_alive_timeout.count(),
+                             this->options.max_requests - served));
+  return true;
+}
+
+std::string Server::reject(WebException::HttpException &e) {
+  // the rest of the request is unread, so the connection cannot go on
+  auto &resp = e.getResponse();
+  resp.setHeader(Http::Header::Connection, "close");
+  resp.setHeader(Http::Header::ContentLength,
+                 std::to_string(resp.getBody().size()));
+
+  auto resp_str = resp.build();
+  this->metrics.transfer(0, resp_str.size());
+  return resp_str;
+}
 } // namespace W
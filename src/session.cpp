@@ -0,0 +1,727 @@
+// Copyright 2024 Mina
+
+#include <webli/http.hpp>
+#include <webli/server.hpp>
+#include <webli/session.hpp>
+
+#include <chrono>
+#include <exception>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <sys/epoll.h>
+#include <thread>
+#include <unistd.h>
+
+namespace W {
+Session::Session(Server &server, Reactor &loop, std::unique_ptr<Con> con)
+    : server(server), loop(loop), con(std::move(con)),
+      input(BufferPool::takeBuffer()),
+      reader(server.router, server.options.buffer_size,
+             server.options.max_body_size),
+      output(BufferPool::takeBuffer()) {}
+
+Session::~Session() {
+  this->detachFile();
+  BufferPool::giveBuffer(std::move(this->input));
+  BufferPool::giveBuffer(std::move(this->output));
+
+  // an upgraded connection keeps its slot until the websocket thread ends
+  if (!this->upgraded) {
+    this->server.connectionClosed();
+  }
+}
+
+void Session::start() {
+  this->timing.start();
+
+  // plain connections have no handshake, they wait for the first request
+  if (this->server.options.transport == Transport::Tcp) {
+    this->state = State::Reading;
+    this->expect(Deadline::Idle);
+  } else {
+    this->expect(Deadline::Handshake);
+  }
+
+  this->armed = EPOLLIN;
+  this->loop.attach(*this->con, this->armed,
+                    [self = this->shared_from_this()](std::uint32_t) {
+                      self->drive();
+                    });
+}
+
+void Session::drive() {
+  try {
+    while (true) {
+      IoStatus status;
+      std::size_t transferred{0};
+
+      switch (this->state) {
+      case State::Handshake:
+        // memory connections get their records fed by the loop meanwhile
+        if (this->server.handshakes &&
+            this->loop.connectionMode() == ConMode::NonBlocking) {
+          this->handshake();
+          return;
+        }
+
+        status = this->con->accept();
+        if (status == IoStatus::Ok) {
+          this->established();
+          continue;
+        }
+        break;
+
+      case State::Handshaking:
+        // a hangup reported while the handshake pool has the connection
+        return;
+
+      case State::Reading: {
+        if (this->nextRequest()) {
+          // handlers run as long as they need
+          this->expect(Deadline::None);
+          this->process();
+          continue;
+        }
+
+        if (this->state != State::Reading) {
+          continue;
+        }
+
+        // the first byte ends the idle time, the head ends the header time
+        if (this->reader.hasHead()) {
+          this->expect(Deadline::Body);
+        } else if (!this->input.empty()) {
+          this->expect(Deadline::Header);
+        }
+
+        // readiness means the first bytes arrived, waiting for them belongs to
+        // no phase
+        auto old_size = this->input.size();
+        if (old_size == 0 && !this->reader.hasHead()) {
+          this->timing.skip();
+        }
+
+        this->input.resize(old_size + this->server.options.buffer_size);
+
+        status = this->con->readSome(
+            reinterpret_cast<std::uint8_t *>(this->input.data() + old_size),
+            static_cast<int>(this->server.options.buffer_size), transferred);
+
+        this->input.resize(old_size + transferred);
+        if (status == IoStatus::Ok) {
+          continue;
+        }
+        break;
+      }
+
+      case State::Processing:
+        // the worker pool resumes the session when the handler is done
+        this->loop.flush(*this->con);
+        return;
+
+      case State::Writing:
+        this->expect(Deadline::Write);
+
+        if (this->output_pos < this->output.size()) {
+          status = this->con->writeSome(
+              reinterpret_cast<const std::uint8_t *>(this->output.data() +
+                                                     this->output_pos),
+              static_cast<int>(this->output.size() - this->output_pos),
+              transferred);
+
+          if (status != IoStatus::Ok) {
+            break;
+          }
+
+          this->output_pos += transferred;
+          continue;
+        }
+
+        if (this->body_pos < this->body.size()) {
+          status = this->con->writeSome(
+              reinterpret_cast<const std::uint8_t *>(this->body.data() +
+                                                     this->body_pos),
+              static_cast<int>(this->body.size() - this->body_pos),
+              transferred);
+
+          if (status != IoStatus::Ok) {
+            break;
+          }
+
+          this->body_pos += transferred;
+          continue;
+        }
+
+        // file bodies follow their head straight from the page cache
+        if (this->file_pos < this->file_size) {
+          status = this->con->sendFileSome(this->file, this->file_pos,
+                                           this->file_size - this->file_pos,
+                                           transferred);
+
+          if (status != IoStatus::Ok) {
+            break;
+          }
+
+          this->file_pos += transferred;
+          continue;
+        }
+        this->detachFile();
+
+        if (this->request) {
+          this->timing.lap(Phase::Write);
+          this->server.requestDone(this->timing, this->request->getMethod(),
+                                   this->request->getPath());
+          this->recycle();
+        }
+        this->timing.start();
+
+        if (!this->keep_alive) {
+          this->close();
+          return;
+        }
+
+        this->output.clear();
+        this->output_pos = 0;
+        this->body.clear();
+        this->body_pos = 0;
+        this->state = State::Reading;
+        this->expect(Deadline::Idle);
+        continue;
+
+      case State::Multiplexing: {
+        // frames go out before more get read, the client waits for them
+        this->output += this->h2->takeOutput();
+
+        if (this->output_pos < this->output.size()) {
+          this->expect(Deadline::Write);
+
+          status = this->con->writeSome(
+              reinterpret_cast<const std::uint8_t *>(this->output.data() +
+                                                     this->output_pos),
+              static_cast<int>(this->output.size() - this->output_pos),
+              transferred);
+
+          if (status != IoStatus::Ok) {
+            break;
+          }
+
+          this->server.metrics.transfer(0, transferred);
+          this->output_pos += transferred;
+          if (this->output_pos == this->output.size()) {
+            this->output.clear();
+            this->output_pos = 0;
+          }
+          continue;
+        }
+
+        if (this->h2->isDone()) {
+          this->close();
+          return;
+        }
+
+        // streams in their handlers keep the connection busy, not idle
+        this->expect(this->h2->getActiveStreams() == 0 ? Deadline::Idle
+                                                       : Deadline::None);
+
+        this->input.resize(this->server.options.buffer_size);
+        status = this->con->readSome(
+            reinterpret_cast<std::uint8_t *>(this->input.data()),
+            static_cast<int>(this->input.size()), transferred);
+        this->input.resize(status == IoStatus::Ok ? transferred : 0);
+
+        if (status != IoStatus::Ok) {
+          break;
+        }
+        this->server.metrics.transfer(transferred, 0);
+
+        // a failed connection is done once its GOAWAY is written
+        this->h2->receive(this->input);
+        this->input.clear();
+
+        while (auto next = this->h2->next()) {
+          this->dispatch(next->first, std::move(next->second));
+        }
+        continue;
+      }
+
+      case State::Closed:
+        return;
+      }
+
+      if (status == IoStatus::WantRead) {
+        this->want(EPOLLIN);
+      } else if (status == IoStatus::WantWrite) {
+        this->want(EPOLLOUT);
+      } else {
+        this->close();
+        return;
+      }
+
+      // memory connections only buffered their records so far
+      this->loop.flush(*this->con);
+      return;
+    }
+  } catch (const Exception &e) {
+    std::cerr << e.getMessage() << "\n";
+    this->close();
+  } catch (const std::exception &e) {
+    std::cerr << "std::exception: " << e.what() << "\n";
+    this->close();
+  }
+}
+
+void Session::handshake() {
+  this->state = State::Handshaking;
+  this->want(EPOLLONESHOT);
+
+  auto step = [self = this->shared_from_this()]() {
+    auto status = self->con->accept();
+
+    self->loop.post([self, status]() {
+      // the deadline passed while the step ran
+      if (self->state == State::Closed) {
+        self->loop.close(std::move(self->con));
+        return;
+      }
+
+      self->state = State::Handshake;
+
+      switch (status) {
+      case IoStatus::Ok:
+        self->established();
+        self->drive();
+        return;
+      case IoStatus::WantRead:
+        self->want(EPOLLIN);
+        return;
+      case IoStatus::WantWrite:
+        self->want(EPOLLOUT);
+        return;
+      default:
+        self->close();
+        return;
+      }
+    });
+  };
+
+  if (!this->server.offloadHandshake(step)) {
+    this->state = State::Handshake;
+    this->close();
+  }
+}
+
+void Session::established() {
+  this->timing.lap(Phase::Handshake);
+  this->server.metrics.handshake(this->con->isResumed());
+  this->state = State::Reading;
+  this->expect(Deadline::Idle);
+
+  if (this->con->getProtocol() == "h2") {
+    this->h2 = std::make_unique<Http2Connection>(this->server.options.http2);
+    this->state = State::Multiplexing;
+  }
+}
+
+bool Session::nextRequest() {
+  try {
+    auto size = this->reader.feed(this->input, this->con->isEarly());
+    this->server.metrics.transfer(size, 0);
+    this->input.erase(0, size);
+  } catch (WebException::HttpException &e) {
+    this->reject(e);
+    return false;
+  }
+
+  return this->reader.isDone();
+}
+
+void Session::process() {
+  this->timing.lap(Phase::Read);
+
+  auto req_buffer = this->reader.take();
+  this->timing.lap(Phase::Parse);
+  this->request = req_buffer;
+
+  auto resp_buffer = BufferPool::takeResponse();
+  this->response = resp_buffer;
+
+  // the handlers may finish later, oneshot without events silences hangups
+  // until they are done
+  this->state = State::Processing;
+
+  auto done = [self = this->shared_from_this(), req_buffer,
+               resp_buffer](std::exception_ptr error) {
+    self->server.admission.release();
+
+    if (self->routing) {
+      self->finish(*req_buffer, *resp_buffer, error);
+      return;
+    }
+
+    self->loop.post([self, req_buffer, resp_buffer, error]() {
+      self->finish(*req_buffer, *resp_buffer, error);
+      self->drive();
+    });
+  };
+
+  if (!this->server.pool) {
+    // the loop itself is the queue here, nothing waited for a worker
+    if (!this->server.admission.admit(std::chrono::steady_clock::duration{})) {
+      this->shed();
+      return;
+    }
+
+    this->routing = true;
+    this->server.route(*req_buffer, resp_buffer, this->timing).detach(done);
+    this->routing = false;
+
+    if (this->state == State::Processing) {
+      this->want(EPOLLONESHOT);
+    }
+    return;
+  }
+
+  this->want(EPOLLONESHOT);
+
+  this->server.pool->submit([self = this->shared_from_this(), req_buffer,
+                             resp_buffer, done,
+                             queued = std::chrono::steady_clock::now()]() {
+    if (!self->server.admission.admit(std::chrono::steady_clock::now() -
+                                      queued)) {
+      self->loop.post([self]() {
+        self->shed();
+        self->drive();
+      });
+      return;
+    }
+
+    self->timing.lap(Phase::Queue);
+    self->server.route(*req_buffer, resp_buffer, self->timing).detach(done);
+  });
+}
+
+void Session::dispatch(std::uint32_t stream, Http::Request request) {
+  auto req_buffer = std::make_shared<Http::Request>(std::move(request));
+  req_buffer->setEarlyData(this->con->isEarly());
+  auto resp_buffer = std::make_shared<Http::Response>();
+  resp_buffer->setStatusCode(Http::StatusCode::Ok);
+
+  // streams overlap, so each one gets its own timing
+  auto timing = std::make_shared<RequestTiming>();
+  timing->start();
+
+  auto done = [self = this->shared_from_this(), stream, req_buffer,
+               resp_buffer, timing](std::exception_ptr error) {
+    self->server.admission.release();
+
+    if (self->routing) {
+      self->finishStream(stream, *req_buffer, *resp_buffer, *timing, error);
+      return;
+    }
+
+    self->loop.post([self, stream, req_buffer, resp_buffer, timing, error]() {
+      self->finishStream(stream, *req_buffer, *resp_buffer, *timing, error);
+      self->drive();
+    });
+  };
+
+  if (!this->server.pool) {
+    if (!this->server.admission.admit(std::chrono::steady_clock::duration{})) {
+      this->h2->respond(stream, this->server.overload);
+      return;
+    }
+
+    this->routing = true;
+    this->server.route(*req_buffer, resp_buffer, *timing).detach(done);
+    this->routing = false;
+    return;
+  }
+
+  this->server.pool->submit([self = this->shared_from_this(), stream,
+                             req_buffer, resp_buffer, timing, done,
+                             queued = std::chrono::steady_clock::now()]() {
+    if (!self->server.admission.admit(std::chrono::steady_clock::now() -
+                                      queued)) {
+      self->loop.post([self, stream]() {
+        if (self->state != State::Closed) {
+          self->h2->respond(stream, self->server.overload);
+        }
+        self->drive();
+      });
+      return;
+    }
+
+    timing->lap(Phase::Queue);
+    self->server.route(*req_buffer, resp_buffer, *timing).detach(done);
+  });
+}
+
+void Session::finishStream(std::uint32_t stream, const Http::Request &req,
+                           Http::Response &resp, RequestTiming &timing,
+                           std::exception_ptr error) {
+  if (this->state == State::Closed) {
+    return;
+  }
+
+  if (!error) {
+    auto status = static_cast<int>(resp.getStatusCode());
+    auto size = resp.getBody().size();
+    this->h2->respond(stream, std::move(resp));
+
+    // the body leaves as the flow control windows allow, only its encoding
+    // is timed
+    timing.lap(Phase::Write);
+    this->server.requestDone(timing, req.getMethod(), req.getPath());
+
+    this->server.access_log.record(this->con->getAddress(), req.getMethod(),
+                                   req.getPath(), status, size);
+    return;
+  }
+
+  try {
+    std::rethrow_exception(error);
+  } catch (WebException::UpgradeToWebsocket &) {
+    // websockets need a HTTP/1.1 connection of their own
+    this->h2->reset(stream, Http2Error::Http11Required);
+    return;
+  } catch (const Exception &e) {
+    std::cerr << e.getMessage() << "\n";
+  } catch (const std::exception &e) {
+    std::cerr << "std::exception: " << e.what() << "\n";
+  } catch (...) {
+  }
+
+  // other streams of the connection go on
+  this->h2->reset(stream, Http2Error::InternalError);
+}
+
+void Session::shed() {
+  if (this->state == State::Closed) {
+    return;
+  }
+
+  this->keep_alive = false;
+  this->request.reset();
+  this->response.reset();
+  this->output += this->server.overload_response;
+  this->state = State::Writing;
+}
+
+void Session::reject(WebException::HttpException &e) {
+  if (this->state == State::Closed) {
+    return;
+  }
+
+  // a request read before keeps its place in the output
+  this->keep_alive = false;
+  this->output += this->server.reject(e);
+  this->state = State::Writing;
+}
+
+void Session::finish(const Http::Request &req, Http::Response &resp,
+                     std::exception_ptr error) {
+  if (this->state == State::Closed) {
+    return;
+  }
+
+  if (!error) {
+    this->respond(req, resp);
+    return;
+  }
+
+  try {
+    std::rethrow_exception(error);
+  } catch (WebException::UpgradeToWebsocket &u) {
+    this->upgrade(req.getPath(), u);
+    return;
+  } catch (const Exception &e) {
+    std::cerr << e.getMessage() << "\n";
+  } catch (const std::exception &e) {
+    std::cerr << "std::exception: " << e.what() << "\n";
+  } catch (...) {
+  }
+
+  this->close();
+}
+
+void Session::respond(const Http::Request &req, Http::Response &resp) {
+  this->attachFile(resp);
+  this->keep_alive = this->server.keepAlive(req, resp, ++this->served);
+
+  auto head = resp.buildHead();
+  auto sent = head.size() + resp.getBody().size() + this->file_size;
+  this->output += head;
+  this->server.metrics.transfer(0, sent);
+
+  // bodies larger than a tls record move out of the response, the head and
+  // their start fill the first record
+  if (resp.getBody().size() > Con::BufferSize) {
+    this->body = resp.takeBody();
+
+    auto pending = this->output.size() - this->output_pos;
+    this->body_pos =
+        (pending < Con::BufferSize)
+            ? std::min(this->body.size(), Con::BufferSize - pending)
+            : 0;
+    this->output.append(this->body, 0, this->body_pos);
+  } else {
+    this->output += resp.getBody();
+  }
+
+  this->server.access_log.record(this->con->getAddress(), req.getMethod(),
+                                 req.getPath(),
+                                 static_cast<int>(resp.getStatusCode()), sent);
+
+  // responses to pipelined requests go out together once no complete
+  // request is left, in as few tls records as possible. A file or a large
+  // body ends the batch.
+  if (this->keep_alive && this->file == -1 && this->body.empty() &&
+      this->nextRequest()) {
+    this->timing.lap(Phase::Write);
+    this->server.requestDone(this->timing, req.getMethod(), req.getPath());
+    this->recycle();
+    this->timing.start();
+    this->state = State::Reading;
+    return;
+  }
+
+  this->state = State::Writing;
+}
+
+void Session::recycle() noexcept {
+  // the ones a handler still holds are freed with its last reference
+  BufferPool::giveRequest(std::move(this->request));
+  BufferPool::giveResponse(std::move(this->response));
+}
+
+void Session::attachFile(Http::Response &resp) {
+  if (resp.getFile().empty()) {
+    return;
+  }
+
+  if (this->con->canSendFile()) {
+    this->file = open(resp.getFile().c_str(), O_RDONLY | O_CLOEXEC);
+    if (this->file != -1) {
+      this->file_pos = 0;
+      this->file_size = resp.getFileSize();
+      return;
+    }
+  }
+
+  resp.loadFile();
+}
+
+void Session::detachFile() noexcept {
+  if (this->file == -1) {
+    return;
+  }
+
+  ::close(this->file);
+  this->file = -1;
+  this->file_pos = 0;
+  this->file_size = 0;
+}
+
+void Session::expect(Deadline deadline) {
+  // the timer keeps running while the session stays in the same phase
+  if (this->deadline == deadline) {
+    return;
+  }
+
+  this->loop.cancel(this->deadline_timer);
+  this->deadline = deadline;
+  this->deadline_timer = 0;
+
+  const auto &options = this->server.options;
+  std::chrono::seconds timeout;
+
+  switch (deadline) {
+  case Deadline::None:
+    return;
+  case Deadline::Handshake:
+    timeout = options.handshake_timeout;
+    break;
+  case Deadline::Idle:
+    timeout = options.keep_alive_timeout;
+    break;
+  case Deadline::Header:
+    timeout = options.header_timeout;
+    break;
+  case Deadline::Body:
+    timeout = options.body_timeout;
+    break;
+  case Deadline::Write:
+    timeout = options.write_timeout;
+    break;
+  }
+
+  this->deadline_timer =
+      this->loop.after(timeout, [weak = this->weak_from_this()]() {
+        if (auto self = weak.lock()) {
+          self->close();
+        }
+      });
+}
+
+void Session::upgrade(const std::string &path,
+                      WebException::UpgradeToWebsocket &e) {
+  this->expect(Deadline::None);
+  this->state = State::Closed;
+  this->upgraded = true;
+
+  // websockets keep the blocking connection api, so they leave the loop and
+  // get a thread like in the thread per connection mode. The thread holds
+  // the connection slot, so draining waits for it. It starts once the loop
+  // let go of the connection, bytes still received by the loop wait in it.
+  std::shared_ptr<Con> con = std::move(this->con);
+  this->loop.detach(*con, [server = &this->server, con, path, e,
+                           timing = this->timing]() {
+    int sd = con->getDescriptor();
+    fcntl(sd, F_SETFL, fcntl(sd, F_GETFL) & ~O_NONBLOCK);
+
+    auto t = std::jthread([server, con, path, e, timing]() mutable {
+      try {
+        server->handle_ws(*con, path, e, timing);
+      } catch (const Exception &error) {
+        std::cerr << error.getMessage() << "\n";
+      } catch (const std::exception &error) {
+        std::cerr << "std::exception: " << error.what() << "\n";
+      }
+
+      // closed before its slot is released
+      con.reset();
+      server->connectionClosed();
+    });
+    t.detach();
+  });
+}
+
+void Session::want(std::uint32_t events) {
+  if (this->armed == events) {
+    return;
+  }
+
+  this->armed = events;
+  this->loop.modify(*this->con, events);
+}
+
+void Session::close() {
+  if (this->state == State::Closed) {
+    return;
+  }
+
+  // the handshake pool still works on the connection, it gets closed once
+  // the step is back
+  bool offloaded = this->state == State::Handshaking;
+
+  this->state = State::Closed;
+  this->expect(Deadline::None);
+  this->detachFile();
+
+  if (!offloaded) {
+    this->loop.close(std::move(this->con));
+  }
+}
+} // namespace W
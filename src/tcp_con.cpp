@@ -0,0 +1,184 @@
+// Copyright 2024 Mina
+
+#include <webli/exceptions.hpp>
+#include <webli/tcp_con.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+namespace W {
+TcpCon::TcpCon(int sd, struct in_addr address, ConMode mode)
+    : Con(sd, address, mode) {}
+
+void TcpCon::writeAll(const std::uint8_t *data, int data_size) const {
+  if (this->mode == ConMode::Memory && !this->transmit()) {
+    throw Exception("Write to client failed");
+  }
+
+  for (int sent = 0; sent < data_size;) {
+    auto ret = ::send(this->sd, data + sent, data_size - sent, MSG_NOSIGNAL);
+    if (ret == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (ret <= 0) {
+      throw Exception("Write to client failed");
+    }
+
+    sent += static_cast<int>(ret);
+  }
+}
+
+std::size_t TcpCon::readAvailable(std::uint8_t *buffer,
+                                  int buffer_size) const {
+  // bytes the loop received before go first
+  if (!this->input.empty()) {
+    auto buffered = std::min(this->input.size(),
+                             static_cast<std::size_t>(buffer_size));
+    std::memcpy(buffer, this->input.data(), buffered);
+    this->input.erase(0, buffered);
+    return buffered;
+  }
+
+  ssize_t ret;
+  do {
+    ret = ::recv(this->sd, buffer, buffer_size, 0);
+  } while (ret == -1 && errno == EINTR);
+
+  if (ret <= 0) {
+    throw Exception("Read from client failed");
+  }
+
+  return static_cast<std::size_t>(ret);
+}
+
+IoStatus TcpCon::accept() { return IoStatus::Ok; }
+
+IoStatus TcpCon::readSome(std::uint8_t *buffer, int buffer_size,
+                          std::size_t &read) {
+  if (this->mode == ConMode::Memory) {
+    if (this->input.empty()) {
+      return this->eof ? IoStatus::Closed : IoStatus::WantRead;
+    }
+
+    read = std::min(this->input.size(), static_cast<std::size_t>(buffer_size));
+    std::memcpy(buffer, this->input.data(), read);
+    this->input.erase(0, read);
+    return IoStatus::Ok;
+  }
+
+  ssize_t ret;
+  do {
+    ret = ::recv(this->sd, buffer, buffer_size, 0);
+  } while (ret == -1 && errno == EINTR);
+
+  if (ret <= 0) {
+    return TcpCon::status(ret, IoStatus::WantRead);
+  }
+
+  read = static_cast<std::size_t>(ret);
+  return IoStatus::Ok;
+}
+
+IoStatus TcpCon::writeSome(const std::uint8_t *data, int data_size,
+                           std::size_t &written) {
+  if (this->mode == ConMode::Memory) {
+    this->output.append(reinterpret_cast<const char *>(data), data_size);
+    written = static_cast<std::size_t>(data_size);
+    return IoStatus::Ok;
+  }
+
+  ssize_t ret;
+  do {
+    ret = ::send(this->sd, data, data_size, MSG_NOSIGNAL);
+  } while (ret == -1 && errno == EINTR);
+
+  if (ret <= 0) {
+    return TcpCon::status(ret, IoStatus::WantWrite);
+  }
+
+  written = static_cast<std::size_t>(ret);
+  return IoStatus::Ok;
+}
+
+void TcpCon::feed(const std::uint8_t *data, std::size_t data_size) {
+  this->input.append(reinterpret_cast<const char *>(data), data_size);
+}
+
+void TcpCon::feedEnd() { this->eof = true; }
+
+std::size_t TcpCon::drain(std::uint8_t *buffer, std::size_t buffer_size) {
+  auto size = std::min(this->output.size(), buffer_size);
+  std::memcpy(buffer, this->output.data(), size);
+  this->output.erase(0, size);
+  return size;
+}
+
+std::size_t TcpCon::pending() const noexcept { return this->output.size(); }
+
+bool TcpCon::canSendFile() const noexcept {
+  return this->mode != ConMode::Memory;
+}
+
+IoStatus TcpCon::sendFileSome(int fd, std::size_t offset, std::size_t size,
+                              std::size_t &sent) {
+  auto file_offset = static_cast<off_t>(offset);
+
+  ssize_t ret;
+  do {
+    ret = ::sendfile(this->sd, fd, &file_offset, size);
+  } while (ret == -1 && errno == EINTR);
+
+  // a file that shrank can't fill the announced length anymore
+  if (ret == 0) {
+    return IoStatus::Error;
+  }
+
+  if (ret < 0) {
+    return TcpCon::status(ret, IoStatus::WantWrite);
+  }
+
+  sent = static_cast<std::size_t>(ret);
+  return IoStatus::Ok;
+}
+
+IoStatus TcpCon::status(ssize_t ret, IoStatus blocked) noexcept {
+  if (ret == 0) {
+    return IoStatus::Closed;
+  }
+
+  switch (errno) {
+  case EAGAIN:
+    return blocked;
+
+  case ECONNRESET:
+  case EPIPE:
+    // a peer hanging up is not worth a log line
+    return IoStatus::Closed;
+
+  default:
+    return IoStatus::Error;
+  }
+}
+
+bool TcpCon::transmit() const {
+  while (!this->output.empty()) {
+    auto ret = ::send(this->sd, this->output.data(), this->output.size(),
+                      MSG_NOSIGNAL);
+    if (ret == -1 && errno == EINTR) {
+      continue;
+    }
+
+    if (ret <= 0) {
+      return false;
+    }
+
+    this->output.erase(0, static_cast<std::size_t>(ret));
+  }
+
+  return true;
+}
+} // namespace W
@@ -0,0 +1,137 @@
+// Copyright 2024 Mina
+
+#include <webli/thread_pool.hpp>
+
+#include <algorithm>
+
+namespace W {
+/** @brief pool the current thread works for */
+static thread_local const ThreadPool *g_current_pool{nullptr};
+
+/** @brief worker index of the current thread */
+static thread_local std::size_t g_current_worker{0};
+
+ThreadPool::ThreadPool(std::size_t size, Setup setup) {
+  if (size == 0) {
+    size = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (std::size_t i = 0; i < size; i++) {
+    this->workers.push_back(std::make_unique<Worker>());
+  }
+
+  for (std::size_t i = 0; i < size; i++) {
+    this->threads.emplace_back(
+        [this, i, setup]() { this->work(i, setup); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard guard(this->sleep_lock);
+    this->running = false;
+  }
+
+  this->wakeup.notify_all();
+  this->threads.clear();
+}
+
+void ThreadPool::submit(Task task) {
+  std::size_t index = (g_current_pool == this)
+                          ? g_current_worker
+                          : (this->next++ % this->workers.size());
+
+  // count first, so pending never underflows when the task is taken at once
+  this->pending++;
+
+  {
+    std::lock_guard guard(this->workers[index]->lock);
+    this->workers[index]->tasks.push_back(std::move(task));
+  }
+  this->submitted++;
+
+  // empty critical section so a worker between its check and its wait
+  // can't miss the notification
+  { std::lock_guard guard(this->sleep_lock); }
+  this->wakeup.notify_one();
+}
+
+void ThreadPool::execute(Job job) { this->submit(std::move(job)); }
+
+ThreadPool &ThreadPool::blocking() {
+  // blocking functions mostly wait, so size for concurrency, not for cores
+  static ThreadPool pool{
+      std::max<std::size_t>(64, 4 * std::thread::hardware_concurrency())};
+  return pool;
+}
+
+std::size_t ThreadPool::size() const noexcept { return this->workers.size(); }
+
+void ThreadPool::work(std::size_t index, const Setup &setup) {
+  if (setup) {
+    setup(index);
+  }
+
+  g_current_pool = this;
+  g_current_worker = index;
+  Executor::Scope scope{this};
+
+  Task task;
+  while (true) {
+    auto seen = this->submitted.load();
+
+    // a pass that lost every race for a lock falls back to waiting for them
+    // once, then sleeps until something new gets submitted
+    if (this->take(index, task, false) || this->take(index, task, true)) {
+      this->pending--;
+      task();
+      task = nullptr;
+      continue;
+    }
+
+    std::unique_lock guard(this->sleep_lock);
+    if (!this->running && this->pending == 0) {
+      return;
+    }
+
+    this->wakeup.wait(guard, [this, seen]() {
+      return this->submitted != seen || !this->running;
+    });
+  }
+}
+
+bool ThreadPool::take(std::size_t index, Task &task, bool wait) {
+  {
+    auto &own = *this->workers[index];
+    std::lock_guard guard(own.lock);
+
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+
+  for (std::size_t i = 1; i < this->workers.size(); i++) {
+    auto &victim = *this->workers[(index + i) % this->workers.size()];
+
+    // skip busy victims instead of convoying on their lock
+    std::unique_lock guard(victim.lock, std::defer_lock);
+    if (wait) {
+      guard.lock();
+    } else if (!guard.try_lock()) {
+      continue;
+    }
+
+    if (victim.tasks.empty()) {
+      continue;
+    }
+
+    task = std::move(victim.tasks.back());
+    victim.tasks.pop_back();
+    return true;
+  }
+
+  return false;
+}
+} // namespace W
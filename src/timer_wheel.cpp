@@ -0,0 +1,209 @@
+// Copyright 2024 Mina
+
+#include <webli/timer_wheel.hpp>
+
+#include <algorithm>
+#include <bit>
+
+namespace W {
+TimerWheel::TimerWheel(std::chrono::milliseconds resolution)
+    : resolution(resolution), origin(std::chrono::steady_clock::now()) {
+  this->heads.fill(Nil);
+}
+
+TimerWheel::TimerId TimerWheel::add(std::chrono::steady_clock::time_point deadline,
+                                    Task task) {
+  std::uint32_t index;
+  if (this->free_list != Nil) {
+    index = this->free_list;
+    this->free_list = this->nodes[index].next;
+  } else {
+    index = static_cast<std::uint32_t>(this->nodes.size());
+    this->nodes.emplace_back();
+  }
+
+  auto &node = this->nodes[index];
+  node.task = std::move(task);
+
+  // rounded up, a timer never fires before its deadline
+  auto delay = std::max(deadline - this->origin,
+                        std::chrono::steady_clock::duration::zero());
+  node.expiry = std::max<std::uint64_t>(
+      (delay + this->resolution - std::chrono::steady_clock::duration{1}) /
+          this->resolution,
+      this->current + 1);
+
+  this->schedule(index);
+  this->pending++;
+
+  return (static_cast<TimerId>(node.generation) << 32) | (index + 1ull);
+}
+
+void TimerWheel::cancel(TimerId id) noexcept {
+  auto index = static_cast<std::uint32_t>(id) - 1;
+  if (id == 0 || index >= this->nodes.size() ||
+      this->nodes[index].generation != static_cast<std::uint32_t>(id >> 32) ||
+      this->nodes[index].list == Nil) {
+    return;
+  }
+
+  this->unlink(index);
+  this->release(index);
+}
+
+void TimerWheel::advance(std::chrono::steady_clock::time_point now) {
+  auto target = this->tickOf(now);
+
+  while (this->current < target) {
+    if (this->pending == 0) {
+      this->current = target;
+      return;
+    }
+
+    // nothing happens on the ticks in between
+    this->current = std::min(this->nextEvent(), target);
+
+    // higher wheels first, their timers may land in lower slots cascading
+    // on the same tick
+    for (unsigned level = Levels - 1; level > 0; level--) {
+      unsigned shift = SlotBits * level;
+      if ((this->current & ((1ull << shift) - 1)) == 0) {
+        this->take(level * Slots + ((this->current >> shift) & (Slots - 1)),
+                   Nil);
+      }
+    }
+
+    this->take(this->current & (Slots - 1), Due);
+
+    while (this->heads[Due] != Nil) {
+      auto index = this->heads[Due];
+      this->unlink(index);
+
+      // the slab may grow while the task adds timers
+      auto task = std::move(this->nodes[index].task);
+      this->release(index);
+      task();
+    }
+  }
+}
+
+int TimerWheel::timeout(std::chrono::steady_clock::time_point now) const noexcept {
+  if (this->pending == 0) {
+    return -1;
+  }
+
+  auto at = this->origin +
+            this->resolution * static_cast<std::int64_t>(this->nextEvent());
+  auto delay = std::chrono::ceil<std::chrono::milliseconds>(at - now);
+
+  return static_cast<int>(std::max<std::int64_t>(0, delay.count()));
+}
+
+std::size_t TimerWheel::size() const noexcept { return this->pending; }
+
+std::uint64_t
+TimerWheel::tickOf(std::chrono::steady_clock::time_point time) const {
+  if (time <= this->origin) {
+    return 0;
+  }
+
+  return static_cast<std::uint64_t>((time - this->origin) / this->resolution);
+}
+
+void TimerWheel::schedule(std::uint32_t index) noexcept {
+  static constexpr const std::uint64_t Span = 1ull << (SlotBits * Levels);
+
+  // timers beyond the last wheel wait in its farthest slot and get placed
+  // again once it cascades
+  auto expiry = std::min(this->nodes[index].expiry, this->current + Span - 1);
+  auto delta = expiry - this->current;
+
+  unsigned level = 0;
+  while (level < Levels - 1 && delta >= (1ull << (SlotBits * (level + 1)))) {
+    level++;
+  }
+
+  auto slot = (expiry >> (SlotBits * level)) & (Slots - 1);
+  this->link(index, static_cast<std::uint32_t>(level * Slots + slot));
+}
+
+void TimerWheel::link(std::uint32_t index, std::uint32_t list) noexcept {
+  auto &node = this->nodes[index];
+  node.list = list;
+  node.prev = Nil;
+  node.next = this->heads[list];
+
+  if (node.next != Nil) {
+    this->nodes[node.next].prev = index;
+  }
+  this->heads[list] = index;
+
+  if (list < Due) {
+    this->occupied[list / Slots] |= 1ull << (list % Slots);
+  }
+}
+
+void TimerWheel::unlink(std::uint32_t index) noexcept {
+  auto &node = this->nodes[index];
+
+  if (node.prev != Nil) {
+    this->nodes[node.prev].next = node.next;
+  } else {
+    this->heads[node.list] = node.next;
+  }
+
+  if (node.next != Nil) {
+    this->nodes[node.next].prev = node.prev;
+  }
+
+  if (node.list < Due && this->heads[node.list] == Nil) {
+    this->occupied[node.list / Slots] &= ~(1ull << (node.list % Slots));
+  }
+
+  node.list = Nil;
+}
+
+void TimerWheel::release(std::uint32_t index) noexcept {
+  auto &node = this->nodes[index];
+  node.task = nullptr;
+  node.generation++;
+  node.next = this->free_list;
+  this->free_list = index;
+  this->pending--;
+}
+
+void TimerWheel::take(std::uint32_t slot, std::uint32_t list) noexcept {
+  while (this->heads[slot] != Nil) {
+    auto index = this->heads[slot];
+    this->unlink(index);
+
+    if (list == Nil) {
+      this->schedule(index);
+    } else {
+      this->link(index, list);
+    }
+  }
+}
+
+std::uint64_t TimerWheel::nextEvent() const noexcept {
+  auto next = UINT64_MAX;
+
+  // the first occupied slot after the current one of every wheel, a wheel
+  // acts once the ones below turned over to that slot
+  for (unsigned level = 0; level < Levels; level++) {
+    if (this->occupied[level] == 0) {
+      continue;
+    }
+
+    unsigned shift = SlotBits * level;
+    auto position = this->current >> shift;
+    auto rotated = std::rotr(this->occupied[level],
+                             static_cast<int>((position + 1) & (Slots - 1)));
+    auto distance = static_cast<std::uint64_t>(std::countr_zero(rotated)) + 1;
+
+    next = std::min(next, (position + distance) << shift);
+  }
+
+  return next;
+}
+} // namespace W
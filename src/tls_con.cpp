@@ -0,0 +1,304 @@
+// Copyright 2024 Mina
+
+#include <webli/exceptions.hpp>
+#include <webli/tls_con.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <openssl/err.h>
+#include <sys/socket.h>
+
+namespace W {
+TlsCon::TlsCon(int sd, struct in_addr address, SSL_CTX *ctx, ConMode mode)
+    : Con(sd, address, mode), ssl(SSL_new(ctx)) {
+
+  if (this->mode == ConMode::Memory) {
+    this->rbio = BIO_new(BIO_s_mem());
+    this->wbio = BIO_new(BIO_s_mem());
+    SSL_set_bio(this->ssl, this->rbio, this->wbio);
+  } else {
+    SSL_set_fd(this->ssl, this->sd);
+  }
+
+  this->early_pending = SSL_get_max_early_data(this->ssl) > 0;
+
+  if (this->mode != ConMode::Blocking) {
+    SSL_set_accept_state(this->ssl);
+    return;
+  }
+
+  if (this->accept() != IoStatus::Ok) {
+    ERR_print_errors_fp(stderr);
+    // the socket gets closed by the base
+    SSL_free(this->ssl);
+    throw Exception("TLS Handshake failed");
+  }
+}
+
+TlsCon::~TlsCon() {
+  // a close before the client finished the handshake resets the connection
+  // with the response still in flight
+  if (this->early && this->mode == ConMode::Blocking) {
+    std::array<std::uint8_t, 4096> buffer;
+    std::size_t read{0};
+    while (SSL_read_early_data(this->ssl, buffer.data(), buffer.size(),
+                               &read) == SSL_READ_EARLY_DATA_SUCCESS) {
+    }
+    SSL_do_handshake(this->ssl);
+  }
+
+  SSL_shutdown(this->ssl);
+
+  if (this->mode == ConMode::Memory) {
+    // best effort close_notify, nobody waits for it
+    this->transmit(MSG_DONTWAIT);
+  }
+
+  SSL_free(this->ssl);
+}
+
+void TlsCon::writeAll(const std::uint8_t *data, int data_size) const {
+  // partial writes are enabled for the loops, so a blocking write may end
+  // after a single record
+  for (int sent = 0; sent < data_size;) {
+    int ret = this->sendData(data + sent, data_size - sent);
+    if (ret <= 0 || (this->mode == ConMode::Memory && !this->transmit())) {
+      ERR_print_errors_fp(stderr);
+      throw Exception("Write to client failed");
+    }
+
+    sent += ret;
+  }
+}
+
+std::size_t TlsCon::readAvailable(std::uint8_t *buffer,
+                                  int buffer_size) const {
+  int ret;
+
+  while ((ret = this->receiveData(buffer, buffer_size)) <= 0) {
+    // memory connections pull the next records themselves
+    if (this->mode == ConMode::Memory &&
+        SSL_get_error(this->ssl, ret) == SSL_ERROR_WANT_READ &&
+        this->transmit() && this->receive()) {
+      continue;
+    }
+
+    ERR_print_errors_fp(stderr);
+    throw Exception("Read from client failed");
+  }
+
+  return ret;
+}
+
+IoStatus TlsCon::accept() {
+  if (this->early_pending) {
+    std::array<std::uint8_t, 16384> buffer;
+    std::size_t read{0};
+
+    switch (SSL_read_early_data(this->ssl, buffer.data(), buffer.size(),
+                                &read)) {
+    case SSL_READ_EARLY_DATA_SUCCESS:
+      // the request is served while the client finishes the handshake
+      this->early_pending = false;
+      this->early = true;
+      this->early_input.assign(reinterpret_cast<const char *>(buffer.data()),
+                               read);
+      return IoStatus::Ok;
+
+    case SSL_READ_EARLY_DATA_FINISH:
+      // no early data, or it was refused and comes again after the handshake
+      this->early_pending = false;
+      break;
+
+    default:
+      return this->status(-1);
+    }
+  }
+
+  int ret = SSL_accept(this->ssl);
+  return (ret == 1) ? IoStatus::Ok : this->status(ret);
+}
+
+IoStatus TlsCon::readSome(std::uint8_t *buffer, int buffer_size,
+                       std::size_t &read) {
+  int ret = this->receiveData(buffer, buffer_size);
+  if (ret <= 0) {
+    return this->status(ret);
+  }
+
+  read = static_cast<std::size_t>(ret);
+  return IoStatus::Ok;
+}
+
+IoStatus TlsCon::writeSome(const std::uint8_t *data, int data_size,
+                        std::size_t &written) {
+  int ret = this->sendData(data, data_size);
+  if (ret <= 0) {
+    return this->status(ret);
+  }
+
+  written = static_cast<std::size_t>(ret);
+  return IoStatus::Ok;
+}
+
+void TlsCon::feed(const std::uint8_t *data, std::size_t data_size) {
+  BIO_write(this->rbio, data, static_cast<int>(data_size));
+}
+
+void TlsCon::feedEnd() { BIO_set_mem_eof_return(this->rbio, 0); }
+
+std::size_t TlsCon::drain(std::uint8_t *buffer, std::size_t buffer_size) {
+  int ret = BIO_read(this->wbio, buffer, static_cast<int>(buffer_size));
+  return (ret > 0) ? static_cast<std::size_t>(ret) : 0;
+}
+
+std::size_t TlsCon::pending() const noexcept {
+  return (this->wbio != nullptr) ? BIO_ctrl_pending(this->wbio) : 0;
+}
+
+std::string_view TlsCon::getProtocol() const noexcept {
+  const unsigned char *protocol{nullptr};
+  unsigned int size{0};
+  SSL_get0_alpn_selected(this->ssl, &protocol, &size);
+
+  if (size == 0) {
+    return Con::getProtocol();
+  }
+
+  return {reinterpret_cast<const char *>(protocol), size};
+}
+
+bool TlsCon::canSendFile() const noexcept {
+  return this->mode != ConMode::Memory &&
+         BIO_get_ktls_send(SSL_get_wbio(this->ssl));
+}
+
+IoStatus TlsCon::sendFileSome(int fd, std::size_t offset, std::size_t size,
+                              std::size_t &sent) {
+  auto ret = SSL_sendfile(this->ssl, fd, static_cast<off_t>(offset), size, 0);
+  if (ret <= 0) {
+    return this->status(static_cast<int>(ret));
+  }
+
+  sent = static_cast<std::size_t>(ret);
+  return IoStatus::Ok;
+}
+
+bool TlsCon::isResumed() const noexcept {
+  return SSL_session_reused(this->ssl) == 1;
+}
+
+bool TlsCon::isEarly() const noexcept { return this->early; }
+
+int TlsCon::receiveData(std::uint8_t *buffer, int buffer_size) const {
+  if (!this->early_input.empty()) {
+    auto size = std::min(this->early_input.size(),
+                         static_cast<std::size_t>(buffer_size));
+    std::memcpy(buffer, this->early_input.data(), size);
+    this->early_input.erase(0, size);
+    return static_cast<int>(size);
+  }
+
+  while (this->early) {
+    std::size_t read{0};
+
+    switch (SSL_read_early_data(this->ssl, buffer,
+                                static_cast<std::size_t>(buffer_size), &read)) {
+    case SSL_READ_EARLY_DATA_SUCCESS:
+      if (read > 0) {
+        return static_cast<int>(read);
+      }
+      break;
+
+    case SSL_READ_EARLY_DATA_FINISH:
+      // the rest comes after the handshake, which the next read completes
+      this->early = false;
+      break;
+
+    default:
+      return -1;
+    }
+  }
+
+  return SSL_read(this->ssl, buffer, buffer_size);
+}
+
+int TlsCon::sendData(const std::uint8_t *data, int data_size) const {
+  if (!this->early) {
+    return SSL_write(this->ssl, data, data_size);
+  }
+
+  std::size_t written{0};
+  return (SSL_write_early_data(this->ssl, data,
+                               static_cast<std::size_t>(data_size),
+                               &written) == 1)
+             ? static_cast<int>(written)
+             : -1;
+}
+
+IoStatus TlsCon::status(int ret) const noexcept {
+  switch (SSL_get_error(this->ssl, ret)) {
+  case SSL_ERROR_WANT_READ:
+    return IoStatus::WantRead;
+
+  case SSL_ERROR_WANT_WRITE:
+    return IoStatus::WantWrite;
+
+  case SSL_ERROR_ZERO_RETURN:
+    return IoStatus::Closed;
+
+  case SSL_ERROR_SYSCALL:
+    // a peer hanging up without close_notify is not worth a log line
+    ERR_clear_error();
+    return (errno == 0 || errno == ECONNRESET || errno == EPIPE)
+               ? IoStatus::Closed
+               : IoStatus::Error;
+
+  default:
+    ERR_print_errors_fp(stderr);
+    return IoStatus::Error;
+  }
+}
+
+bool TlsCon::receive() const {
+  std::array<std::uint8_t, 16384> buffer;
+
+  ssize_t ret;
+  do {
+    ret = ::recv(this->sd, buffer.data(), buffer.size(), 0);
+  } while (ret == -1 && errno == EINTR);
+
+  if (ret <= 0) {
+    return false;
+  }
+
+  BIO_write(this->rbio, buffer.data(), static_cast<int>(ret));
+  return true;
+}
+
+bool TlsCon::transmit(int flags) const {
+  std::array<std::uint8_t, 16384> buffer;
+
+  while (BIO_ctrl_pending(this->wbio) > 0) {
+    int size = BIO_read(this->wbio, buffer.data(), buffer.size());
+
+    for (int sent = 0; sent < size;) {
+      auto ret = ::send(this->sd, buffer.data() + sent, size - sent,
+                        flags | MSG_NOSIGNAL);
+      if (ret == -1 && errno == EINTR) {
+        continue;
+      }
+
+      if (ret <= 0) {
+        return false;
+      }
+
+      sent += static_cast<int>(ret);
+    }
+  }
+
+  return true;
+}
+} // namespace W
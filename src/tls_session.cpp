@@ -0,0 +1,354 @@
+// Copyright 2024 Mina
+
+#include <webli/tls_session.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+
+namespace W {
+/**
+ * @brief get the context slot of the ticket keys
+ *
+ * @return int
+ */
+static int ticketKeysIndex() {
+  static const int index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+/**
+ * @brief get the context slot of the session cache
+ *
+ * @return int
+ */
+static int sessionCacheIndex() {
+  static const int index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+/**
+ * @brief ticket key callback of the context, hands over to its keys
+ *
+ */
+static int ticketKeyCallback(SSL *ssl, unsigned char *name, unsigned char *iv,
+                             EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac,
+                             int encrypt) {
+  auto *keys = static_cast<TicketKeys *>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), ticketKeysIndex()));
+  return keys->crypt(name, iv, cipher, mac, encrypt);
+}
+
+/**
+ * @brief store a new session in the cache of the context
+ *
+ * @return int - 0, openssl keeps its reference
+ */
+static int newSession(SSL *ssl, SSL_SESSION *session) {
+  auto *cache = static_cast<SessionCache *>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), sessionCacheIndex()));
+
+  int size = i2d_SSL_SESSION(session, nullptr);
+  if (size <= 0) {
+    return 0;
+  }
+
+  std::string serialized(static_cast<std::size_t>(size), '\0');
+  auto *out = reinterpret_cast<unsigned char *>(serialized.data());
+  i2d_SSL_SESSION(session, &out);
+
+  unsigned int id_size{0};
+  const auto *id = SSL_SESSION_get_id(session, &id_size);
+  cache->add({reinterpret_cast<const char *>(id), id_size},
+             std::move(serialized));
+
+  // the cache keeps a copy, not the session itself
+  return 0;
+}
+
+/**
+ * @brief look up a session in the cache of the context
+ *
+ * @return SSL_SESSION* - null if unknown
+ */
+static SSL_SESSION *getSession(SSL *ssl, const unsigned char *id, int id_size,
+                               int *copy) {
+  auto *cache = static_cast<SessionCache *>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), sessionCacheIndex()));
+
+  // the new session belongs to openssl, no extra reference
+  *copy = 0;
+
+  auto serialized = cache->find(
+      {reinterpret_cast<const char *>(id), static_cast<std::size_t>(id_size)});
+  if (serialized.empty()) {
+    return nullptr;
+  }
+
+  const auto *in = reinterpret_cast<const unsigned char *>(serialized.data());
+  return d2i_SSL_SESSION(nullptr, &in, static_cast<long>(serialized.size()));
+}
+
+/**
+ * @brief drop a session openssl found expired or broken
+ *
+ */
+static void removeSession(SSL_CTX *ctx, SSL_SESSION *session) {
+  auto *cache =
+      static_cast<SessionCache *>(SSL_CTX_get_ex_data(ctx, sessionCacheIndex()));
+
+  unsigned int id_size{0};
+  const auto *id = SSL_SESSION_get_id(session, &id_size);
+  cache->remove({reinterpret_cast<const char *>(id), id_size});
+}
+
+/**
+ * @brief get the context slot of the early data guard
+ *
+ * @return int
+ */
+static int earlyDataGuardIndex() {
+  static const int index =
+      SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  return index;
+}
+
+/**
+ * @brief allow early data callback of the context, refuses replays
+ *
+ * @return int - 1 to take the early data
+ */
+static int allowEarlyData(SSL *ssl, void *) {
+  auto *guard = static_cast<EarlyDataGuard *>(
+      SSL_CTX_get_ex_data(SSL_get_SSL_CTX(ssl), earlyDataGuardIndex()));
+
+  std::array<unsigned char, SSL3_RANDOM_SIZE> random{};
+  auto size = SSL_get_client_random(ssl, random.data(), random.size());
+
+  return guard->fresh({reinterpret_cast<const char *>(random.data()), size})
+             ? 1
+             : 0;
+}
+
+TicketKeys::TicketKeys(std::chrono::seconds rotation, std::string secret)
+    : rotation(std::max(rotation, std::chrono::seconds(1))),
+      secret(std::move(secret)) {
+  std::lock_guard lock{this->mutex};
+  this->rotate();
+}
+
+void TicketKeys::install(SSL_CTX *ctx) {
+  SSL_CTX_set_ex_data(ctx, ticketKeysIndex(), this);
+  SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, &ticketKeyCallback);
+}
+
+int TicketKeys::crypt(unsigned char *name, unsigned char *iv,
+                      EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int encrypt) {
+  std::lock_guard lock{this->mutex};
+  if (!this->rotate()) {
+    return -1;
+  }
+
+  const Key *key = &this->current;
+
+  if (encrypt == 1) {
+    std::memcpy(name, key->name.data(), key->name.size());
+    if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1) {
+      return -1;
+    }
+  } else if (std::memcmp(name, this->previous.name.data(),
+                         this->previous.name.size()) == 0 &&
+             this->previous.period + 1 == this->current.period) {
+    key = &this->previous;
+  } else if (std::memcmp(name, key->name.data(), key->name.size()) != 0) {
+    // unknown or expired key, the client gets a full handshake
+    return 0;
+  }
+
+  OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_octet_string(
+          OSSL_MAC_PARAM_KEY, const_cast<unsigned char *>(key->hmac.data()),
+          key->hmac.size()),
+      OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+                                       const_cast<char *>("SHA256"), 0),
+      OSSL_PARAM_construct_end()};
+
+  if (EVP_MAC_CTX_set_params(mac, params) != 1) {
+    return -1;
+  }
+
+  int ret = (encrypt == 1)
+                ? EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr,
+                                     key->aes.data(), iv)
+                : EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr,
+                                     key->aes.data(), iv);
+  if (ret != 1) {
+    return -1;
+  }
+
+  // tickets of the previous key get replaced by fresh ones
+  return (key == &this->previous) ? 2 : 1;
+}
+
+bool TicketKeys::rotate() {
+  auto period = static_cast<std::uint64_t>(
+      std::chrono::system_clock::now().time_since_epoch() / this->rotation);
+
+  if (period == this->current.period) {
+    return true;
+  }
+
+  Key next{};
+  if (!this->derive(period, next)) {
+    return false;
+  }
+
+  if (!this->secret.empty()) {
+    // peers may have issued tickets with the previous key already
+    if (!this->derive(period - 1, this->previous)) {
+      return false;
+    }
+  } else if (this->current.period + 1 == period) {
+    this->previous = this->current;
+  } else {
+    // keys skipped by an idle server are expired anyway
+    this->previous = Key{};
+  }
+
+  this->current = next;
+  return true;
+}
+
+bool TicketKeys::derive(std::uint64_t period, Key &key) const {
+  std::array<unsigned char, 80> material{};
+
+  if (this->secret.empty()) {
+    if (RAND_bytes(material.data(), static_cast<int>(material.size())) != 1) {
+      return false;
+    }
+  } else {
+    // expand the secret like hkdf-expand, one hmac block at a time
+    std::array<unsigned char, 32> block{};
+    unsigned int block_size{0};
+
+    for (std::size_t offset = 0, i = 1; offset < material.size(); i++) {
+      std::string info{"webli ticket key "};
+      info += std::to_string(period);
+      info.append(reinterpret_cast<const char *>(block.data()), block_size);
+      info.push_back(static_cast<char>(i));
+
+      if (HMAC(EVP_sha256(), this->secret.data(),
+               static_cast<int>(this->secret.size()),
+               reinterpret_cast<const unsigned char *>(info.data()),
+               info.size(), block.data(), &block_size) == nullptr) {
+        return false;
+      }
+
+      auto size = std::min<std::size_t>(block_size, material.size() - offset);
+      std::memcpy(material.data() + offset, block.data(), size);
+      offset += size;
+    }
+  }
+
+  key.period = period;
+  std::memcpy(key.name.data(), material.data(), key.name.size());
+  std::memcpy(key.aes.data(), material.data() + 16, key.aes.size());
+  std::memcpy(key.hmac.data(), material.data() + 48, key.hmac.size());
+  return true;
+}
+
+EarlyDataGuard::EarlyDataGuard(std::chrono::seconds window)
+    : window(window), started(std::chrono::steady_clock::now()) {}
+
+void EarlyDataGuard::install(SSL_CTX *ctx) {
+  SSL_CTX_set_ex_data(ctx, earlyDataGuardIndex(), this);
+  SSL_CTX_set_allow_early_data_cb(ctx, &allowEarlyData, nullptr);
+}
+
+bool EarlyDataGuard::fresh(std::string_view random) {
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard lock{this->mutex};
+
+  if (now - this->started >= this->window) {
+    // after two windows without traffic both generations are stale
+    this->previous = (now - this->started >= 2 * this->window)
+                         ? std::unordered_set<std::string>{}
+                         : std::move(this->current);
+    this->current.clear();
+    this->started = now;
+  }
+
+  std::string key{random};
+  if (this->previous.contains(key)) {
+    return false;
+  }
+
+  return this->current.insert(std::move(key)).second;
+}
+
+SessionCache::SessionCache(std::size_t capacity, std::size_t shards)
+    : capacity(std::max<std::size_t>(capacity / std::max<std::size_t>(shards, 1),
+                                     1)),
+      shard_count(std::max<std::size_t>(shards, 1)),
+      shards(std::make_unique<Shard[]>(this->shard_count)) {}
+
+void SessionCache::install(SSL_CTX *ctx) {
+  SSL_CTX_set_ex_data(ctx, sessionCacheIndex(), this);
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER |
+                                          SSL_SESS_CACHE_NO_INTERNAL);
+  SSL_CTX_sess_set_new_cb(ctx, &newSession);
+  SSL_CTX_sess_set_get_cb(ctx, &getSession);
+  SSL_CTX_sess_set_remove_cb(ctx, &removeSession);
+}
+
+void SessionCache::add(std::string_view id, std::string session) {
+  auto &shard = this->shardOf(id);
+  std::lock_guard lock{shard.mutex};
+
+  if (auto it = shard.entries.find(std::string(id));
+      it != shard.entries.end()) {
+    it->second.session = std::move(session);
+    return;
+  }
+
+  while (shard.entries.size() >= this->capacity) {
+    shard.entries.erase(shard.order.front());
+    shard.order.pop_front();
+  }
+
+  shard.order.emplace_back(id);
+  shard.entries.emplace(std::string(id),
+                        Entry{std::move(session), std::prev(shard.order.end())});
+}
+
+std::string SessionCache::find(std::string_view id) {
+  auto &shard = this->shardOf(id);
+  std::lock_guard lock{shard.mutex};
+
+  auto it = shard.entries.find(std::string(id));
+  return (it != shard.entries.end()) ? it->second.session : std::string{};
+}
+
+void SessionCache::remove(std::string_view id) {
+  auto &shard = this->shardOf(id);
+  std::lock_guard lock{shard.mutex};
+
+  auto it = shard.entries.find(std::string(id));
+  if (it == shard.entries.end()) {
+    return;
+  }
+
+  shard.order.erase(it->second.order);
+  shard.entries.erase(it);
+}
+
+SessionCache::Shard &SessionCache::shardOf(std::string_view id) noexcept {
+  return this->shards[std::hash<std::string_view>{}(id) % this->shard_count];
+}
+} // namespace W
@@ -0,0 +1,628 @@
+// Copyright 2024 Mina
+
+#include <webli/exceptions.hpp>
+#include <webli/uring_loop.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace W {
+/** @brief size of one provided receive buffer (one full tls record) */
+static constexpr const std::size_t RecvBufferSize = 16384;
+
+/** @brief number of provided receive buffers */
+static constexpr const std::uint16_t RecvBufferCount = 128;
+
+/** @brief size of one send buffer */
+static constexpr const std::size_t SendBufferSize = 16384;
+
+/** @brief number of send buffers */
+static constexpr const int SendBufferCount = 128;
+
+/** @brief buffer group of the provided receive buffers */
+static constexpr const std::uint16_t RecvBufferGroup = 0;
+
+/** @brief time closed connections get to send their rest after `stop` */
+static constexpr const std::chrono::milliseconds LingerTimeout{1000};
+
+/** @brief features the loop relies on */
+static constexpr const std::uint32_t RequiredFeatures =
+    IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+
+static int uringSetup(unsigned entries, struct io_uring_params &params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+}
+
+static std::uint64_t userData(std::uint64_t id, std::uint8_t op) noexcept {
+  return (id << 8) | op;
+}
+
+UringLoop::UringLoop(unsigned entries) {
+  struct io_uring_params params{};
+
+  this->ringfd = uringSetup(entries, params);
+  if (this->ringfd == -1) {
+    perror("[Webli] UringLoop");
+    throw Exception("io_uring setup failed");
+  }
+
+  if ((params.features & RequiredFeatures) != RequiredFeatures) {
+    ::close(this->ringfd);
+    throw Exception("io_uring lacks required features");
+  }
+
+  this->entries = params.sq_entries;
+
+  // single mmap: both rings live in the submission ring mapping
+  this->rings_size =
+      std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+               params.cq_off.cqes +
+                   params.cq_entries * sizeof(struct io_uring_cqe));
+  this->rings = mmap(nullptr, this->rings_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, this->ringfd,
+                     IORING_OFF_SQ_RING);
+
+  this->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  void *sqes = mmap(nullptr, this->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, this->ringfd, IORING_OFF_SQES);
+
+  if (this->rings == MAP_FAILED || sqes == MAP_FAILED) {
+    perror("[Webli] UringLoop");
+    if (this->rings != MAP_FAILED) {
+      munmap(this->rings, this->rings_size);
+    }
+    ::close(this->ringfd);
+    throw Exception("io_uring mmap failed");
+  }
+
+  auto *base = static_cast<std::uint8_t *>(this->rings);
+  this->sqes = static_cast<struct io_uring_sqe *>(sqes);
+  this->sq_head = reinterpret_cast<unsigned *>(base + params.sq_off.head);
+  this->sq_tail = reinterpret_cast<unsigned *>(base + params.sq_off.tail);
+  this->sq_mask = *reinterpret_cast<unsigned *>(base + params.sq_off.ring_mask);
+  this->sq_array = reinterpret_cast<unsigned *>(base + params.sq_off.array);
+  this->sq_local_tail = *this->sq_tail;
+  this->cq_head = reinterpret_cast<unsigned *>(base + params.cq_off.head);
+  this->cq_tail = reinterpret_cast<unsigned *>(base + params.cq_off.tail);
+  this->cq_mask = *reinterpret_cast<unsigned *>(base + params.cq_off.ring_mask);
+  this->cqes =
+      reinterpret_cast<struct io_uring_cqe *>(base + params.cq_off.cqes);
+
+  this->recv_buffers =
+      std::make_unique<std::uint8_t[]>(RecvBufferSize * RecvBufferCount);
+  this->provide(0, RecvBufferCount);
+
+  this->send_buffers =
+      std::make_unique<std::uint8_t[]>(SendBufferSize * SendBufferCount);
+
+  std::vector<struct iovec> iovecs(SendBufferCount);
+  for (int i = 0; i < SendBufferCount; i++) {
+    iovecs[i].iov_base = this->send_buffers.get() + i * SendBufferSize;
+    iovecs[i].iov_len = SendBufferSize;
+    this->free_slots.push_back(SendBufferCount - 1 - i);
+  }
+
+  // pinning can exceed RLIMIT_MEMLOCK, plain sends work without it
+  this->fixed_buffers =
+      syscall(__NR_io_uring_register, this->ringfd, IORING_REGISTER_BUFFERS,
+              iovecs.data(), SendBufferCount) == 0;
+}
+
+UringLoop::~UringLoop() {
+  // closing the ring cancels everything still in flight
+  ::close(this->ringfd);
+  munmap(this->sqes, this->sqes_size);
+  munmap(this->rings, this->rings_size);
+
+  // callbacks may own connections that want to unregister on destruction
+  auto connections = std::move(this->connections);
+  connections.clear();
+}
+
+bool UringLoop::supported() noexcept {
+  struct io_uring_params params{};
+
+  int fd = uringSetup(1, params);
+  if (fd == -1) {
+    return false;
+  }
+
+  ::close(fd);
+  return (params.features & RequiredFeatures) == RequiredFeatures;
+}
+
+void UringLoop::accept(int sd, const AcceptCallback &callback) {
+  this->listeners.push_back(
+      std::make_unique<Listener>(Listener{sd, callback, {}, 0, false}));
+  this->armAccept(this->listeners.size() - 1);
+}
+
+void UringLoop::stopAccept(int sd) {
+  for (std::size_t i = 0; i < this->listeners.size(); i++) {
+    if (this->listeners[i]->sd != sd || this->listeners[i]->stopped) {
+      continue;
+    }
+
+    this->listeners[i]->stopped = true;
+    this->cancelOp(i, Op::Accept);
+    this->cancelOp(i, Op::Ready);
+  }
+}
+
+void UringLoop::attach(Con &con, std::uint32_t events,
+                       const Callback &callback) {
+  std::uint64_t id = this->next_id++;
+
+  auto &entry = this->connections[id];
+  entry = Connection{&con,  nullptr, std::make_shared<Callback>(callback),
+                     nullptr, events, false,
+                     false, false,  -1,
+                     0,     0};
+  this->ids[con.getDescriptor()] = id;
+
+  if (events & EPOLLIN) {
+    this->armRecv(id, entry);
+  }
+}
+
+void UringLoop::modify(Con &con, std::uint32_t events) {
+  std::uint64_t id = this->find(con);
+  if (id == 0) {
+    return;
+  }
+
+  auto &entry = this->connections[id];
+  entry.events = events;
+
+  if ((events & EPOLLIN) && !entry.receiving && !entry.eof) {
+    this->armRecv(id, entry);
+  }
+}
+
+void UringLoop::detach(Con &con, Task done) {
+  std::uint64_t id = this->find(con);
+  if (id == 0) {
+    done();
+    return;
+  }
+
+  // the pending recv may still complete with bytes and a send may still be
+  // in flight, the new owner takes over once both are back
+  auto &entry = this->connections[id];
+  entry.callback.reset();
+  entry.handover = std::move(done);
+  this->ids.erase(con.getDescriptor());
+
+  if (entry.receiving) {
+    this->cancelOp(id, Op::Recv);
+  }
+
+  this->reap(id);
+}
+
+void UringLoop::close(std::unique_ptr<Con> con) {
+  std::uint64_t id = this->find(*con);
+  if (id == 0) {
+    return;
+  }
+
+  auto &entry = this->connections[id];
+  entry.callback.reset();
+  entry.owned = std::move(con);
+  this->ids.erase(entry.con->getDescriptor());
+
+  if (entry.receiving) {
+    this->cancelOp(id, Op::Recv);
+  }
+
+  // the connection lingers until the response left the send buffers
+  this->transmit(id, entry);
+  this->reap(id);
+}
+
+void UringLoop::flush(Con &con) {
+  std::uint64_t id = this->find(con);
+  if (id != 0) {
+    this->transmit(id, this->connections[id]);
+  }
+}
+
+ConMode UringLoop::connectionMode() const noexcept { return ConMode::Memory; }
+
+void UringLoop::run() {
+  std::vector<struct io_uring_cqe> batch;
+  Executor::Scope scope{this};
+
+  auto poll = [this, &batch](int timeout_ms) {
+    if (this->enter(1, timeout_ms) == -1 && errno != EINTR &&
+        errno != ETIME && errno != EBUSY && errno != EAGAIN) {
+      perror("[Webli] UringLoop::run");
+      return false;
+    }
+
+    // handlers queue new entries, so free the completion ring first
+    unsigned head = *this->cq_head;
+    unsigned tail = __atomic_load_n(this->cq_tail, __ATOMIC_ACQUIRE);
+
+    batch.clear();
+    for (; head != tail; head++) {
+      batch.push_back(this->cqes[head & this->cq_mask]);
+    }
+    __atomic_store_n(this->cq_head, head, __ATOMIC_RELEASE);
+
+    for (const auto &cqe : batch) {
+      this->complete(cqe);
+    }
+    return true;
+  };
+
+  this->armWake();
+
+  while (this->running) {
+    if (!poll(this->timeout())) {
+      return;
+    }
+
+    this->runTimers();
+  }
+
+  // closed connections may still have their last response in the send
+  // buffers, give them a moment to leave
+  auto deadline = std::chrono::steady_clock::now() + LingerTimeout;
+  while (std::chrono::steady_clock::now() < deadline &&
+         std::any_of(this->connections.begin(), this->connections.end(),
+                     [](const auto &entry) { return entry.second.owned != nullptr; })) {
+    if (!poll(static_cast<int>(LingerTimeout.count()))) {
+      return;
+    }
+  }
+}
+
+struct io_uring_sqe *UringLoop::nextEntry() {
+  if (this->sq_local_tail - __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE) >=
+      this->entries) {
+    this->enter(0, 0);
+  }
+
+  unsigned index = this->sq_local_tail & this->sq_mask;
+  this->sq_array[index] = index;
+  this->sq_local_tail++;
+
+  auto *sqe = &this->sqes[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+int UringLoop::enter(unsigned wait, int timeout_ms) {
+  __atomic_store_n(this->sq_tail, this->sq_local_tail, __ATOMIC_RELEASE);
+
+  unsigned to_submit =
+      this->sq_local_tail - __atomic_load_n(this->sq_head, __ATOMIC_ACQUIRE);
+  unsigned flags = (wait > 0) ? IORING_ENTER_GETEVENTS : 0;
+
+  struct __kernel_timespec ts{};
+  struct io_uring_getevents_arg arg{};
+  arg.sigmask_sz = _NSIG / 8;
+
+  if (timeout_ms >= 0) {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000LL;
+    arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+  }
+
+  return static_cast<int>(syscall(__NR_io_uring_enter, this->ringfd, to_submit,
+                                  wait, flags | IORING_ENTER_EXT_ARG, &arg,
+                                  sizeof(arg)));
+}
+
+void UringLoop::complete(const struct io_uring_cqe &cqe) {
+  auto op = static_cast<Op>(cqe.user_data & 0xff);
+  std::uint64_t id = cqe.user_data >> 8;
+
+  switch (op) {
+  case Op::Wake: {
+    std::uint64_t counter;
+    [[maybe_unused]] auto ret = ::read(this->wakefd, &counter, sizeof(counter));
+
+    this->armWake();
+    this->runPosted();
+    return;
+  }
+
+  case Op::Accept: {
+    auto &listener = *this->listeners[id];
+    if (cqe.res >= 0) {
+      // accepted before the cancel got through, still serve it
+      listener.callback(cqe.res, listener.addr.sin_addr);
+    } else if (cqe.res == -EAGAIN && !listener.stopped) {
+      // non-blocking listener on an older kernel, wait until it is readable
+      this->armReady(id);
+      return;
+    } else if (cqe.res != -EINTR && cqe.res != -ECONNABORTED &&
+               cqe.res != -ECANCELED) {
+      errno = -cqe.res;
+      perror("[Webli] Accept");
+    }
+
+    if (!listener.stopped) {
+      this->armAccept(id);
+    }
+    return;
+  }
+
+  case Op::Ready:
+    if (!this->listeners[id]->stopped) {
+      this->armAccept(id);
+    }
+    return;
+
+  case Op::Provide:
+    if (cqe.res < 0) {
+      errno = -cqe.res;
+      perror("[Webli] UringLoop provide buffers");
+    }
+    return;
+
+  case Op::Cancel:
+    // the canceled recv reports itself
+    return;
+
+  case Op::Recv:
+  case Op::Send:
+    break;
+  }
+
+  auto it = this->connections.find(id);
+  if (it == this->connections.end()) {
+    return;
+  }
+
+  auto &entry = it->second;
+
+  if (op == Op::Send) {
+    bool failed = cqe.res <= 0 && cqe.res != -EINTR && cqe.res != -EAGAIN;
+
+    if (failed) {
+      // a failing peer reads as a hangup on the next read
+      entry.eof = true;
+      entry.sent = entry.size;
+      if (entry.callback) {
+        entry.con->feedEnd();
+      }
+    } else if (cqe.res > 0) {
+      entry.sent += static_cast<std::size_t>(cqe.res);
+    }
+
+    if (entry.sent < entry.size) {
+      this->send(id, entry);
+      return;
+    }
+
+    this->free_slots.push_back(entry.slot);
+    entry.slot = -1;
+    this->transmit(id, entry);
+
+    // hand free buffers to the connections in line
+    while (!this->free_slots.empty() && !this->send_waiters.empty()) {
+      auto waiter = this->send_waiters.front();
+      this->send_waiters.pop_front();
+
+      auto w = this->connections.find(waiter);
+      if (w != this->connections.end()) {
+        w->second.waiting = false;
+        this->transmit(waiter, w->second);
+        this->reap(waiter);
+      }
+    }
+
+    // the waiters never erase the entry, it is still valid here
+    if (failed && entry.callback) {
+      auto callback = entry.callback;
+      (*callback)(EPOLLIN | EPOLLHUP);
+      return;
+    }
+
+    this->reap(id);
+    return;
+  }
+
+  entry.receiving = false;
+
+  if (cqe.res == -ENOBUFS && entry.callback) {
+    // retried as soon as a buffer comes back
+    this->starved.push_back(id);
+    return;
+  }
+
+  std::uint32_t events = EPOLLIN;
+
+  if (cqe.flags & IORING_CQE_F_BUFFER) {
+    auto bid = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+    if (cqe.res > 0 && (entry.callback || entry.handover)) {
+      entry.con->feed(this->recv_buffers.get() + bid * RecvBufferSize,
+                      static_cast<std::size_t>(cqe.res));
+    }
+
+    this->provide(bid, 1);
+
+    auto starved = std::move(this->starved);
+    this->starved.clear();
+    for (auto waiter : starved) {
+      auto w = this->connections.find(waiter);
+      if (w != this->connections.end() && w->second.callback &&
+          (w->second.events & EPOLLIN) && !w->second.receiving) {
+        this->armRecv(waiter, w->second);
+      }
+    }
+  }
+
+  if (cqe.res <= 0 && cqe.res != -EINTR && cqe.res != -EAGAIN) {
+    entry.eof = true;
+    events |= EPOLLHUP;
+    if (entry.callback) {
+      entry.con->feedEnd();
+    }
+  }
+
+  if (!entry.callback) {
+    this->reap(id);
+    return;
+  }
+
+  if (!(entry.events & EPOLLIN)) {
+    // paused, the records wait in the connection
+    return;
+  }
+
+  // keep the callback alive in case it unregisters itself
+  auto callback = entry.callback;
+  (*callback)(events);
+
+  // the callback may have closed the connection or rehashed the map
+  it = this->connections.find(id);
+  if (it != this->connections.end() && it->second.callback &&
+      (it->second.events & EPOLLIN) && !it->second.receiving &&
+      !it->second.eof) {
+    this->armRecv(id, it->second);
+  }
+}
+
+void UringLoop::armWake() {
+  auto *sqe = this->nextEntry();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = this->wakefd;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = userData(0, static_cast<std::uint8_t>(Op::Wake));
+}
+
+void UringLoop::armAccept(std::size_t index) {
+  auto &listener = *this->listeners[index];
+  listener.addr_len = sizeof(listener.addr);
+
+  auto *sqe = this->nextEntry();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listener.sd;
+  sqe->addr = reinterpret_cast<std::uint64_t>(&listener.addr);
+  sqe->addr2 = reinterpret_cast<std::uint64_t>(&listener.addr_len);
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = userData(index, static_cast<std::uint8_t>(Op::Accept));
+}
+
+void UringLoop::armReady(std::size_t index) {
+  auto *sqe = this->nextEntry();
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = this->listeners[index]->sd;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = userData(index, static_cast<std::uint8_t>(Op::Ready));
+}
+
+void UringLoop::cancelOp(std::uint64_t id, Op op) {
+  auto *sqe = this->nextEntry();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->addr = userData(id, static_cast<std::uint8_t>(op));
+  sqe->user_data = userData(id, static_cast<std::uint8_t>(Op::Cancel));
+}
+
+void UringLoop::armRecv(std::uint64_t id, Connection &entry) {
+  entry.receiving = true;
+
+  auto *sqe = this->nextEntry();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = entry.con->getDescriptor();
+  sqe->len = RecvBufferSize;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = RecvBufferGroup;
+  sqe->user_data = userData(id, static_cast<std::uint8_t>(Op::Recv));
+}
+
+void UringLoop::provide(std::uint16_t bid, std::uint16_t count) {
+  auto *sqe = this->nextEntry();
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = count;
+  sqe->addr = reinterpret_cast<std::uint64_t>(this->recv_buffers.get() +
+                                              bid * RecvBufferSize);
+  sqe->len = RecvBufferSize;
+  sqe->off = bid;
+  sqe->buf_group = RecvBufferGroup;
+  sqe->user_data = userData(0, static_cast<std::uint8_t>(Op::Provide));
+}
+
+void UringLoop::send(std::uint64_t id, Connection &entry) {
+  auto *data = this->send_buffers.get() + entry.slot * SendBufferSize;
+  auto *con = (entry.owned != nullptr) ? entry.owned.get() : entry.con;
+
+  auto *sqe = this->nextEntry();
+  sqe->fd = con->getDescriptor();
+  sqe->addr = reinterpret_cast<std::uint64_t>(data + entry.sent);
+  sqe->len = static_cast<std::uint32_t>(entry.size - entry.sent);
+  sqe->user_data = userData(id, static_cast<std::uint8_t>(Op::Send));
+
+  if (this->fixed_buffers) {
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->buf_index = static_cast<std::uint16_t>(entry.slot);
+  } else {
+    sqe->opcode = IORING_OP_SEND;
+    sqe->msg_flags = MSG_NOSIGNAL;
+  }
+}
+
+void UringLoop::transmit(std::uint64_t id, Connection &entry) {
+  auto *con = (entry.owned != nullptr) ? entry.owned.get() : entry.con;
+  if (con == nullptr || entry.slot != -1 || entry.waiting || entry.eof ||
+      con->pending() == 0) {
+    return;
+  }
+
+  if (this->free_slots.empty()) {
+    entry.waiting = true;
+    this->send_waiters.push_back(id);
+    return;
+  }
+
+  entry.slot = this->free_slots.back();
+  this->free_slots.pop_back();
+
+  entry.sent = 0;
+  entry.size = con->drain(this->send_buffers.get() + entry.slot * SendBufferSize,
+                          SendBufferSize);
+  this->send(id, entry);
+}
+
+void UringLoop::reap(std::uint64_t id) {
+  auto it = this->connections.find(id);
+  if (it == this->connections.end() || it->second.callback) {
+    return;
+  }
+
+  auto &entry = it->second;
+  if (entry.receiving || entry.slot != -1 || entry.waiting ||
+      (entry.owned != nullptr && !entry.eof && entry.owned->pending() > 0)) {
+    return;
+  }
+
+  // destroys a closed connection, a detached one goes to its new owner
+  auto handover = std::move(entry.handover);
+  this->connections.erase(it);
+  if (handover) {
+    handover();
+  }
+}
+
+std::uint64_t UringLoop::find(const Con &con) const noexcept {
+  auto it = this->ids.find(con.getDescriptor());
+  return (it != this->ids.end()) ? it->second : 0;
+}
+} // namespace W
@@ -257,18 +257,25 @@ void WebsocketConnection::process() {
 }
 
 void WebsocketConnection::sendFrame(const WebsocketFrame &frame) const {
-  auto header_data = frame.header.build();
-
-  // more funny haha
-  this->con.write(header_data.data(), static_cast<int>(header_data.size()));
-  this->con.write(frame.payload.data(), static_cast<int>(frame.payload.size()));
+  this->queueFrame(frame);
+  this->con.flush();
 }
 
 void WebsocketConnection::sendMultiple(
     const std::vector<WebsocketFrame> &frames) const {
+  // small frames share their tls records
   for (const auto &frame : frames) {
-    this->sendFrame(frame);
+    this->queueFrame(frame);
   }
+  this->con.flush();
+}
+
+void WebsocketConnection::queueFrame(const WebsocketFrame &frame) const {
+  auto header_data = frame.header.build();
+
+  // header and payload meet in the write buffer of the connection
+  this->con.write(header_data.data(), static_cast<int>(header_data.size()));
+  this->con.write(frame.payload.data(), static_cast<int>(frame.payload.size()));
 }
 
 void WebsocketConnection::ping() const {